@@ -0,0 +1,139 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/**
+ * 4 KB appends to a temporary file with an fsync every 64 records, issued
+ * from a DispatchThread: blocking pwrite/fsync on the thread itself, the
+ * thread pool fallback and io_uring. Prints the throughput and how long the
+ * dispatch thread was kept busy issuing the I/O, i.e. not running other
+ * tasks.
+ *
+ * $> ./AsyncFileIoBench [records]
+ */
+#include <AsyncFileIo.h>
+#include <DispatchThread.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+using namespace CppUtils;
+using namespace std;
+
+namespace {
+
+const size_t kRecordSize = 4096;
+const size_t kSyncEvery = 64;
+
+int TempFd()
+{
+  char path[] = "/tmp/AsyncFileIoBenchXXXXXX";
+  int fd = mkstemp( path );
+  if( fd < 0 ) {
+    abort();
+  }
+  unlink( path );
+  return fd;
+}
+
+void Print( const char* pName, size_t records, chrono::steady_clock::duration elapsed, chrono::steady_clock::duration busy )
+{
+  double seconds = chrono::duration<double>( elapsed ).count();
+  cout << setw( 14 ) << left << pName << right << fixed << setprecision( 0 )
+       << setw( 8 ) << records / seconds << " records/s"
+       << setw( 10 ) << chrono::duration<double, micro>( busy ).count() / records * 1000 << " ns/record on the thread"
+       << endl;
+}
+
+void Blocking( DispatchThread& thr, size_t records, const vector<char>& record )
+{
+  int fd = TempFd();
+  chrono::steady_clock::duration busy{};
+  auto start = chrono::steady_clock::now();
+  thr.DispatchSync( [&]() {
+    for( size_t i = 0; i < records; i++ ) {
+      if( pwrite( fd, record.data(), kRecordSize, i * kRecordSize ) != kRecordSize ) {
+        abort();
+      }
+      if( i % kSyncEvery == kSyncEvery - 1 ) {
+        fsync( fd );
+      }
+    }
+    busy = chrono::steady_clock::now() - start;
+  } );
+  Print( "blocking", records, chrono::steady_clock::now() - start, busy );
+  close( fd );
+}
+
+void Async( const char* pName, DispatchThread& thr, AAsyncFileIo& io, size_t records, const vector<char>& record )
+{
+  int fd = TempFd();
+  atomic<size_t> completed{ 0 };
+  promise<void> done;
+  size_t expected = records + records / kSyncEvery;
+  AAsyncFileIo::Callback onDone = [&]( ssize_t result ) {
+    if( result < 0 ) {
+      abort();
+    }
+    if( ++completed == expected ) {
+      done.set_value();
+    }
+  };
+  chrono::steady_clock::duration busy{};
+  auto start = chrono::steady_clock::now();
+  thr.DispatchSync( [&]() {
+    for( size_t i = 0; i < records; i++ ) {
+      io.Write( fd, record.data(), kRecordSize, i * kRecordSize, onDone );
+      if( i % kSyncEvery == kSyncEvery - 1 ) {
+        io.Fsync( fd, onDone );
+      }
+    }
+    busy = chrono::steady_clock::now() - start;
+  } );
+  done.get_future().wait();
+  Print( pName, records, chrono::steady_clock::now() - start, busy );
+  close( fd );
+}
+
+}
+
+int main( int argc, char** argv )
+{
+  size_t records = argc > 1 ? strtoull( argv[ 1 ], nullptr, 10 ) : 20000;
+  vector<char> record( kRecordSize, 'r' );
+  cout << records << " records of " << kRecordSize << " bytes, fsync every " << kSyncEvery << endl;
+  DispatchThread thr;
+  Blocking( thr, records, record );
+  {
+    ThreadPoolFileIo pool( [&thr]( Task task ) { return thr.PostToDispatch( std::move( task ) ); } );
+    Async( "thread pool", thr, pool, records, record );
+  }
+  auto spIo = MakeAsyncFileIo( thr );
+  if( string( spIo->Backend() ) == "io_uring" ) {
+    Async( "io_uring", thr, *spIo, records, record );
+  }
+  return 0;
+}
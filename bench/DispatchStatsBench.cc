@@ -0,0 +1,85 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/**
+ * Cost of DispatchStats: posts and runs tiny tasks on a DispatchThread and an
+ * InstrumentedDispatchThread and prints the throughput of both, then the
+ * instrumented thread's snapshot.
+ *
+ * $> ./DispatchStatsBench [tasks]
+ */
+#include <DispatchThread.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+using namespace CppUtils;
+using namespace std;
+
+namespace {
+
+template<typename DispatchThreadType>
+double Run( DispatchThreadType& thr, size_t tasks )
+{
+  atomic<uint64_t> sum{ 0 };
+  auto start = chrono::steady_clock::now();
+  for( size_t i = 0; i < tasks; i++ ) {
+    thr.PostToDispatch( [i, &sum]() { sum.fetch_add( i, memory_order_relaxed ); } );
+  }
+  thr.DispatchSync( []() {} );
+  return chrono::duration<double, nano>( chrono::steady_clock::now() - start ).count() / tasks;
+}
+
+void Print( const char* pName, const HdrHistogram::Snapshot& histogram )
+{
+  cout << setw( 12 ) << left << pName << right
+       << " p50 " << setw( 9 ) << histogram.ValueAtPercentile( 50 )
+       << " p99 " << setw( 9 ) << histogram.ValueAtPercentile( 99 )
+       << " p99.9 " << setw( 9 ) << histogram.ValueAtPercentile( 99.9 )
+       << " max " << setw( 9 ) << histogram.Max() << " ns" << endl;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+  size_t tasks = argc > 1 ? strtoull( argv[ 1 ], nullptr, 10 ) : 2000000;
+  cout << "Post and run " << tasks << " tasks" << endl;
+  {
+    DispatchThread thr;
+    cout << setw( 28 ) << left << "DispatchThread" << right << fixed << setprecision( 1 )
+         << setw( 8 ) << Run( thr, tasks ) << " ns/task" << endl;
+  }
+  InstrumentedDispatchThread thr;
+  cout << setw( 28 ) << left << "InstrumentedDispatchThread" << right << fixed << setprecision( 1 )
+       << setw( 8 ) << Run( thr, tasks ) << " ns/task" << endl;
+
+  DispatchStatsSnapshot snapshot = thr.Stats().Snapshot();
+  cout << "completed " << snapshot.m_completed << ", max depth " << snapshot.m_maxDepth
+       << ", " << setprecision( 0 ) << snapshot.m_tasksPerSecond << " tasks/s" << endl;
+  Print( "queue wait", snapshot.m_queueWait );
+  Print( "run time", snapshot.m_runTime );
+  return 0;
+}
@@ -0,0 +1,114 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/**
+ * ParallelFor, ParallelReduce and ParallelSort on a DispatchPool compared
+ * with std::for_each, std::accumulate and std::sort, for sizes from 1K up to
+ * the given maximum in steps of 10x.
+ *
+ * $> ./ParallelAlgorithmsBench [maxSize] [threads]
+ */
+#include <ParallelAlgorithms.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace CppUtils;
+using namespace std;
+
+namespace {
+
+const size_t kGrain = 4096;
+
+template<typename F>
+double Time( F&& fn )
+{
+  auto start = chrono::steady_clock::now();
+  fn();
+  return chrono::duration<double, micro>( chrono::steady_clock::now() - start ).count();
+}
+
+void Print( const char* pName, size_t size, double sequential, double parallel )
+{
+  cout << setw( 8 ) << left << pName << right << setw( 11 ) << size
+       << fixed << setprecision( 1 ) << setw( 13 ) << sequential << setw( 13 ) << parallel
+       << setprecision( 2 ) << setw( 9 ) << sequential / parallel << "x" << endl;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+  size_t maxSize = argc > 1 ? strtoull( argv[ 1 ], nullptr, 10 ) : 100000000;
+  size_t threads = argc > 2 ? strtoull( argv[ 2 ], nullptr, 10 ) : thread::hardware_concurrency();
+  DispatchPool pool( threads );
+  cout << pool.ThreadCount() << " workers, grain " << kGrain << endl;
+  cout << setw( 8 ) << left << "" << right << setw( 11 ) << "size" << setw( 13 ) << "std us"
+       << setw( 13 ) << "parallel us" << setw( 10 ) << "speedup" << endl;
+
+  mt19937 rng( 42 );
+  for( size_t size = 1000; size <= maxSize; size *= 10 ) {
+    vector<double> values( size );
+    for( auto& v : values ) {
+      v = static_cast<double>( rng() % 1000000 );
+    }
+
+    vector<double> out( size );
+    auto body = []( double v ) { return sqrt( v ) * 1.5 + 1.0; };
+    double sequential = Time( [&]() {
+      transform( values.begin(), values.end(), out.begin(), body );
+    } );
+    double parallel = Time( [&]() {
+      ParallelFor( pool, 0, size, kGrain, [&]( size_t b, size_t e ) {
+        transform( values.begin() + b, values.begin() + e, out.begin() + b, body );
+      } );
+    } );
+    Print( "for", size, sequential, parallel );
+
+    volatile double sink = 0;
+    sequential = Time( [&]() { sink = accumulate( values.begin(), values.end(), 0.0 ); } );
+    parallel = Time( [&]() {
+      sink = ParallelReduce( pool, 0, size, kGrain, 0.0,
+        [&]( size_t b, size_t e ) { return accumulate( values.begin() + b, values.begin() + e, 0.0 ); },
+        []( double a, double b ) { return a + b; } );
+    } );
+    Print( "reduce", size, sequential, parallel );
+
+    vector<double> copy = values;
+    sequential = Time( [&]() { sort( copy.begin(), copy.end() ); } );
+    parallel = Time( [&]() { ParallelSort( pool, values.begin(), values.end() ); } );
+    Print( "sort", size, sequential, parallel );
+    if( copy != values ) {
+      cerr << "ParallelSort disagrees with std::sort" << endl;
+      return 1;
+    }
+  }
+  return 0;
+}
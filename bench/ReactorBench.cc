@@ -0,0 +1,128 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/**
+ * Round trip latency of a message over a socketpair when the logic runs on
+ * a dispatch thread: a separate epoll thread that hands every message over
+ * to a DispatchThread, compared with a ReactorDispatchThread that watches
+ * the socket itself.
+ *
+ * $> ./ReactorBench [round trips]
+ */
+#include <DispatchThread.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#if defined( __linux__ )
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace CppUtils;
+using namespace std;
+
+namespace {
+
+// Runs on the logic thread: reads the ping and answers it
+void Serve( int fd, uint64_t& served )
+{
+  char c;
+  if( read( fd, &c, 1 ) == 1 ) {
+    served++;
+    if( write( fd, &c, 1 ) != 1 ) {
+      abort();
+    }
+  }
+}
+
+template<typename SetUp>
+double PingPong( const char* pName, size_t roundTrips, SetUp setUp )
+{
+  int fds[ 2 ];
+  if( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) != 0 ) {
+    abort();
+  }
+  auto tearDown = setUp( fds[ 1 ] );
+  char c = 'x';
+  auto start = chrono::steady_clock::now();
+  for( size_t i = 0; i < roundTrips; i++ ) {
+    if( write( fds[ 0 ], &c, 1 ) != 1 || read( fds[ 0 ], &c, 1 ) != 1 ) {
+      abort();
+    }
+  }
+  double ns = chrono::duration<double, nano>( chrono::steady_clock::now() - start ).count() / roundTrips;
+  tearDown();
+  close( fds[ 0 ] );
+  close( fds[ 1 ] );
+  cout << setw( 36 ) << left << pName << right << fixed << setprecision( 0 ) << setw( 8 ) << ns << " ns/round trip"
+       << endl;
+  return ns;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+  size_t roundTrips = argc > 1 ? strtoull( argv[ 1 ], nullptr, 10 ) : 100000;
+  cout << roundTrips << " round trips" << endl;
+
+  DispatchThread logic;
+  uint64_t served = 0;
+  PingPong( "epoll thread + DispatchThread hop", roundTrips, [&]( int fd ) {
+    int epollFd = epoll_create1( 0 );
+    epoll_event event = epoll_event();
+    event.events = EPOLLIN | EPOLLET;
+    epoll_ctl( epollFd, EPOLL_CTL_ADD, fd, &event );
+    auto spStop = make_shared<atomic<bool>>( false );
+    auto spIo = make_shared<thread>( [&logic, &served, epollFd, fd, spStop]() {
+      epoll_event ready[ 8 ];
+      while( !*spStop ) {
+        if( epoll_wait( epollFd, ready, 8, 10 ) > 0 ) {
+          logic.PostToDispatch( [fd, &served]() { Serve( fd, served ); } );
+        }
+      }
+    } );
+    return [epollFd, spStop, spIo]() {
+      *spStop = true;
+      spIo->join();
+      close( epollFd );
+    };
+  } );
+
+  ReactorDispatchThread reactor;
+  PingPong( "ReactorDispatchThread::WatchFd", roundTrips, [&]( int fd ) {
+    auto token = reactor.WatchFd( fd, EPOLLIN, [fd, &served]( uint32_t ) { Serve( fd, served ); } );
+    return [token]() { LOCK_AND_CANCEL( token ); };
+  } );
+  return 0;
+}
+#else
+int main()
+{
+  return 0;
+}
+#endif
@@ -0,0 +1,168 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/**
+ * Heap allocations per PostToDispatch(), std::function vs Task. Every
+ * posted lambda captures 48 bytes, which is past std::function's small
+ * buffer but within Task's. Allocations are counted by replacing the global
+ * operator new, so they include the queue's own node allocations. The pool
+ * case posts from a DispatchPool worker, each task posting the next.
+ *
+ * $> ./TaskAllocBench [posts]
+ */
+#include <DispatchPool.h>
+#include <DispatchThread.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+using namespace CppUtils;
+using namespace std;
+
+namespace {
+atomic<size_t> g_allocations{ 0 };
+}
+
+void* operator new( size_t size )
+{
+  g_allocations.fetch_add( 1, memory_order_relaxed );
+  void* p = malloc( size ? size : 1 );
+  if( !p ) {
+    throw bad_alloc();
+  }
+  return p;
+}
+
+void operator delete( void* p ) noexcept
+{
+  free( p );
+}
+
+void operator delete( void* p, size_t ) noexcept
+{
+  free( p );
+}
+
+namespace {
+
+template<typename DispatchThreadType>
+void Run( const char* pName, size_t posts )
+{
+  DispatchThreadType thr;
+  array<uint64_t, 6> payload{};
+  atomic<uint64_t> sum{ 0 };
+  // Park the thread so the posts pile up in the queue like a real backlog
+  promise<void> gate;
+  auto opened = gate.get_future().share();
+  thr.PostToDispatch( [opened]() { opened.wait(); } );
+
+  size_t before = g_allocations.load();
+  auto start = chrono::steady_clock::now();
+  for( size_t i = 0; i < posts; i++ ) {
+    payload[ 0 ] = i;
+    thr.PostToDispatch( [payload, &sum]() { sum += payload[ 0 ]; } );
+  }
+  auto elapsed = chrono::steady_clock::now() - start;
+  size_t allocations = g_allocations.load() - before;
+  gate.set_value();
+  thr.Kill();
+
+  cout << setw( 34 ) << left << pName << right << fixed << setprecision( 3 )
+       << setw( 8 ) << (double)allocations / posts << " allocs/post"
+       << setw( 9 ) << setprecision( 1 ) << chrono::duration<double, nano>( elapsed ).count() / posts << " ns/post"
+       << endl;
+}
+
+// Posts from inside a worker go to its own deque. Each link of the chain
+// posts the next one, so the nodes can be reused once the pool warms up.
+struct PoolChain
+{
+  struct State
+  {
+    DispatchPool pool{ 1 };
+    size_t posts;
+    size_t before;
+    size_t allocations;
+    chrono::steady_clock::time_point start;
+    chrono::steady_clock::duration elapsed;
+    atomic<uint64_t> sum{ 0 };
+    promise<void> done;
+  };
+
+  void operator()()
+  {
+    if( m_left == m_pState->posts ) {
+      m_pState->before = g_allocations.load();
+      m_pState->start = chrono::steady_clock::now();
+    }
+    m_pState->sum += m_payload[ 0 ];
+    if( m_left == 0 ) {
+      m_pState->elapsed = chrono::steady_clock::now() - m_pState->start;
+      m_pState->allocations = g_allocations.load() - m_pState->before;
+      m_pState->done.set_value();
+      return;
+    }
+    array<uint64_t, 4> payload = m_payload;
+    payload[ 0 ] = m_left;
+    m_pState->pool.PostToDispatch( PoolChain{ m_pState, m_left - 1, payload } );
+  }
+
+  State* m_pState;
+  size_t m_left;
+  array<uint64_t, 4> m_payload;
+};
+
+void RunPool( const char* pName, size_t posts )
+{
+  PoolChain::State state;
+  state.posts = posts;
+  auto done = state.done.get_future();
+  state.pool.PostToDispatch( PoolChain{ &state, posts, {} } );
+  done.wait();
+  state.pool.Kill();
+
+  cout << setw( 34 ) << left << pName << right << fixed << setprecision( 3 )
+       << setw( 8 ) << (double)state.allocations / posts << " allocs/post"
+       << setw( 9 ) << setprecision( 1 ) << chrono::duration<double, nano>( state.elapsed ).count() / posts << " ns/post"
+       << endl;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+  size_t posts = argc > 1 ? strtoull( argv[ 1 ], nullptr, 10 ) : 1000000;
+  cout << "Allocations per post, " << posts << " posts with 48 byte captures" << endl;
+  Run<BasicDispatchThread<TsQueue<function<void()>>>>( "TsQueue<std::function>", posts );
+  Run<DispatchThread>( "TsQueue<Task> (DispatchThread)", posts );
+  Run<BasicDispatchThread<SegmentedQueue<function<void()>>>>( "SegmentedQueue<std::function>", posts );
+  Run<SegmentedDispatchThread>( "SegmentedQueue<Task>", posts );
+  RunPool( "DispatchPool worker<Task>", posts );
+  return 0;
+}
@@ -0,0 +1,101 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+/**
+ * Timer wheel arm / cancel / expire throughput with a large population of
+ * outstanding timeouts, the pattern of a per request timeout.
+ *
+ *  - arm:    N timers with timeouts spread over a minute
+ *  - cancel: every other one of them, i.e. N/2 cancels with N outstanding
+ *  - expire: N timers sharing one deadline, timed from the first to the last
+ *            callback, i.e. the dispatch thread's cost of firing them
+ *
+ * $> ./TimerWheelBench [timers]
+ */
+#include <TimerWheel.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace CppUtils;
+using namespace std;
+
+namespace {
+
+void Report( const char* pName, size_t ops, chrono::steady_clock::duration elapsed )
+{
+  double seconds = chrono::duration<double>( elapsed ).count();
+  cout << setw( 8 ) << left << pName << right << fixed << setprecision( 1 )
+       << setw( 10 ) << ops / seconds / 1e6 << " M ops/s"
+       << setw( 10 ) << seconds * 1e9 / ops << " ns/op" << endl;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+  size_t timers = argc > 1 ? strtoull( argv[ 1 ], nullptr, 10 ) : 1000000;
+  cout << "Timer wheel benchmark: " << timers << " timers" << endl;
+
+  DispatchThread thr;
+  TimerWheel wheel( thr );
+  atomic<size_t> fired{ 0 };
+  auto onFire = [&fired]() { fired++; };
+
+  vector<weak_ptr<ACancelableToken>> tokens;
+  tokens.reserve( timers );
+  auto start = chrono::steady_clock::now();
+  for( size_t i = 0; i < timers; i++ ) {
+    tokens.push_back( wheel.Arm( chrono::milliseconds( 1000 + i % 59000 ), onFire ) );
+  }
+  Report( "arm", timers, chrono::steady_clock::now() - start );
+
+  start = chrono::steady_clock::now();
+  for( size_t i = 0; i < timers; i += 2 ) {
+    LOCK_AND_CANCEL( tokens[ i ] );
+  }
+  Report( "cancel", ( timers + 1 ) / 2, chrono::steady_clock::now() - start );
+  cout << "outstanding " << wheel.Size() << endl;
+
+  atomic<size_t> expired{ 0 };
+  atomic<int64_t> firstFired{ 0 };
+  auto onFirstFire = [&expired, &firstFired]() {
+    if( expired++ == 0 ) {
+      firstFired = chrono::steady_clock::now().time_since_epoch().count();
+    }
+  };
+  auto deadline = chrono::steady_clock::now() + chrono::seconds( 2 );
+  for( size_t i = 0; i < timers; i++ ) {
+    wheel.Arm( deadline - chrono::steady_clock::now(), onFirstFire );
+  }
+  while( expired < timers ) {
+    this_thread::sleep_for( chrono::microseconds( 100 ) );
+  }
+  auto lastFired = chrono::steady_clock::now();
+  Report( "expire", timers, lastFired - chrono::steady_clock::time_point( chrono::steady_clock::duration( firstFired ) ) );
+  return 0;
+}
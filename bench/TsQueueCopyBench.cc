@@ -0,0 +1,151 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * Measures how many times a large payload is copied on its way through a
+ * TsQueue, and the resulting throughput, for the original copy-in/copy-out
+ * queue and for the current move/emplace aware TsQueue.
+ *
+ * $> ./TsQueueCopyBench [items] [payload bytes]
+ */
+#include <TsQueue.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace CppUtils;
+using namespace std;
+
+namespace {
+
+atomic<uint64_t> g_copies{ 0 };
+atomic<uint64_t> g_moves{ 0 };
+
+struct LargePayload
+{
+  LargePayload() { }
+  explicit LargePayload( size_t bytes ) : m_data( bytes, 0xA5 ) { }
+  LargePayload( const LargePayload& other ) : m_data( other.m_data ) { g_copies++; }
+  LargePayload( LargePayload&& other ) : m_data( std::move( other.m_data ) ) { g_moves++; }
+  LargePayload& operator=( const LargePayload& other ) { m_data = other.m_data; g_copies++; return *this; }
+  LargePayload& operator=( LargePayload&& other ) { m_data = std::move( other.m_data ); g_moves++; return *this; }
+
+  vector<uint8_t> m_data;
+};
+
+/**
+ * TsQueue as it was before move/emplace support, kept here as the baseline.
+ */
+template<typename T>
+class CopyingTsQueue
+{
+public:
+  void EnQueue( T t )
+  {
+    unique_lock<mutex> lk( m_mtx );
+    m_q.push( t );
+    lk.unlock();
+    m_cond.notify_one();
+  }
+
+  T DeQueue()
+  {
+    unique_lock<mutex> lk( m_mtx );
+    if( m_q.empty() ) {
+      m_cond.wait( lk, [=]() { return !m_q.empty(); } );
+    }
+    T t = m_q.front();
+    m_q.pop();
+    return t;
+  }
+
+private:
+  condition_variable m_cond;
+  mutex m_mtx;
+  queue<T> m_q;
+};
+
+template<typename ProduceFn, typename ConsumeFn>
+void Run( const char* pName, uint64_t items, ProduceFn produce, ConsumeFn consume )
+{
+  g_copies = 0;
+  g_moves = 0;
+  auto start = chrono::steady_clock::now();
+  thread producer( [ & ]() {
+    for( uint64_t i = 0; i < items; i++ ) {
+      produce();
+    }
+  } );
+  uint64_t bytes = 0;
+  for( uint64_t i = 0; i < items; i++ ) {
+    bytes += consume();
+  }
+  producer.join();
+  double secs = chrono::duration<double>( chrono::steady_clock::now() - start ).count();
+  cout << setw( 28 ) << left << pName
+       << " copies/item " << setw( 6 ) << fixed << setprecision( 2 ) << (double)g_copies / items
+       << " moves/item " << setw( 6 ) << (double)g_moves / items
+       << " items/s " << setw( 12 ) << setprecision( 0 ) << items / secs
+       << " (" << bytes / items << " bytes/item)" << endl;
+}
+
+}
+
+int main( int argc, char** argv )
+{
+  uint64_t items = argc > 1 ? strtoull( argv[ 1 ], nullptr, 10 ) : 200000;
+  size_t payloadBytes = argc > 2 ? strtoull( argv[ 2 ], nullptr, 10 ) : 4096;
+
+  cout << "TsQueue copy benchmark: " << items << " items of " << payloadBytes << " bytes" << endl;
+
+  {
+    CopyingTsQueue<LargePayload> q;
+    Run( "before: EnQueue/DeQueue", items,
+         [ & ]() { LargePayload p( payloadBytes ); q.EnQueue( p ); },
+         [ & ]() { return q.DeQueue().m_data.size(); } );
+  }
+  {
+    TsQueue<LargePayload> q;
+    Run( "after:  EnQueue(lvalue)", items,
+         [ & ]() { LargePayload p( payloadBytes ); q.EnQueue( p ); },
+         [ & ]() { return q.DeQueue().m_data.size(); } );
+  }
+  {
+    TsQueue<LargePayload> q;
+    Run( "after:  EnQueue(std::move)", items,
+         [ & ]() { LargePayload p( payloadBytes ); q.EnQueue( std::move( p ) ); },
+         [ & ]() { return q.DeQueue().m_data.size(); } );
+  }
+  {
+    TsQueue<LargePayload> q;
+    Run( "after:  Emplace", items,
+         [ & ]() { q.Emplace( payloadBytes ); },
+         [ & ]() { return q.DeQueue().m_data.size(); } );
+  }
+  return 0;
+}
@@ -0,0 +1,111 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/**
+ * Latency / CPU trade-off of the wait strategies. A producer posts a time
+ * stamp every few microseconds (so the consumer keeps running dry) and the
+ * consumer records how long each stamp sat in the queue. CPU is the process
+ * CPU time over wall time, i.e. ~100% means one core was kept busy.
+ *
+ * $> ./WaitStrategyBench [messages] [gap in microseconds]
+ */
+#include <MpmcQueue.h>
+#include <TsQueue.h>
+#include <WaitStrategy.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace CppUtils;
+using namespace std;
+
+namespace {
+
+using Stamp = chrono::steady_clock::time_point;
+
+template<typename QueueType>
+void Run( const char* pQueueName, const char* pStrategyName, QueueType& q, size_t messages, chrono::microseconds gap )
+{
+  vector<double> latenciesUs;
+  latenciesUs.reserve( messages );
+  thread consumer( [ &q, &latenciesUs ]() {
+    Stamp stamp;
+    while( q.DeQueue( stamp ) ) {
+      latenciesUs.push_back( chrono::duration<double, micro>( chrono::steady_clock::now() - stamp ).count() );
+    }
+  } );
+
+  clock_t cpuStart = clock();
+  auto wallStart = chrono::steady_clock::now();
+  for( size_t i = 0; i < messages; i++ ) {
+    this_thread::sleep_for( gap );
+    q.EnQueue( chrono::steady_clock::now() );
+  }
+  q.Close();
+  consumer.join();
+  double wall = chrono::duration<double>( chrono::steady_clock::now() - wallStart ).count();
+  double cpu = (double)( clock() - cpuStart ) / CLOCKS_PER_SEC;
+
+  sort( latenciesUs.begin(), latenciesUs.end() );
+  cout << setw( 8 ) << left << pQueueName << setw( 20 ) << pStrategyName << right << fixed << setprecision( 2 )
+       << " p50 " << setw( 8 ) << latenciesUs[ latenciesUs.size() / 2 ] << "us"
+       << " p99 " << setw( 8 ) << latenciesUs[ latenciesUs.size() * 99 / 100 ] << "us"
+       << " max " << setw( 9 ) << latenciesUs.back() << "us"
+       << " cpu " << setw( 6 ) << setprecision( 1 ) << 100.0 * cpu / wall << "%" << endl;
+}
+
+template<typename WaitStrategy>
+void RunBoth( const char* pStrategyName, size_t messages, chrono::microseconds gap )
+{
+  {
+    TsQueue<Stamp, WaitStrategy> q;
+    Run( "TsQueue", pStrategyName, q, messages, gap );
+  }
+  {
+    MpmcQueue<Stamp, WaitStrategy> q;
+    Run( "Mpmc", pStrategyName, q, messages, gap );
+  }
+}
+
+}
+
+int main( int argc, char** argv )
+{
+  size_t messages = argc > 1 ? strtoull( argv[ 1 ], nullptr, 10 ) : 20000;
+  chrono::microseconds gap( argc > 2 ? strtoull( argv[ 2 ], nullptr, 10 ) : 20 );
+
+  cout << "Wait strategy benchmark: " << messages << " messages, " << gap.count() << "us apart" << endl;
+  RunBoth<BlockingWait>( "Blocking", messages, gap );
+  RunBoth<SpinThenParkWait<>>( "SpinThenPark<64>", messages, gap );
+  RunBoth<SpinThenParkWait<1024, 64>>( "SpinThenPark<1K,64>", messages, gap );
+  RunBoth<YieldWait>( "Yield", messages, gap );
+  RunBoth<SpinPauseWait>( "SpinPause", messages, gap );
+  RunBoth<BusySpinWait>( "BusySpin", messages, gap );
+  return 0;
+}
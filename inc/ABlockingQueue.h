@@ -0,0 +1,203 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ABLOCKING_QUEUE_H__
+#define __ABLOCKING_QUEUE_H__
+
+#include <EventCount.h>
+#include <WaitStrategy.h>
+#include <atomic>
+#include <chrono>
+#include <utility>
+
+namespace CppUtils {
+
+/**
+ * ABlockingQueue - the TsQueue style API (blocking, timed, non-blocking and
+ * closable) for queues that are built out of a non-blocking push and pop.
+ *
+ * Derived must provide
+ *   template<typename... Args> bool TryPush( Args&&... args );
+ *   bool TryPop( T& out );
+ * which return false when the queue is full / empty without touching their
+ * arguments. Blocked threads wait according to WaitStrategy (see
+ * WaitStrategy.h) and park on an EventCount if the strategy gives up.
+ *
+ * Once Close() is called every EnQueue fails and every waiter wakes up.
+ * Consumers keep receiving the items that are still queued and then fail.
+ * An EnQueue that races with Close() may still succeed after the consumers
+ * have given up; such items are destroyed along with the queue.
+ */
+template<typename Derived, typename T, typename WaitStrategy>
+class ABlockingQueue
+{
+public:
+  using ValueType = T;
+
+  bool TryEnQueue( const T& t ) { return TryEmplace( t ); }
+  bool TryEnQueue( T&& t ) { return TryEmplace( std::move( t ) ); }
+
+  /**
+   * Constructs the item in place if there is room. args are left untouched
+   * when the queue is full or closed.
+   */
+  template<typename... Args>
+  bool TryEmplace( Args&&... args )
+  {
+    if( IsClosed() || !Self().TryPush( std::forward<Args>( args )... ) ) {
+      return false;
+    }
+    if( WaitStrategy::kMayPark ) {
+      m_notEmpty.NotifyOne();
+    }
+    return true;
+  }
+
+  bool TryDeQueue( T& out )
+  {
+    if( !Self().TryPop( out ) ) {
+      return false;
+    }
+    if( WaitStrategy::kMayPark ) {
+      m_notFull.NotifyOne();
+    }
+    return true;
+  }
+
+  /**
+   * Blocks while the queue is full.
+   * @return false if the queue is closed
+   */
+  bool EnQueue( const T& t ) { return Emplace( t ); }
+  bool EnQueue( T&& t ) { return Emplace( std::move( t ) ); }
+
+  /**
+   * Blocks while the queue is full and then constructs the item in place.
+   * args are only consumed once a slot has been claimed.
+   * @return false if the queue is closed
+   */
+  template<typename... Args>
+  bool Emplace( Args&&... args )
+  {
+    bool retval = false;
+    auto ready = [ & ]() { return ( retval = TryEmplace( std::forward<Args>( args )... ) ) || IsClosed(); };
+    Wait( m_notFull, ready );
+    return retval;
+  }
+
+  /**
+   * Blocks while the queue is empty.
+   * @return false once the queue is closed and drained
+   */
+  bool DeQueue( T& out )
+  {
+    bool retval = false;
+    auto ready = [ & ]() { return ( retval = TryDeQueue( out ) ) || IsClosed(); };
+    Wait( m_notEmpty, ready );
+    return retval || TryDeQueue( out );
+  }
+
+  /**
+   * Blocks while the queue is empty. Returns a value initialized T once the
+   * queue is closed and drained, use DeQueue( T& ) to tell the difference.
+   */
+  T DeQueue()
+  {
+    T t{};
+    DeQueue( t );
+    return t;
+  }
+
+  /**
+   * @return false if nothing arrived before the deadline or the queue is
+   *         closed and drained
+   */
+  template<typename Clock, typename Duration>
+  bool DeQueueUntil( T& out, const std::chrono::time_point<Clock, Duration>& deadline )
+  {
+    bool retval = false;
+    auto ready = [ & ]() { return ( retval = TryDeQueue( out ) ) || IsClosed(); };
+    WaitUntil( m_notEmpty, ready, deadline );
+    return retval || TryDeQueue( out );
+  }
+
+  template<typename Rep, typename Period>
+  bool DeQueueFor( T& out, const std::chrono::duration<Rep, Period>& timeout )
+  {
+    return DeQueueUntil( out, std::chrono::steady_clock::now() + timeout );
+  }
+
+  /**
+   * Rejects further EnQueues and wakes up every waiter.
+   */
+  void Close()
+  {
+    m_closed.store( true, std::memory_order_release );
+    m_notEmpty.NotifyAll();
+    m_notFull.NotifyAll();
+  }
+
+  bool IsClosed() const { return m_closed.load( std::memory_order_acquire ); }
+
+protected:
+  ABlockingQueue() : m_closed{ false }
+  { }
+
+  ~ABlockingQueue()
+  { }
+
+private:
+  Derived& Self() { return static_cast<Derived&>( *this ); }
+
+  template<typename Pred>
+  static void Wait( EventCount& ec, Pred& ready )
+  {
+    typename WaitStrategy::Waiter waiter;
+    while( !ready() ) {
+      if( !waiter.Spin() ) {
+        ec.Wait( ready );
+        return;
+      }
+    }
+  }
+
+  template<typename Pred, typename Clock, typename Duration>
+  static void WaitUntil( EventCount& ec, Pred& ready, const std::chrono::time_point<Clock, Duration>& deadline )
+  {
+    typename WaitStrategy::Waiter waiter;
+    while( !ready() && Clock::now() < deadline ) {
+      if( !waiter.Spin() ) {
+        ec.WaitUntil( ready, deadline );
+        return;
+      }
+    }
+  }
+
+  EventCount m_notEmpty;
+  EventCount m_notFull;
+  std::atomic<bool> m_closed;
+};
+
+}
+
+#endif // __ABLOCKING_QUEUE_H__
@@ -0,0 +1,567 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __ASYNC_FILE_IO_H__
+#define __ASYNC_FILE_IO_H__
+
+#include <DispatchPool.h>
+#include <Task.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined( __linux__ ) && defined( __has_include )
+#if __has_include( <linux/io_uring.h> )
+#define CPPUTILS_HAS_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+namespace CppUtils {
+
+/**
+ * AAsyncFileIo - reads, writes and fsyncs files without blocking the caller.
+ *
+ * Every call returns right away; the callback later runs on the completion
+ * executor the service was made with (see MakeAsyncFileIo) and gets what
+ * the system call returned: bytes transferred, 0 for fsync, or -errno.
+ * Short reads and writes are reported, not retried. Requests over
+ * kMaxIoSize fail with -EINVAL rather than being cut short. The buffer must stay
+ * valid until the callback runs. Calls may come from any thread.
+ *
+ * Operations are not ordered among themselves: an Fsync() only covers the
+ * writes that completed before it, so issue it from their callbacks.
+ *
+ * The Fixed variants use a buffer registered when the service was made, by
+ * index; pBuf must lie within it. They save the kernel mapping the pages on
+ * every call and behave like the plain ones where that does not apply.
+ *
+ * Destroying the service waits for the operations in flight; callbacks the
+ * completion executor rejects by then are dropped.
+ */
+class AAsyncFileIo
+{
+public:
+  using Callback = std::function<void( ssize_t )>;
+  // Hands a completion to the executor, false if it was rejected
+  using CompletionPoster = std::function<bool( Task )>;
+
+  // Largest read or write, io_uring takes the length as 32 bits
+  static constexpr size_t kMaxIoSize = UINT32_MAX;
+
+  virtual ~AAsyncFileIo()
+  { }
+
+  /**
+   * @return false if the service is shutting down, cb is not called then
+   */
+  virtual bool Read( int fd, void* pBuf, size_t size, uint64_t offset, Callback cb ) = 0;
+  virtual bool Write( int fd, const void* pBuf, size_t size, uint64_t offset, Callback cb ) = 0;
+  virtual bool Fsync( int fd, Callback cb ) = 0;
+  virtual bool ReadFixed( int fd, unsigned bufIndex, void* pBuf, size_t size, uint64_t offset, Callback cb ) = 0;
+  virtual bool WriteFixed( int fd, unsigned bufIndex, const void* pBuf, size_t size, uint64_t offset, Callback cb ) = 0;
+
+  /**
+   * @return "io_uring" or "thread pool"
+   */
+  virtual const char* Backend() const = 0;
+
+protected:
+  enum EFileIoOp {
+    eFILE_IO_READ = 0,
+    eFILE_IO_WRITE = 1,
+    eFILE_IO_FSYNC = 2,
+  };
+
+  // Runs the callback on the completion executor
+  struct Completion
+  {
+    Callback m_cb;
+    ssize_t m_result;
+
+    void operator()()
+    {
+      m_cb( m_result );
+    }
+  };
+
+  // Fails a request that is too large through its callback
+  static bool Reject( const CompletionPoster& poster, Callback cb, ssize_t error )
+  {
+    return poster( Task( Completion{ std::move( cb ), error } ) );
+  }
+};
+
+/**
+ * Fallback for kernels without io_uring: the operations block a worker of a
+ * private DispatchPool instead of the caller.
+ */
+class ThreadPoolFileIo : public AAsyncFileIo
+{
+public:
+  ThreadPoolFileIo( CompletionPoster poster, size_t threads = 2 ) : m_poster( std::move( poster ) ), m_pool( threads )
+  { }
+
+  virtual ~ThreadPoolFileIo()
+  {
+    m_pool.Kill();
+  }
+
+  virtual bool Read( int fd, void* pBuf, size_t size, uint64_t offset, Callback cb )
+  {
+    return Post( eFILE_IO_READ, fd, pBuf, size, offset, std::move( cb ) );
+  }
+
+  virtual bool Write( int fd, const void* pBuf, size_t size, uint64_t offset, Callback cb )
+  {
+    return Post( eFILE_IO_WRITE, fd, const_cast<void*>( pBuf ), size, offset, std::move( cb ) );
+  }
+
+  virtual bool Fsync( int fd, Callback cb )
+  {
+    return Post( eFILE_IO_FSYNC, fd, nullptr, 0, 0, std::move( cb ) );
+  }
+
+  virtual bool ReadFixed( int fd, unsigned, void* pBuf, size_t size, uint64_t offset, Callback cb )
+  {
+    return Read( fd, pBuf, size, offset, std::move( cb ) );
+  }
+
+  virtual bool WriteFixed( int fd, unsigned, const void* pBuf, size_t size, uint64_t offset, Callback cb )
+  {
+    return Write( fd, pBuf, size, offset, std::move( cb ) );
+  }
+
+  virtual const char* Backend() const
+  {
+    return "thread pool";
+  }
+
+private:
+  struct BlockingOp
+  {
+    EFileIoOp m_op;
+    int m_fd;
+    void* m_pBuf;
+    size_t m_size;
+    uint64_t m_offset;
+    Callback m_cb;
+    const CompletionPoster* m_pPoster;
+
+    void operator()()
+    {
+      ssize_t result;
+      if( m_op == eFILE_IO_READ ) {
+        result = pread( m_fd, m_pBuf, m_size, static_cast<off_t>( m_offset ) );
+      } else if( m_op == eFILE_IO_WRITE ) {
+        result = pwrite( m_fd, m_pBuf, m_size, static_cast<off_t>( m_offset ) );
+      } else {
+        result = fsync( m_fd );
+      }
+      if( result < 0 ) {
+        result = -errno;
+      }
+      ( *m_pPoster )( Task( Completion{ std::move( m_cb ), result } ) );
+    }
+  };
+
+  bool Post( EFileIoOp op, int fd, void* pBuf, size_t size, uint64_t offset, Callback cb )
+  {
+    if( !cb ) {
+      return false;
+    }
+    if( size > kMaxIoSize ) {
+      return Reject( m_poster, std::move( cb ), -EINVAL );
+    }
+    return m_pool.PostToDispatch( Task( BlockingOp{ op, fd, pBuf, size, offset, std::move( cb ), &m_poster } ) );
+  }
+
+  CompletionPoster m_poster;
+  BasicDispatchPool<Task> m_pool;
+};
+
+#if defined( CPPUTILS_HAS_IO_URING )
+/**
+ * UringFileIo - AAsyncFileIo on an io_uring driven by a service thread.
+ *
+ * Callers queue requests and ring an eventfd; each iteration of the service
+ * loop turns every queued request into a submission queue entry and submits
+ * the whole batch with the same io_uring_enter() that waits for
+ * completions. The eventfd is read by a request of its own that is always
+ * in flight, so new work interrupts the wait.
+ *
+ * Throws std::system_error if the kernel has no io_uring (or one older than
+ * 5.7), or the buffers cannot be registered.
+ */
+class UringFileIo : public AAsyncFileIo
+{
+public:
+  UringFileIo( CompletionPoster poster, unsigned entries = 256, const std::vector<iovec>& buffers = std::vector<iovec>() )
+    : m_poster( std::move( poster ) )
+  {
+    io_uring_params params = io_uring_params();
+    m_ringFd = static_cast<int>( syscall( __NR_io_uring_setup, entries, &params ) );
+    if( m_ringFd < 0 ) {
+      throw std::system_error( errno, std::generic_category(), "io_uring_setup" );
+    }
+    // Require 5.7, which FAST_POLL marks, treat anything older as no io_uring
+    int err = ( params.features & IORING_FEAT_FAST_POLL ) ? Map( params ) : ENOSYS;
+    if( !err && !buffers.empty() &&
+        syscall( __NR_io_uring_register, m_ringFd, IORING_REGISTER_BUFFERS, buffers.data(), buffers.size() ) != 0 ) {
+      err = errno;
+    }
+    if( !err ) {
+      m_wakeFd = eventfd( 0, EFD_CLOEXEC );
+      err = m_wakeFd < 0 ? errno : 0;
+    }
+    if( err ) {
+      Unmap();
+      throw std::system_error( err, std::generic_category(), "UringFileIo" );
+    }
+    // One entry is the wake up read
+    m_capacity = params.sq_entries - 1;
+    m_thread = std::thread( [this]() { Run(); } );
+  }
+
+  virtual ~UringFileIo()
+  {
+    {
+      std::lock_guard<std::mutex> lk( m_mtx );
+      m_closed = true;
+    }
+    Wake();
+    m_thread.join();
+    Unmap();
+  }
+
+  virtual bool Read( int fd, void* pBuf, size_t size, uint64_t offset, Callback cb )
+  {
+    return Queue( IORING_OP_READ, fd, pBuf, size, offset, 0, std::move( cb ) );
+  }
+
+  virtual bool Write( int fd, const void* pBuf, size_t size, uint64_t offset, Callback cb )
+  {
+    return Queue( IORING_OP_WRITE, fd, const_cast<void*>( pBuf ), size, offset, 0, std::move( cb ) );
+  }
+
+  virtual bool Fsync( int fd, Callback cb )
+  {
+    return Queue( IORING_OP_FSYNC, fd, nullptr, 0, 0, 0, std::move( cb ) );
+  }
+
+  virtual bool ReadFixed( int fd, unsigned bufIndex, void* pBuf, size_t size, uint64_t offset, Callback cb )
+  {
+    return Queue( IORING_OP_READ_FIXED, fd, pBuf, size, offset, bufIndex, std::move( cb ) );
+  }
+
+  virtual bool WriteFixed( int fd, unsigned bufIndex, const void* pBuf, size_t size, uint64_t offset, Callback cb )
+  {
+    return Queue( IORING_OP_WRITE_FIXED, fd, const_cast<void*>( pBuf ), size, offset, bufIndex, std::move( cb ) );
+  }
+
+  virtual const char* Backend() const
+  {
+    return "io_uring";
+  }
+
+private:
+  struct Request
+  {
+    uint8_t m_opcode;
+    int m_fd;
+    void* m_pBuf;
+    size_t m_size;
+    uint64_t m_offset;
+    unsigned m_bufIndex;
+    Callback m_cb;
+  };
+
+  // user_data of the wake up read, requests use their address
+  static constexpr uint64_t kWakeUserData = 0;
+
+  bool Queue( uint8_t opcode, int fd, void* pBuf, size_t size, uint64_t offset, unsigned bufIndex, Callback cb )
+  {
+    if( !cb ) {
+      return false;
+    }
+    if( size > kMaxIoSize ) {
+      return Reject( m_poster, std::move( cb ), -EINVAL );
+    }
+    std::unique_ptr<Request> spRequest( new Request{ opcode, fd, pBuf, size, offset, bufIndex, std::move( cb ) } );
+    bool wasEmpty;
+    {
+      std::lock_guard<std::mutex> lk( m_mtx );
+      if( m_closed ) {
+        return false;
+      }
+      wasEmpty = m_pending.empty();
+      m_pending.push_back( spRequest.release() );
+    }
+    // The loop takes all queued requests at once, one ring per batch
+    if( wasEmpty ) {
+      Wake();
+    }
+    return true;
+  }
+
+  void Run()
+  {
+    std::deque<Request*> backlog;
+    size_t inFlight = 0;
+    bool wakeArmed = false;
+    for( ;; ) {
+      bool closed;
+      {
+        std::lock_guard<std::mutex> lk( m_mtx );
+        backlog.insert( backlog.end(), m_pending.begin(), m_pending.end() );
+        m_pending.clear();
+        closed = m_closed;
+      }
+      if( closed && backlog.empty() && inFlight == 0 ) {
+        break;
+      }
+      unsigned toSubmit = 0;
+      if( !wakeArmed ) {
+        PrepareWake();
+        wakeArmed = true;
+        toSubmit++;
+      }
+      while( !backlog.empty() && inFlight < m_capacity ) {
+        Prepare( *backlog.front() );
+        backlog.pop_front();
+        inFlight++;
+        toSubmit++;
+      }
+      m_unsubmitted += toSubmit;
+      Enter();
+      Reap( inFlight, wakeArmed );
+    }
+  }
+
+  // Submits every published entry and waits for at least one completion
+  void Enter()
+  {
+    for( ;; ) {
+      long submitted = syscall( __NR_io_uring_enter, m_ringFd, m_unsubmitted, 1, IORING_ENTER_GETEVENTS, nullptr, 0 );
+      if( submitted >= 0 ) {
+        m_unsubmitted -= static_cast<unsigned>( submitted );
+        if( m_unsubmitted == 0 ) {
+          return;
+        }
+      } else if( errno != EINTR ) {
+        // EAGAIN / EBUSY, completions have to be reaped first. The entries
+        // are published already, the next Enter() submits them
+        return;
+      }
+    }
+  }
+
+  void Reap( size_t& inFlight, bool& wakeArmed )
+  {
+    unsigned head = *m_pCqHead;
+    unsigned tail = __atomic_load_n( m_pCqTail, __ATOMIC_ACQUIRE );
+    for( ; head != tail; head++ ) {
+      const io_uring_cqe& cqe = m_pCqes[ head & m_cqMask ];
+      if( cqe.user_data == kWakeUserData ) {
+        wakeArmed = false;
+        continue;
+      }
+      std::unique_ptr<Request> spRequest( reinterpret_cast<Request*>( static_cast<uintptr_t>( cqe.user_data ) ) );
+      inFlight--;
+      m_poster( Task( Completion{ std::move( spRequest->m_cb ), static_cast<ssize_t>( cqe.res ) } ) );
+    }
+    __atomic_store_n( m_pCqHead, head, __ATOMIC_RELEASE );
+  }
+
+  io_uring_sqe& NextSqe()
+  {
+    unsigned tail = *m_pSqTail;
+    unsigned index = tail & m_sqMask;
+    io_uring_sqe& sqe = m_pSqes[ index ];
+    sqe = io_uring_sqe();
+    m_pSqArray[ index ] = index;
+    // Published to the kernel by the release store of the new tail
+    __atomic_store_n( m_pSqTail, tail + 1, __ATOMIC_RELEASE );
+    return sqe;
+  }
+
+  void PrepareWake()
+  {
+    io_uring_sqe& sqe = NextSqe();
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = m_wakeFd;
+    sqe.addr = reinterpret_cast<uintptr_t>( &m_wakeValue );
+    sqe.len = sizeof( m_wakeValue );
+    sqe.user_data = kWakeUserData;
+  }
+
+  void Prepare( const Request& request )
+  {
+    io_uring_sqe& sqe = NextSqe();
+    sqe.opcode = request.m_opcode;
+    sqe.fd = request.m_fd;
+    sqe.addr = reinterpret_cast<uintptr_t>( request.m_pBuf );
+    sqe.len = static_cast<uint32_t>( request.m_size );
+    sqe.off = request.m_offset;
+    sqe.buf_index = static_cast<uint16_t>( request.m_bufIndex );
+    sqe.user_data = reinterpret_cast<uintptr_t>( &request );
+  }
+
+  void Wake()
+  {
+    uint64_t one = 1;
+    ssize_t written = write( m_wakeFd, &one, sizeof( one ) );
+    (void)written;
+  }
+
+  int Map( const io_uring_params& params )
+  {
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+    if( params.features & IORING_FEAT_SINGLE_MMAP ) {
+      m_sqRingSize = m_cqRingSize = m_sqRingSize > m_cqRingSize ? m_sqRingSize : m_cqRingSize;
+    }
+    m_pSqRing = mmap( nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING );
+    if( m_pSqRing == MAP_FAILED ) {
+      m_pSqRing = nullptr;
+      return errno;
+    }
+    if( params.features & IORING_FEAT_SINGLE_MMAP ) {
+      m_pCqRing = m_pSqRing;
+    } else {
+      m_pCqRing = mmap( nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING );
+      if( m_pCqRing == MAP_FAILED ) {
+        m_pCqRing = nullptr;
+        return errno;
+      }
+    }
+    m_sqesSize = params.sq_entries * sizeof( io_uring_sqe );
+    void* pSqes = mmap( nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES );
+    if( pSqes == MAP_FAILED ) {
+      return errno;
+    }
+    m_pSqes = static_cast<io_uring_sqe*>( pSqes );
+
+    char* pSq = static_cast<char*>( m_pSqRing );
+    m_pSqTail = reinterpret_cast<unsigned*>( pSq + params.sq_off.tail );
+    m_sqMask = *reinterpret_cast<unsigned*>( pSq + params.sq_off.ring_mask );
+    m_pSqArray = reinterpret_cast<unsigned*>( pSq + params.sq_off.array );
+    char* pCq = static_cast<char*>( m_pCqRing );
+    m_pCqHead = reinterpret_cast<unsigned*>( pCq + params.cq_off.head );
+    m_pCqTail = reinterpret_cast<unsigned*>( pCq + params.cq_off.tail );
+    m_cqMask = *reinterpret_cast<unsigned*>( pCq + params.cq_off.ring_mask );
+    m_pCqes = reinterpret_cast<io_uring_cqe*>( pCq + params.cq_off.cqes );
+    return 0;
+  }
+
+  void Unmap()
+  {
+    if( m_pSqes ) {
+      munmap( m_pSqes, m_sqesSize );
+    }
+    if( m_pCqRing && m_pCqRing != m_pSqRing ) {
+      munmap( m_pCqRing, m_cqRingSize );
+    }
+    if( m_pSqRing ) {
+      munmap( m_pSqRing, m_sqRingSize );
+    }
+    if( m_wakeFd >= 0 ) {
+      close( m_wakeFd );
+    }
+    close( m_ringFd );
+  }
+
+  CompletionPoster m_poster;
+  int m_ringFd = -1;
+  int m_wakeFd = -1;
+  void* m_pSqRing = nullptr;
+  size_t m_sqRingSize = 0;
+  void* m_pCqRing = nullptr;
+  size_t m_cqRingSize = 0;
+  io_uring_sqe* m_pSqes = nullptr;
+  size_t m_sqesSize = 0;
+  unsigned* m_pSqTail = nullptr;
+  unsigned m_sqMask = 0;
+  unsigned* m_pSqArray = nullptr;
+  unsigned* m_pCqHead = nullptr;
+  unsigned* m_pCqTail = nullptr;
+  unsigned m_cqMask = 0;
+  io_uring_cqe* m_pCqes = nullptr;
+  size_t m_capacity = 0;
+
+  std::mutex m_mtx;
+  bool m_closed = false;
+  std::vector<Request*> m_pending;
+  // Service thread only
+  uint64_t m_wakeValue = 0;
+  // Entries past the SQ tail the kernel has not taken yet
+  unsigned m_unsubmitted = 0;
+  std::thread m_thread;
+};
+#endif
+
+/**
+ * Makes the io_uring service where the kernel supports it and the thread
+ * pool fallback otherwise. Callbacks run on completions, anything with
+ * PostToDispatch( Task ), e.g. the DispatchThread that issued the I/O.
+ *
+ * @param buffers - To register for the Fixed operations
+ * @param fallbackThreads - Workers of the fallback's pool
+ */
+template<typename Executor>
+std::unique_ptr<AAsyncFileIo> MakeAsyncFileIo( Executor& completions,
+                                               const std::vector<iovec>& buffers = std::vector<iovec>(),
+                                               size_t fallbackThreads = 2 )
+{
+  AAsyncFileIo::CompletionPoster poster = [&completions]( Task task ) {
+    return completions.PostToDispatch( std::move( task ) );
+  };
+#if defined( CPPUTILS_HAS_IO_URING )
+  try {
+    return std::unique_ptr<AAsyncFileIo>( new UringFileIo( poster, 256, buffers ) );
+  } catch( const std::system_error& ) {
+    // ENOSYS, EPERM in sandboxes, ... fall back below
+  }
+#else
+  (void)buffers;
+#endif
+  return std::unique_ptr<AAsyncFileIo>( new ThreadPoolFileIo( std::move( poster ), fallbackThreads ) );
+}
+
+}
+
+#endif // __ASYNC_FILE_IO_H__
@@ -0,0 +1,177 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __CHASE_LEV_DEQUE_H__
+#define __CHASE_LEV_DEQUE_H__
+
+#include <CpuUtils.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace CppUtils {
+
+/**
+ * ChaseLevDeque - the growable work-stealing deque of Chase and Lev, with the
+ * C11 memory orderings of Le, Pop, Cohen and Zappa Nardelli.
+ *
+ * The owner thread pushes and pops at the bottom (LIFO), any number of
+ * thieves steal from the top (FIFO). Only the owner may call Push() and
+ * Pop(). When the ring fills up the owner doubles it; retired rings are kept
+ * until the deque is destroyed because a thief may still be reading them.
+ *
+ * @tparam T - Trivially copyable, typically a pointer to the actual task
+ */
+template<typename T>
+class ChaseLevDeque
+{
+  static_assert( std::is_trivially_copyable<T>::value, "ChaseLevDeque holds trivially copyable items" );
+
+public:
+  explicit ChaseLevDeque( size_t capacity = 256 ) : m_top{ 0 }, m_bottom{ 0 }
+  {
+    size_t size = 2;
+    while( size < capacity ) {
+      size <<= 1;
+    }
+    m_rings.emplace_back( new Ring( size ) );
+    m_pRing.store( m_rings.back().get(), std::memory_order_relaxed );
+  }
+
+  ChaseLevDeque( const ChaseLevDeque& ) = delete;
+  ChaseLevDeque& operator=( const ChaseLevDeque& ) = delete;
+
+  /**
+   * Owner only
+   */
+  void Push( T item )
+  {
+    int64_t bottom = m_bottom.load( std::memory_order_relaxed );
+    int64_t top = m_top.load( std::memory_order_acquire );
+    Ring* pRing = m_pRing.load( std::memory_order_relaxed );
+    if( bottom - top > pRing->m_mask ) {
+      pRing = Grow( pRing, top, bottom );
+    }
+    pRing->Put( bottom, item );
+    std::atomic_thread_fence( std::memory_order_release );
+    m_bottom.store( bottom + 1, std::memory_order_relaxed );
+  }
+
+  /**
+   * Owner only, takes the most recently pushed item.
+   * @return false if the deque is empty
+   */
+  bool Pop( T& out )
+  {
+    int64_t bottom = m_bottom.load( std::memory_order_relaxed ) - 1;
+    Ring* pRing = m_pRing.load( std::memory_order_relaxed );
+    m_bottom.store( bottom, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    int64_t top = m_top.load( std::memory_order_relaxed );
+    bool retval = false;
+    if( top <= bottom ) {
+      out = pRing->Get( bottom );
+      retval = true;
+      if( top == bottom ) {
+        // Last item, race the thieves for it
+        retval = m_top.compare_exchange_strong( top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed );
+        m_bottom.store( bottom + 1, std::memory_order_relaxed );
+      }
+    } else {
+      m_bottom.store( bottom + 1, std::memory_order_relaxed );
+    }
+    return retval;
+  }
+
+  /**
+   * Any thread, takes the oldest item.
+   * @return false if the deque is empty or another thread won the race
+   */
+  bool Steal( T& out )
+  {
+    int64_t top = m_top.load( std::memory_order_acquire );
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    int64_t bottom = m_bottom.load( std::memory_order_acquire );
+    if( top >= bottom ) {
+      return false;
+    }
+    Ring* pRing = m_pRing.load( std::memory_order_acquire );
+    T item = pRing->Get( top );
+    if( !m_top.compare_exchange_strong( top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed ) ) {
+      return false;
+    }
+    out = item;
+    return true;
+  }
+
+  /**
+   * Approximate number of items, may be called from any thread.
+   */
+  size_t Size() const
+  {
+    int64_t bottom = m_bottom.load( std::memory_order_acquire );
+    int64_t top = m_top.load( std::memory_order_acquire );
+    return bottom > top ? static_cast<size_t>( bottom - top ) : 0;
+  }
+
+  bool Empty() const { return Size() == 0; }
+
+private:
+  struct Ring
+  {
+    explicit Ring( size_t size ) : m_mask{ static_cast<int64_t>( size ) - 1 }, m_pSlots{ new std::atomic<T>[ size ] }
+    { }
+
+    void Put( int64_t index, T item ) { m_pSlots[ index & m_mask ].store( item, std::memory_order_relaxed ); }
+    T Get( int64_t index ) const { return m_pSlots[ index & m_mask ].load( std::memory_order_relaxed ); }
+
+    const int64_t m_mask;
+    std::unique_ptr<std::atomic<T>[]> m_pSlots;
+  };
+
+  Ring* Grow( Ring* pRing, int64_t top, int64_t bottom )
+  {
+    Ring* pBigger = new Ring( 2 * ( pRing->m_mask + 1 ) );
+    m_rings.emplace_back( pBigger );
+    for( int64_t i = top; i < bottom; i++ ) {
+      pBigger->Put( i, pRing->Get( i ) );
+    }
+    m_pRing.store( pBigger, std::memory_order_release );
+    return pBigger;
+  }
+
+  // Thieves hammer m_top, keep it off the owner's line
+  std::atomic<int64_t> m_top;
+  char m_pad0[ CPPUTILS_CACHE_LINE_SIZE - sizeof( std::atomic<int64_t> ) ];
+  std::atomic<int64_t> m_bottom;
+  std::atomic<Ring*> m_pRing;
+  // Owner only
+  std::vector<std::unique_ptr<Ring>> m_rings;
+};
+
+}
+
+#endif // __CHASE_LEV_DEQUE_H__
@@ -0,0 +1,597 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __COROUTINE_H__
+#define __COROUTINE_H__
+
+#if !defined( __cpp_impl_coroutine )
+#error "Coroutine.h needs C++20 coroutines, link the CppUtilsCoro target"
+#endif
+
+#include <condition_variable>
+#include <Task.h>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+namespace CppUtils {
+namespace Coro {
+
+/**
+ * FrameAllocator - where Task coroutine frames come from.
+ *
+ * By default frames use operator new. A coroutine whose first parameters are
+ * ( std::allocator_arg_t, const Alloc& ) - or, for a member function, whose
+ * parameters after the object are - gets its frame from that allocator
+ * instead. The allocator, the size of the block and how to free it are kept
+ * in a header in front of the frame, so every frame is freed through the one
+ * operator delete( void* ), e.g.
+ *
+ *   Coro::Task<int> Handle( std::allocator_arg_t, ArenaAllocator<std::byte>, Request req );
+ */
+class FrameAllocator
+{
+public:
+  template<typename Alloc>
+  static void* Allocate( size_t size, const Alloc& alloc )
+  {
+    using ByteAlloc = typename std::allocator_traits<Alloc>::template rebind_alloc<std::byte>;
+    ByteAlloc byteAlloc( alloc );
+    size_t total = HeaderSize<ByteAlloc>() + size;
+    std::byte* pBlock = std::allocator_traits<ByteAlloc>::allocate( byteAlloc, total );
+    new( pBlock ) ByteAlloc( std::move( byteAlloc ) );
+    std::byte* pFrame = pBlock + HeaderSize<ByteAlloc>();
+    new( pFrame - sizeof( Header ) ) Header{ &Deallocate<ByteAlloc>, total };
+    return pFrame;
+  }
+
+  static void Deallocate( void* pFrame )
+  {
+    Header* pHeader = reinterpret_cast<Header*>( static_cast<std::byte*>( pFrame ) - sizeof( Header ) );
+    pHeader->m_deallocate( pFrame, pHeader->m_total );
+  }
+
+private:
+  // Right in front of the frame, the allocator is at the start of the block
+  struct Header
+  {
+    void ( *m_deallocate )( void*, size_t );
+    size_t m_total;
+  };
+
+  static constexpr size_t kFrameAlignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+  static constexpr size_t AlignUp( size_t n, size_t alignment ) { return ( n + alignment - 1 ) & ~( alignment - 1 ); }
+
+  template<typename ByteAlloc>
+  static constexpr size_t HeaderSize()
+  {
+    return AlignUp( AlignUp( sizeof( ByteAlloc ), alignof( Header ) ) + sizeof( Header ), kFrameAlignment );
+  }
+
+  template<typename ByteAlloc>
+  static void Deallocate( void* pFrame, size_t total )
+  {
+    std::byte* pBlock = static_cast<std::byte*>( pFrame ) - HeaderSize<ByteAlloc>();
+    ByteAlloc* pAlloc = reinterpret_cast<ByteAlloc*>( pBlock );
+    ByteAlloc byteAlloc( std::move( *pAlloc ) );
+    pAlloc->~ByteAlloc();
+    std::allocator_traits<ByteAlloc>::deallocate( byteAlloc, pBlock, total );
+  }
+};
+
+template<typename T = void> class Task;
+
+class TaskPromiseBase
+{
+public:
+  static void* operator new( size_t size )
+  {
+    return FrameAllocator::Allocate( size, std::allocator<std::byte>() );
+  }
+
+  static void operator delete( void* pFrame )
+  {
+    FrameAllocator::Deallocate( pFrame );
+  }
+
+  // Lazy, the task starts when it is awaited
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  struct FinalAwaiter
+  {
+    bool await_ready() const noexcept { return false; }
+
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend( std::coroutine_handle<Promise> handle ) noexcept
+    {
+      std::coroutine_handle<> continuation = handle.promise().m_continuation;
+      return continuation ? continuation : std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept { }
+  };
+
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() { m_error = std::current_exception(); }
+
+  std::coroutine_handle<> m_continuation;
+  std::exception_ptr m_error;
+};
+
+template<typename T>
+class TaskPromise : public TaskPromiseBase
+{
+public:
+  Task<T> get_return_object();
+
+  template<typename U>
+  void return_value( U&& value )
+  {
+    m_value.emplace( std::forward<U>( value ) );
+  }
+
+  T Result()
+  {
+    if( m_error ) {
+      std::rethrow_exception( m_error );
+    }
+    return std::move( *m_value );
+  }
+
+private:
+  std::optional<T> m_value;
+};
+
+template<>
+class TaskPromise<void> : public TaskPromiseBase
+{
+public:
+  Task<void> get_return_object();
+
+  void return_void() { }
+
+  void Result()
+  {
+    if( m_error ) {
+      std::rethrow_exception( m_error );
+    }
+  }
+};
+
+/**
+ * Task - lazily started, move-only coroutine returning T.
+ *
+ * co_await a Task from another coroutine to start it; the awaiting coroutine
+ * resumes, by symmetric transfer, right where the task finished, which may
+ * be another thread if the task hopped with co_await thr.Schedule().
+ * Exceptions propagate to the awaiter. Use SyncWait() to run a task from
+ * ordinary code.
+ */
+template<typename T>
+class Task
+{
+public:
+  using promise_type = TaskPromise<T>;
+
+  Task() noexcept = default;
+
+  Task( Task&& other ) noexcept :
+    m_handle{ std::exchange( other.m_handle, nullptr ) },
+    m_pPromise{ std::exchange( other.m_pPromise, nullptr ) }
+  { }
+
+  Task& operator=( Task&& other ) noexcept
+  {
+    if( this != &other ) {
+      Reset();
+      m_handle = std::exchange( other.m_handle, nullptr );
+      m_pPromise = std::exchange( other.m_pPromise, nullptr );
+    }
+    return *this;
+  }
+
+  Task( const Task& ) = delete;
+  Task& operator=( const Task& ) = delete;
+
+  ~Task()
+  {
+    Reset();
+  }
+
+  bool Valid() const noexcept { return static_cast<bool>( m_handle ); }
+
+  bool IsReady() const noexcept { return !m_handle || m_handle.done(); }
+
+  struct Awaiter
+  {
+    std::coroutine_handle<> m_handle;
+    TaskPromise<T>* m_pPromise;
+
+    bool await_ready() const noexcept { return !m_handle || m_handle.done(); }
+
+    std::coroutine_handle<> await_suspend( std::coroutine_handle<> awaiting ) noexcept
+    {
+      m_pPromise->m_continuation = awaiting;
+      return m_handle;
+    }
+
+    T await_resume() { return m_pPromise->Result(); }
+  };
+
+  Awaiter operator co_await() const& noexcept { return Awaiter{ m_handle, m_pPromise }; }
+  Awaiter operator co_await() const&& noexcept { return Awaiter{ m_handle, m_pPromise }; }
+
+private:
+  friend class TaskPromise<T>;
+  template<typename, typename, typename...> friend class AllocatorTaskPromise;
+
+  // The promise may derive from TaskPromise<T>, see AllocatorTaskPromise
+  Task( std::coroutine_handle<> handle, TaskPromise<T>* pPromise ) noexcept : m_handle{ handle }, m_pPromise{ pPromise }
+  { }
+
+  void Reset()
+  {
+    if( m_handle ) {
+      m_handle.destroy();
+      m_handle = nullptr;
+      m_pPromise = nullptr;
+    }
+  }
+
+  std::coroutine_handle<> m_handle;
+  TaskPromise<T>* m_pPromise = nullptr;
+};
+
+template<typename T>
+Task<T> TaskPromise<T>::get_return_object()
+{
+  return Task<T>( std::coroutine_handle<TaskPromise<T>>::from_promise( *this ), this );
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+  return Task<void>( std::coroutine_handle<TaskPromise<void>>::from_promise( *this ), this );
+}
+
+/**
+ * AllocatorTaskPromise - the promise of a Task coroutine that takes an
+ * allocator, see FrameAllocator. Params are the coroutine's parameter types,
+ * led by the object for a member function.
+ *
+ * operator new is not a template here, it is a plain member of a class
+ * template, so it pairs with operator delete and compilers that check
+ * new / delete pairs accept the frame being freed through it.
+ */
+template<typename T, typename Alloc, typename... Params>
+class AllocatorTaskPromise : public TaskPromise<T>
+{
+public:
+  static void* operator new( size_t size, const Params&... params )
+  {
+    return FrameAllocator::Allocate( size, FindAllocator( params... ) );
+  }
+
+  static void operator delete( void* pFrame )
+  {
+    FrameAllocator::Deallocate( pFrame );
+  }
+
+  Task<T> get_return_object()
+  {
+    return Task<T>( std::coroutine_handle<AllocatorTaskPromise>::from_promise( *this ), this );
+  }
+
+private:
+  template<typename... Rest>
+  static const Alloc& FindAllocator( std::allocator_arg_t, const Alloc& alloc, const Rest&... )
+  {
+    return alloc;
+  }
+
+  template<typename Self, typename... Rest>
+  static const Alloc& FindAllocator( const Self&, std::allocator_arg_t, const Alloc& alloc, const Rest&... )
+  {
+    return alloc;
+  }
+};
+
+class SyncWaitState
+{
+public:
+  void Signal()
+  {
+    // Notify with the lock held, the state dies as soon as Wait() returns
+    std::lock_guard<std::mutex> lk( m_mtx );
+    m_done = true;
+    m_cond.notify_one();
+  }
+
+  void Wait()
+  {
+    std::unique_lock<std::mutex> lk( m_mtx );
+    m_cond.wait( lk, [this]() { return m_done; } );
+  }
+
+private:
+  std::mutex m_mtx;
+  std::condition_variable m_cond;
+  bool m_done = false;
+};
+
+// Starts eagerly and frees its own frame when it finishes
+struct SyncWaitDriver
+{
+  struct promise_type
+  {
+    SyncWaitDriver get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept { }
+    void unhandled_exception() noexcept { std::terminate(); }
+  };
+};
+
+// Waits for an awaiter without taking its result, SyncWait takes it after
+template<typename Awaiter>
+struct CompletionAwaiter
+{
+  Awaiter m_awaiter;
+
+  bool await_ready() { return m_awaiter.await_ready(); }
+
+  template<typename Handle>
+  auto await_suspend( Handle handle ) { return m_awaiter.await_suspend( handle ); }
+
+  void await_resume() noexcept { }
+};
+
+template<typename T>
+SyncWaitDriver RunToCompletion( const Task<T>& task, SyncWaitState& state )
+{
+  co_await CompletionAwaiter<typename Task<T>::Awaiter>{ task.operator co_await() };
+  state.Signal();
+}
+
+/**
+ * Blocks the calling thread until task has finished and returns its result.
+ * The task starts on the calling thread and may finish on any other.
+ */
+template<typename T>
+T SyncWait( Task<T> task )
+{
+  SyncWaitState state;
+  RunToCompletion( task, state );
+  state.Wait();
+  return task.operator co_await().await_resume();
+}
+
+/**
+ * AsyncQueue - an unbounded FIFO that coroutines can co_await, e.g.
+ *
+ *   Coro::AsyncQueue<Request, DispatchPool> requests( pool );
+ *   Request req = co_await requests.Pop();
+ *
+ * A coroutine suspended in Pop() is handed the next item and resumed as a
+ * task on the executor, never on the stack of the thread that pushed the
+ * item or closed the queue. If the executor rejects the task (it has been
+ * killed) the coroutine is resumed on that thread instead. Pop() yields a
+ * value initialized T once the queue is closed and drained, Pop( out )
+ * yields false in that case.
+ */
+template<typename T, typename Executor>
+class AsyncQueue
+{
+  // A coroutine suspended in Pop(), guarded by m_mtx while listed
+  struct Waiter
+  {
+    Waiter* m_pNext;
+    T* m_pOut;
+    bool m_got;
+    std::coroutine_handle<> m_handle;
+  };
+
+public:
+  explicit AsyncQueue( Executor& executor ) : m_executor( executor )
+  { }
+
+  AsyncQueue( const AsyncQueue& ) = delete;
+  AsyncQueue& operator=( const AsyncQueue& ) = delete;
+
+  /**
+   * Hands the item to the longest suspended Pop(), or queues it.
+   * @return false if the queue has been closed
+   */
+  template<typename... Args>
+  bool EnQueue( Args&&... args )
+  {
+    std::unique_lock<std::mutex> lk( m_mtx );
+    if( m_closed ) {
+      return false;
+    }
+    Waiter* pWaiter = m_pWaitersHead;
+    if( !pWaiter ) {
+      m_q.emplace_back( std::forward<Args>( args )... );
+      return true;
+    }
+    m_pWaitersHead = pWaiter->m_pNext;
+    if( !m_pWaitersHead ) {
+      m_pWaitersTail = nullptr;
+    }
+    lk.unlock();
+    *pWaiter->m_pOut = T( std::forward<Args>( args )... );
+    pWaiter->m_got = true;
+    Resume( *pWaiter );
+    return true;
+  }
+
+  bool TryDeQueue( T& out )
+  {
+    std::lock_guard<std::mutex> lk( m_mtx );
+    return TakeFront( out );
+  }
+
+  /**
+   * Rejects further items and resumes every suspended Pop() empty handed.
+   * Items already queued can still be popped.
+   */
+  void Close()
+  {
+    std::unique_lock<std::mutex> lk( m_mtx );
+    m_closed = true;
+    Waiter* pWaiter = m_pWaitersHead;
+    m_pWaitersHead = m_pWaitersTail = nullptr;
+    lk.unlock();
+    while( pWaiter ) {
+      // Resuming may destroy the waiter
+      Waiter* pNext = pWaiter->m_pNext;
+      Resume( *pWaiter );
+      pWaiter = pNext;
+    }
+  }
+
+  bool IsClosed() const
+  {
+    std::lock_guard<std::mutex> lk( m_mtx );
+    return m_closed;
+  }
+
+  template<bool kInto>
+  class PopAwaiter : private Waiter
+  {
+  public:
+    PopAwaiter( AsyncQueue& q, T* pOut ) : Waiter{ nullptr, pOut, false, {} }, m_q( q ), m_item()
+    { }
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend( std::coroutine_handle<> handle )
+    {
+      if( !this->m_pOut ) {
+        this->m_pOut = &m_item;
+      }
+      this->m_handle = handle;
+      return m_q.Suspend( *this );
+    }
+
+    typename std::conditional<kInto, bool, T>::type await_resume()
+    {
+      return Result( std::integral_constant<bool, kInto>() );
+    }
+
+  private:
+    bool Result( std::true_type ) { return this->m_got; }
+    T Result( std::false_type ) { return std::move( m_item ); }
+
+    AsyncQueue& m_q;
+    T m_item;
+  };
+
+  PopAwaiter<false> Pop()
+  {
+    return PopAwaiter<false>( *this, nullptr );
+  }
+
+  PopAwaiter<true> Pop( T& out )
+  {
+    return PopAwaiter<true>( *this, &out );
+  }
+
+private:
+  // Expects m_mtx to be held
+  bool TakeFront( T& out )
+  {
+    if( m_q.empty() ) {
+      return false;
+    }
+    out = std::move( m_q.front() );
+    m_q.pop_front();
+    return true;
+  }
+
+  /**
+   * Parks a coroutine unless an item or Close() beat it to it.
+   * @return false if the coroutine should carry on right away
+   */
+  bool Suspend( Waiter& waiter )
+  {
+    std::lock_guard<std::mutex> lk( m_mtx );
+    if( TakeFront( *waiter.m_pOut ) ) {
+      waiter.m_got = true;
+      return false;
+    }
+    if( m_closed ) {
+      return false;
+    }
+    if( m_pWaitersTail ) {
+      m_pWaitersTail->m_pNext = &waiter;
+    } else {
+      m_pWaitersHead = &waiter;
+    }
+    m_pWaitersTail = &waiter;
+    return true;
+  }
+
+  void Resume( Waiter& waiter )
+  {
+    std::coroutine_handle<> handle = waiter.m_handle;
+    if( !m_executor.PostToDispatch( CppUtils::Task( [handle]() { handle.resume(); } ) ) ) {
+      handle.resume();
+    }
+  }
+
+  Executor& m_executor;
+  mutable std::mutex m_mtx;
+  std::deque<T> m_q;
+  bool m_closed = false;
+  // FIFO of suspended coroutines
+  Waiter* m_pWaitersHead = nullptr;
+  Waiter* m_pWaitersTail = nullptr;
+};
+
+}
+}
+
+// Picks AllocatorTaskPromise for Task coroutines that take
+// ( std::allocator_arg_t, const Alloc& ), as free or member functions
+template<typename T, typename Alloc, typename... Args>
+struct std::coroutine_traits<CppUtils::Coro::Task<T>, std::allocator_arg_t, Alloc, Args...>
+{
+  using promise_type = CppUtils::Coro::AllocatorTaskPromise<T, std::decay_t<Alloc>, std::allocator_arg_t, Alloc, Args...>;
+};
+
+template<typename T, typename Self, typename Alloc, typename... Args>
+struct std::coroutine_traits<CppUtils::Coro::Task<T>, Self, std::allocator_arg_t, Alloc, Args...>
+{
+  using promise_type = CppUtils::Coro::AllocatorTaskPromise<T, std::decay_t<Alloc>, Self, std::allocator_arg_t, Alloc, Args...>;
+};
+
+#endif // __COROUTINE_H__
@@ -0,0 +1,47 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __CPU_UTILS_H__
+#define __CPU_UTILS_H__
+
+/**
+ * Small set of hardware related helpers shared by the lock-free containers.
+ */
+
+// Size used to pad hot atomics so that producers and consumers do not
+// false-share a cache line. Override at build time for exotic targets.
+#ifndef CPPUTILS_CACHE_LINE_SIZE
+#define CPPUTILS_CACHE_LINE_SIZE 64
+#endif
+
+// Hint to the CPU that we are in a spin loop.
+#if defined( __i386__ ) || defined( __x86_64__ ) || defined( _M_IX86 ) || defined( _M_X64 )
+#include <immintrin.h>
+#define CPPUTILS_CPU_RELAX() _mm_pause()
+#elif defined( __aarch64__ ) || defined( __arm__ )
+#define CPPUTILS_CPU_RELAX() __asm__ __volatile__( "yield" )
+#else
+#define CPPUTILS_CPU_RELAX() do { } while( 0 )
+#endif
+
+#endif // __CPU_UTILS_H__
@@ -0,0 +1,363 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __DISPATCH_POOL_H__
+#define __DISPATCH_POOL_H__
+
+#include <ChaseLevDeque.h>
+#include <DispatchThread.h>
+#include <EventCount.h>
+#include <TsQueue.h>
+#include <WaitStrategy.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace CppUtils
+{
+
+/**
+ * BasicDispatchPool - N worker threads behind the DispatchThread API.
+ *
+ * Every worker owns a ChaseLevDeque. Tasks posted from inside a worker go to
+ * its own deque, tasks posted from anywhere else go to a shared injection
+ * queue. An idle worker first pops its own deque, then the injection queue,
+ * then steals from the other workers starting at a random victim; when that
+ * keeps failing it spins according to WaitStrategy and parks.
+ *
+ * There is no ordering between tasks, use a DispatchThread or a Strand for
+ * that. Kill() has DispatchThread semantics: queued tasks still run, new
+ * posts are rejected.
+ *
+ * @tparam FnType - Callable as void(void)
+ * @tparam WaitStrategy - What an idle worker does before parking
+ */
+template<typename FnType, typename WaitStrategy = SpinThenParkWait<>>
+class BasicDispatchPool
+{
+public:
+  using Fn = FnType;
+
+  /**
+   * @param threads - Number of workers, one per hardware thread by default
+   */
+  explicit BasicDispatchPool( size_t threads = thread::hardware_concurrency() )
+    : BasicDispatchPool( threads, DispatchThreadOptions() )
+  { }
+
+  /**
+   * @param options - Applied to every worker, see DispatchThreadOptions. All
+   *        workers share the cpu set, worker i is named "<name>-<i>". Throws
+   *        std::system_error if they cannot be applied.
+   */
+  BasicDispatchPool( size_t threads, const DispatchThreadOptions& options ) : m_closed{ false }
+  {
+    threads = threads ? threads : 1;
+    for( size_t i = 0; i < threads; i++ ) {
+      m_workers.emplace_back( new Worker( this, static_cast<uint32_t>( i ) ) );
+    }
+    DispatchThreadOptions workerOptions = options;
+    try {
+      for( size_t i = 0; i < threads; i++ ) {
+        Worker* pWorker = m_workers[ i ].get();
+        if( !options.m_name.empty() ) {
+          workerOptions.m_name = options.m_name + "-" + to_string( i );
+        }
+        m_threads.emplace_back( new ConfiguredThread( workerOptions, [this, pWorker]() { Run( *pWorker ); } ) );
+      }
+    } catch( ... ) {
+      // Workers that did start must not outlive the pool
+      Kill();
+      throw;
+    }
+  }
+
+  virtual ~BasicDispatchPool()
+  {
+    Kill();
+  }
+
+  BasicDispatchPool( const BasicDispatchPool& ) = delete;
+  BasicDispatchPool& operator=( const BasicDispatchPool& ) = delete;
+
+  /**
+   * Stops accepting new tasks. The tasks that are already queued still run,
+   * after which the workers exit. Blocks until then unless called from one
+   * of the workers.
+   */
+  void Kill()
+  {
+    m_closed.store( true, memory_order_release );
+    m_injected.Close();
+    m_idle.NotifyAll();
+    if( !IsWorkerThread() ) {
+      for( auto& spWorker : m_threads ) {
+        spWorker->Join();
+      }
+      m_threads.clear();
+    }
+  }
+
+  /**
+   * @return false if fn is empty or the pool has been killed
+   */
+  bool PostToDispatch( Fn fn )
+  {
+    if( !fn || m_closed.load( memory_order_acquire ) ) {
+      return false;
+    }
+    Worker* pWorker = CurrentWorker();
+    if( pWorker && pWorker->m_pPool == this ) {
+      pWorker->m_deque.Push( pWorker->NewNode( std::move( fn ) ) );
+    } else if( !m_injected.EnQueue( std::move( fn ) ) ) {
+      return false;
+    }
+    m_idle.NotifyOne();
+    return true;
+  }
+
+  /**
+   * Runs fn on the pool and hands its result back through a Future, see
+   * Future.h.
+   */
+  template<typename F>
+  Future<SubmitResult<F>> Submit( F&& fn )
+  {
+    return SubmitTo( *this, std::forward<F>( fn ) );
+  }
+
+  /**
+   * co_await Schedule() resumes a C++20 coroutine on one of the workers, see
+   * ScheduleAwaiter.h.
+   */
+  ScheduleAwaiter<BasicDispatchPool> Schedule()
+  {
+    return ScheduleAwaiter<BasicDispatchPool>( *this );
+  }
+
+  size_t ThreadCount() const { return m_workers.size(); }
+
+  /**
+   * Runs one queued task on the calling thread, if there is one: a worker
+   * takes from its own deque first, any other thread from the injection
+   * queue or by stealing. Lets a thread that waits for work it posted help
+   * instead of blocking, see Strand::Kill() and ParallelFor.
+   * @return false if nothing was queued
+   */
+  bool TryRunOne()
+  {
+    Fn fn;
+    Worker* pWorker = CurrentWorker();
+    bool found = ( pWorker && pWorker->m_pPool == this ) ? FindWork( *pWorker, fn ) : FindForeignWork( fn );
+    if( found ) {
+      fn();
+    }
+    return found;
+  }
+
+  /**
+   * @return true if called from one of this pool's workers
+   */
+  bool IsWorkerThread() const
+  {
+    Worker* pWorker = CurrentWorker();
+    return pWorker && pWorker->m_pPool == this;
+  }
+
+private:
+  struct Worker;
+
+  // A task in a worker's deque. Nodes go back to the worker that made them
+  // once the task is taken, so posting from a worker does not allocate in
+  // steady state.
+  struct Node
+  {
+    Fn m_fn;
+    Worker* m_pOwner;
+    Node* m_pNext;
+  };
+
+  struct Worker
+  {
+    Worker( BasicDispatchPool* pPool, uint32_t index ) : m_pPool{ pPool }, m_seed{ index * 2654435761u + 1 }
+    { }
+
+    ~Worker()
+    {
+      Node* pNode = nullptr;
+      while( m_deque.Pop( pNode ) ) {
+        delete pNode;
+      }
+      DeleteList( m_pFree );
+      DeleteList( m_pReturned.exchange( nullptr, memory_order_acquire ) );
+    }
+
+    // Owner only
+    Node* NewNode( Fn&& fn )
+    {
+      if( !m_pFree ) {
+        m_pFree = m_pReturned.exchange( nullptr, memory_order_acquire );
+      }
+      Node* pNode = m_pFree;
+      if( !pNode ) {
+        return new Node{ std::move( fn ), this, nullptr };
+      }
+      m_pFree = pNode->m_pNext;
+      pNode->m_fn = std::move( fn );
+      return pNode;
+    }
+
+    // pTaker is the worker that took the node, null for other threads. They
+    // push onto m_pReturned, which the owner only ever empties as a whole,
+    // so the stack is free of ABA.
+    void Recycle( Node* pNode, Worker* pTaker )
+    {
+      if( pTaker == this ) {
+        pNode->m_pNext = m_pFree;
+        m_pFree = pNode;
+        return;
+      }
+      Node* pHead = m_pReturned.load( memory_order_relaxed );
+      do {
+        pNode->m_pNext = pHead;
+      } while( !m_pReturned.compare_exchange_weak( pHead, pNode, memory_order_release, memory_order_relaxed ) );
+    }
+
+    static void DeleteList( Node* pNode )
+    {
+      while( pNode ) {
+        Node* pNext = pNode->m_pNext;
+        delete pNode;
+        pNode = pNext;
+      }
+    }
+
+    // xorshift32, good enough to pick a victim
+    uint32_t NextRandom()
+    {
+      m_seed ^= m_seed << 13;
+      m_seed ^= m_seed >> 17;
+      m_seed ^= m_seed << 5;
+      return m_seed;
+    }
+
+    BasicDispatchPool* const m_pPool;
+    uint32_t m_seed;
+    ChaseLevDeque<Node*> m_deque;
+    Node* m_pFree = nullptr;
+    atomic<Node*> m_pReturned{ nullptr };
+  };
+
+  static Worker*& CurrentWorker()
+  {
+    static thread_local Worker* pWorker = nullptr;
+    return pWorker;
+  }
+
+  void Run( Worker& self )
+  {
+    CurrentWorker() = &self;
+    Fn fn;
+    for( ;; ) {
+      bool found = FindWork( self, fn );
+      if( !found ) {
+        typename WaitStrategy::Waiter waiter;
+        while( !( found = FindWork( self, fn ) ) && !m_closed.load( memory_order_acquire ) && waiter.Spin() );
+        if( !found ) {
+          m_idle.Wait( [&]() { return ( found = FindWork( self, fn ) ) || m_closed.load( memory_order_acquire ); } );
+        }
+        // Killed, exit once nothing is left
+        if( !found && !FindWork( self, fn ) ) {
+          break;
+        }
+      }
+      fn();
+      fn = Fn();
+    }
+    CurrentWorker() = nullptr;
+  }
+
+  bool FindWork( Worker& self, Fn& fn )
+  {
+    Node* pNode = nullptr;
+    if( self.m_deque.Pop( pNode ) ) {
+      return Take( pNode, &self, fn );
+    }
+    if( m_injected.TryDeQueue( fn ) ) {
+      return true;
+    }
+    return Steal( self.NextRandom(), &self, fn );
+  }
+
+  // For threads that are not workers of this pool
+  bool FindForeignWork( Fn& fn )
+  {
+    if( m_injected.TryDeQueue( fn ) ) {
+      return true;
+    }
+    static thread_local uint32_t nextVictim = 0;
+    return Steal( nextVictim++, nullptr, fn );
+  }
+
+  bool Steal( uint32_t start, Worker* pSelf, Fn& fn )
+  {
+    Node* pNode = nullptr;
+    size_t count = m_workers.size();
+    for( size_t i = 0; i < count; i++ ) {
+      Worker& victim = *m_workers[ ( start + i ) % count ];
+      if( &victim == pSelf ) {
+        continue;
+      }
+      // Steal() also fails when another thief wins, retry while there is work
+      while( !victim.m_deque.Empty() ) {
+        if( victim.m_deque.Steal( pNode ) ) {
+          return Take( pNode, pSelf, fn );
+        }
+      }
+    }
+    return false;
+  }
+
+  static bool Take( Node* pNode, Worker* pTaker, Fn& fn )
+  {
+    fn = std::move( pNode->m_fn );
+    pNode->m_fn = Fn();
+    pNode->m_pOwner->Recycle( pNode, pTaker );
+    return true;
+  }
+
+  vector<unique_ptr<Worker>> m_workers;
+  vector<unique_ptr<ConfiguredThread>> m_threads;
+  TsQueue<Fn> m_injected;
+  EventCount m_idle;
+  atomic<bool> m_closed;
+};
+
+using DispatchPool = BasicDispatchPool<DispatchFn>;
+
+}
+
+#endif // __DISPATCH_POOL_H__
@@ -0,0 +1,424 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __DISPATCH_STATS_H__
+#define __DISPATCH_STATS_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace CppUtils {
+
+/**
+ * HdrHistogram - log linear histogram of non negative integer values, e.g.
+ * nanoseconds.
+ *
+ * Values below 128 are counted exactly, larger ones in 64 sub buckets per
+ * power of two, so any recorded value is off by less than 1/64 (1.6%).
+ * Values above kMaxValue (about 36 minutes in nanoseconds) count as
+ * kMaxValue. Record() is lock free and may be called from any thread.
+ */
+class HdrHistogram
+{
+public:
+  static constexpr uint64_t kMaxValue = ( uint64_t( 1 ) << 41 ) - 1;
+  static constexpr size_t kBucketCount = 128 + 34 * 64;
+
+  class Snapshot
+  {
+  public:
+    Snapshot() : m_counts( kBucketCount, 0 )
+    { }
+
+    uint64_t Count() const { return m_count; }
+    uint64_t Min() const { return m_count ? m_min : 0; }
+    uint64_t Max() const { return m_max; }
+    double Mean() const { return m_count ? double( m_sum ) / double( m_count ) : 0.0; }
+
+    /**
+     * @param percentile - 0 to 100
+     * @return the largest value that falls in the same bucket as the value
+     *         at percentile, 0 if nothing was recorded
+     */
+    uint64_t ValueAtPercentile( double percentile ) const
+    {
+      if( !m_count ) {
+        return 0;
+      }
+      double wanted = percentile / 100.0 * double( m_count );
+      uint64_t rank = wanted < 1.0 ? 1 : uint64_t( wanted + 0.5 );
+      uint64_t seen = 0;
+      for( size_t i = 0; i < kBucketCount; i++ ) {
+        seen += m_counts[i];
+        if( seen >= rank ) {
+          uint64_t highest = HighestInBucket( i );
+          return highest < m_max ? highest : m_max;
+        }
+      }
+      return m_max;
+    }
+
+  private:
+    friend class HdrHistogram;
+
+    std::vector<uint64_t> m_counts;
+    uint64_t m_count = 0;
+    uint64_t m_sum = 0;
+    uint64_t m_min = 0;
+    uint64_t m_max = 0;
+  };
+
+  HdrHistogram()
+  {
+    for( auto& count : m_counts ) {
+      count.store( 0, std::memory_order_relaxed );
+    }
+  }
+
+  HdrHistogram( const HdrHistogram& ) = delete;
+  HdrHistogram& operator=( const HdrHistogram& ) = delete;
+
+  void Record( uint64_t value )
+  {
+    if( value > kMaxValue ) {
+      value = kMaxValue;
+    }
+    m_counts[BucketOf( value )].fetch_add( 1, std::memory_order_relaxed );
+    m_sum.fetch_add( value, std::memory_order_relaxed );
+    uint64_t min = m_min.load( std::memory_order_relaxed );
+    while( value < min && !m_min.compare_exchange_weak( min, value, std::memory_order_relaxed ) ) {
+    }
+    uint64_t max = m_max.load( std::memory_order_relaxed );
+    while( value > max && !m_max.compare_exchange_weak( max, value, std::memory_order_relaxed ) ) {
+    }
+  }
+
+  /**
+   * Copies the counts. Values recorded meanwhile may or may not show up.
+   */
+  Snapshot Take() const
+  {
+    Snapshot retval;
+    for( size_t i = 0; i < kBucketCount; i++ ) {
+      retval.m_counts[i] = m_counts[i].load( std::memory_order_relaxed );
+      retval.m_count += retval.m_counts[i];
+    }
+    retval.m_sum = m_sum.load( std::memory_order_relaxed );
+    retval.m_min = m_min.load( std::memory_order_relaxed );
+    retval.m_max = m_max.load( std::memory_order_relaxed );
+    return retval;
+  }
+
+  static size_t BucketOf( uint64_t value )
+  {
+    if( value < 128 ) {
+      return size_t( value );
+    }
+    unsigned shift = MostSignificantBit( value ) - 6;
+    return 128 + ( shift - 1 ) * 64 + size_t( ( value >> shift ) - 64 );
+  }
+
+  static uint64_t HighestInBucket( size_t bucket )
+  {
+    if( bucket < 128 ) {
+      return bucket;
+    }
+    unsigned shift = unsigned( ( bucket - 128 ) / 64 ) + 1;
+    uint64_t mantissa = 64 + ( bucket - 128 ) % 64;
+    return ( ( mantissa + 1 ) << shift ) - 1;
+  }
+
+private:
+  static unsigned MostSignificantBit( uint64_t value )
+  {
+#if defined( __GNUC__ )
+    return 63 - unsigned( __builtin_clzll( value ) );
+#else
+    unsigned msb = 0;
+    while( value >>= 1 ) {
+      msb++;
+    }
+    return msb;
+#endif
+  }
+
+  std::atomic<uint64_t> m_counts[kBucketCount];
+  std::atomic<uint64_t> m_sum{ 0 };
+  std::atomic<uint64_t> m_min{ UINT64_MAX };
+  std::atomic<uint64_t> m_max{ 0 };
+};
+
+/**
+ * Where a task was posted from, see CPPUTILS_TASK_SITE. m_pFile is null for
+ * tasks posted without one.
+ */
+struct TaskSite
+{
+  const char* m_pFile;
+  int m_line;
+};
+
+#define CPPUTILS_TASK_SITE ::CppUtils::TaskSite{ __FILE__, __LINE__ }
+
+/**
+ * A task stamped with the time it was created, i.e. posted, and optionally
+ * the site it was posted from. The queue element of instrumented dispatch
+ * threads, see DispatchStats.
+ */
+template<typename TaskType>
+class TimedTask
+{
+public:
+  TimedTask() = default;
+
+  template<typename F,
+           typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, TimedTask>::value>::type>
+  TimedTask( F&& fn ) : m_task( std::forward<F>( fn ) ), m_enqueuedAt( std::chrono::steady_clock::now() )
+  { }
+
+  template<typename F>
+  TimedTask( F&& fn, const TaskSite& site ) : TimedTask( std::forward<F>( fn ) )
+  {
+    m_site = site;
+  }
+
+  TimedTask( TimedTask&& ) = default;
+  TimedTask& operator=( TimedTask&& ) = default;
+
+  explicit operator bool() const { return static_cast<bool>( m_task ); }
+
+  void operator()() { m_task(); }
+
+  std::chrono::steady_clock::time_point EnqueuedAt() const { return m_enqueuedAt; }
+
+  const TaskSite& Site() const { return m_site; }
+
+private:
+  TaskType m_task;
+  std::chrono::steady_clock::time_point m_enqueuedAt;
+  TaskSite m_site = TaskSite{ nullptr, 0 };
+};
+
+/**
+ * The default stats policy of BasicDispatchThread: records nothing and
+ * compiles away entirely.
+ */
+class NoDispatchStats
+{
+public:
+  struct RunStamp
+  { };
+
+  void OnPost() { }
+  void OnRejected() { }
+  void OnDropped() { }
+
+  template<typename F>
+  RunStamp OnDequeue( const F& ) { return RunStamp(); }
+
+  void OnRun( RunStamp ) { }
+};
+
+/**
+ * DispatchTaskProbe - what a dispatch thread is running right now, published
+ * by its thread and sampled by any other, see DispatchWatchdog.
+ */
+class DispatchTaskProbe
+{
+public:
+  struct Sample
+  {
+    // Changes with every task, tells apart two tasks from the same site
+    uint64_t m_task;
+    std::chrono::steady_clock::time_point m_startedAt;
+    TaskSite m_site;
+  };
+
+  // Dispatch thread only
+  void Begin( std::chrono::steady_clock::time_point startedAt, const TaskSite& site )
+  {
+    // Odd while the fields are being written
+    m_writes += 2;
+    m_seq.store( m_writes - 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    m_startedAt.store( startedAt.time_since_epoch().count(), std::memory_order_relaxed );
+    m_pFile.store( site.m_pFile, std::memory_order_relaxed );
+    m_line.store( site.m_line, std::memory_order_relaxed );
+    m_seq.store( m_writes, std::memory_order_release );
+  }
+
+  // Dispatch thread only
+  void End()
+  {
+    m_startedAt.store( 0, std::memory_order_release );
+  }
+
+  /**
+   * @return false if the thread is idle or just switching tasks
+   */
+  bool Read( Sample& out ) const
+  {
+    uint64_t seq = m_seq.load( std::memory_order_acquire );
+    if( seq & 1 ) {
+      return false;
+    }
+    auto startedAt = m_startedAt.load( std::memory_order_relaxed );
+    out.m_site.m_pFile = m_pFile.load( std::memory_order_relaxed );
+    out.m_site.m_line = m_line.load( std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_acquire );
+    if( startedAt == 0 || m_seq.load( std::memory_order_relaxed ) != seq ) {
+      return false;
+    }
+    out.m_task = seq;
+    out.m_startedAt = std::chrono::steady_clock::time_point( std::chrono::steady_clock::duration( startedAt ) );
+    return true;
+  }
+
+private:
+  std::atomic<uint64_t> m_seq{ 0 };
+  std::atomic<std::chrono::steady_clock::rep> m_startedAt{ 0 };
+  std::atomic<const char*> m_pFile{ nullptr };
+  std::atomic<int> m_line{ 0 };
+  uint64_t m_writes = 0;
+};
+
+/**
+ * Scraped from DispatchStats::Snapshot(). Times are in nanoseconds.
+ */
+struct DispatchStatsSnapshot
+{
+  HdrHistogram::Snapshot m_queueWait;
+  HdrHistogram::Snapshot m_runTime;
+  size_t m_depth = 0;
+  size_t m_maxDepth = 0;
+  uint64_t m_completed = 0;
+  // Over the time since the previous Snapshot(), or construction
+  double m_tasksPerSecond = 0.0;
+};
+
+/**
+ * DispatchStats - instrumentation policy for BasicDispatchThread.
+ *
+ * Tracks how long tasks wait in the queue and run, the current and highest
+ * queue depth and the completion rate. Recording is lock free; the queue
+ * must hold TimedTask elements to know when a task was posted, see
+ * InstrumentedDispatchThread. Timer callbacks and DispatchTasks bypass the
+ * queue and are not counted. Probe() tells what the thread is running, for
+ * DispatchWatchdog.
+ */
+class DispatchStats
+{
+public:
+  using RunStamp = std::chrono::steady_clock::time_point;
+
+  DispatchStats() : m_lastSnapshotAt( std::chrono::steady_clock::now() )
+  { }
+
+  void OnPost()
+  {
+    size_t depth = m_depth.fetch_add( 1, std::memory_order_relaxed ) + 1;
+    size_t maxDepth = m_maxDepth.load( std::memory_order_relaxed );
+    while( depth > maxDepth && !m_maxDepth.compare_exchange_weak( maxDepth, depth, std::memory_order_relaxed ) ) {
+    }
+  }
+
+  void OnRejected()
+  {
+    m_depth.fetch_sub( 1, std::memory_order_relaxed );
+  }
+
+  void OnDropped()
+  {
+    m_depth.fetch_sub( 1, std::memory_order_relaxed );
+  }
+
+  template<typename F>
+  RunStamp OnDequeue( const F& fn )
+  {
+    RunStamp now = std::chrono::steady_clock::now();
+    m_depth.fetch_sub( 1, std::memory_order_relaxed );
+    m_queueWait.Record( Nanoseconds( now - fn.EnqueuedAt() ) );
+    m_probe.Begin( now, fn.Site() );
+    return now;
+  }
+
+  void OnRun( RunStamp startedAt )
+  {
+    m_probe.End();
+    m_runTime.Record( Nanoseconds( std::chrono::steady_clock::now() - startedAt ) );
+    m_completed.fetch_add( 1, std::memory_order_relaxed );
+  }
+
+  const DispatchTaskProbe& Probe() const
+  {
+    return m_probe;
+  }
+
+  DispatchStatsSnapshot Snapshot()
+  {
+    DispatchStatsSnapshot retval;
+    retval.m_queueWait = m_queueWait.Take();
+    retval.m_runTime = m_runTime.Take();
+    retval.m_depth = m_depth.load( std::memory_order_relaxed );
+    retval.m_maxDepth = m_maxDepth.load( std::memory_order_relaxed );
+    retval.m_completed = m_completed.load( std::memory_order_relaxed );
+
+    std::lock_guard<std::mutex> lk( m_snapshotMtx );
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>( now - m_lastSnapshotAt ).count();
+    if( elapsed > 0.0 ) {
+      retval.m_tasksPerSecond = double( retval.m_completed - m_lastCompleted ) / elapsed;
+    }
+    m_lastSnapshotAt = now;
+    m_lastCompleted = retval.m_completed;
+    return retval;
+  }
+
+private:
+  static uint64_t Nanoseconds( std::chrono::steady_clock::duration duration )
+  {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>( duration ).count();
+    return ns > 0 ? uint64_t( ns ) : 0;
+  }
+
+  HdrHistogram m_queueWait;
+  HdrHistogram m_runTime;
+  std::atomic<size_t> m_depth{ 0 };
+  std::atomic<size_t> m_maxDepth{ 0 };
+  std::atomic<uint64_t> m_completed{ 0 };
+  DispatchTaskProbe m_probe;
+
+  std::mutex m_snapshotMtx;
+  std::chrono::steady_clock::time_point m_lastSnapshotAt;
+  uint64_t m_lastCompleted = 0;
+};
+
+}
+
+#endif // __DISPATCH_STATS_H__
@@ -25,55 +25,546 @@
 #define __DISPATH_THREAD_H__
 
 #include <thread>
+#include <functional>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include <AShutdownable.h>
 #include <TsQueue.h>
+#include <SpscQueue.h>
+#include <PriorityTsQueue.h>
+#include <IntrusiveMpscQueue.h>
+#if defined( __linux__ )
+#include <ReactorQueue.h>
+#endif
+#include <DispatchTimers.h>
+#include <DispatchStats.h>
+#include <DispatchThreadOptions.h>
+#include <Task.h>
+#include <Future.h>
+#include <ScheduleAwaiter.h>
 
 namespace CppUtils
 {
 
 using namespace std;
 
-class DispatchThread
+/**
+ * Tasks are move-only and store lambdas of up to 64 bytes inline, see Task.h
+ */
+using DispatchFn = Task;
+
+/**
+ * How Shutdown() treats the tasks that are still queued. Drain runs them,
+ * drop destroys them unrun and counts them in DroppedCount().
+ */
+enum EShutdownMode {
+  eSHUTDOWN_MODE_DRAIN = 0,
+  eSHUTDOWN_MODE_DROP = 1,
+};
+
+/**
+ * A task that can be posted without allocating. The caller owns the object,
+ * the dispatch thread only links it into its queue and calls Run(). The task
+ * must stay alive until Run() is entered, after which it may be reposted,
+ * reused or deleted, including from inside Run().
+ */
+class DispatchTask : public MpscNode
 {
 public:
-  DispatchThread()
+  virtual ~DispatchTask() {}
+  virtual void Run() = 0;
+};
+
+/**
+ * BasicDispatchThread - a worker thread fed through QueueType.
+ *
+ * QueueType is the queueing policy. It must expose a ValueType callable as
+ * void(void), bool EnQueue( ValueType&& ), bool DeQueue( ValueType& ) and
+ * Close() with TsQueue semantics. Use the DispatchThread alias unless you
+ * know better.
+ *
+ * StatsType is the instrumentation policy, NoDispatchStats records nothing
+ * and costs nothing. See InstrumentedDispatchThread.
+ */
+template<typename QueueType, typename StatsType = NoDispatchStats>
+class BasicDispatchThread : public AShutdownable
+{
+public:
+  using Fn = typename QueueType::ValueType;
+
+  BasicDispatchThread() : BasicDispatchThread( DispatchThreadOptions() )
+  { }
+
+  /**
+   * Starts the thread with a name, cpu set, scheduling policy or stack size,
+   * see DispatchThreadOptions. Throws std::system_error if they cannot be
+   * applied.
+   */
+  explicit BasicDispatchThread( const DispatchThreadOptions& options ) : m_name( options.m_name )
   {
     // thread started in constructor member initialization
     // list appears to reference uninitailized variables
     // so wait until constructor body to start it up
-    m_spThread = make_shared<thread>( [this]() {
-      while( m_keepRunning ) {
-        auto fn = m_tsQueue.DeQueue();
-        fn();
-      }
-    });
+    m_spThread = make_shared<ConfiguredThread>( options, [this]() { Run(); } );
+    m_threadId = m_spThread->GetId();
   }
-  virtual ~DispatchThread()
+  virtual ~BasicDispatchThread()
   {
     Kill();
   }
+
+  /**
+   * Stops accepting new tasks. The tasks that are already queued still run,
+   * after which the thread exits. Timers that have not fired are dropped.
+   * Blocks until then unless called from the dispatch thread itself.
+   */
   void Kill()
   {
     if ( m_spThread ) {
-      PostToDispatch( [this]() { m_keepRunning = false; } );
-      if( this_thread::get_id() != m_spThread->get_id() ) {
-        m_spThread->join();
+      Close( eSHUTDOWN_MODE_DRAIN );
+      if( this_thread::get_id() != m_spThread->GetId() ) {
+        m_spThread->Join();
         m_spThread.reset();
       }
     }
   }
 
-  void PostToDispatch( std::function<void(void)> fn )
+  /**
+   * Drain mode shutdown, see Shutdown( mode ).
+   */
+  ShutdownFuture Shutdown() override
+  {
+    return Shutdown( eSHUTDOWN_MODE_DRAIN );
+  }
+
+  /**
+   * Stops accepting new tasks without blocking. In drain mode the queued
+   * tasks still run, in drop mode they are destroyed unrun, only the task
+   * that is running finishes. Timers that have not fired are dropped either
+   * way. A drain in progress can be cut short by calling Shutdown() again in
+   * drop mode, e.g. once its future missed a deadline.
+   * @return future that becomes ready once the thread has stopped running
+   *         tasks, the destructor or Kill() then no longer block on work
+   */
+  ShutdownFuture Shutdown( EShutdownMode mode )
+  {
+    Close( mode );
+    promise<EShutdownStatus> stopped;
+    ShutdownFuture retval = stopped.get_future();
+    lock_guard<mutex> lk( m_shutdownMtx );
+    if( m_stopped ) {
+      stopped.set_value( eSHUTDOWN_STATUS_SUCCESS );
+    } else {
+      m_shutdownPromises.push_back( std::move( stopped ) );
+    }
+    return retval;
+  }
+
+  /**
+   * @return number of queued tasks a drop mode shutdown destroyed unrun.
+   *         Posts rejected after shutdown are not counted, they returned
+   *         false to their caller.
+   */
+  size_t DroppedCount() const
+  {
+    return m_dropped.load( memory_order_acquire );
+  }
+
+  /**
+   * @return false if fn is empty or the thread has been killed
+   */
+  bool PostToDispatch( Fn fn )
   {
     if( fn ) {
-      m_tsQueue.EnQueue( fn );
+      return EnQueue( std::move( fn ) );
+    }
+    return false;
+  }
+
+  /**
+   * Posts fn along with the site it was posted from, e.g.
+   * thr.PostToDispatch( CPPUTILS_TASK_SITE, fn ), so DispatchWatchdog can
+   * name it. Only available when Fn carries a site, e.g.
+   * InstrumentedDispatchThread.
+   */
+  template<typename F>
+  bool PostToDispatch( const TaskSite& site, F&& fn )
+  {
+    return PostToDispatch( Fn( std::forward<F>( fn ), site ) );
+  }
+
+  /**
+   * Runs fn on the dispatch thread and hands its result back through a
+   * Future, see Future.h.
+   */
+  template<typename F>
+  Future<SubmitResult<F>> Submit( F&& fn )
+  {
+    return SubmitTo( *this, std::forward<F>( fn ) );
+  }
+
+  /**
+   * co_await Schedule() resumes a C++20 coroutine on the dispatch thread, see
+   * ScheduleAwaiter.h.
+   */
+  ScheduleAwaiter<BasicDispatchThread> Schedule()
+  {
+    return ScheduleAwaiter<BasicDispatchThread>( *this );
+  }
+
+  /**
+   * Runs fn on the dispatch thread and blocks until it returned. Called on
+   * the dispatch thread itself fn runs inline instead of deadlocking. The
+   * hand off uses a completion on the caller's stack, nothing is allocated
+   * besides the queue's own storage.
+   * @return false if the thread has been killed and fn did not run
+   */
+  template<typename F>
+  bool DispatchSync( F&& fn )
+  {
+    if( IsDispatchThread() ) {
+      fn();
+      return true;
+    }
+    SyncCompletion completion;
+    PostToDispatch( Fn( SyncTask<typename remove_reference<F>::type>( fn, completion ) ) );
+    unique_lock<mutex> lk( completion.m_mtx );
+    completion.m_cond.wait( lk, [&completion]() { return completion.m_done; } );
+    return completion.m_ran;
+  }
+
+  /**
+   * The instrumentation, e.g. Stats().Snapshot() with DispatchStats.
+   */
+  StatsType& Stats()
+  {
+    return m_stats;
+  }
+
+  /**
+   * @return the name from DispatchThreadOptions, empty by default
+   */
+  const string& Name() const
+  {
+    return m_name;
+  }
+
+  /**
+   * @return true if called from the dispatch thread
+   */
+  bool IsDispatchThread() const
+  {
+    return this_thread::get_id() == m_threadId;
+  }
+
+  /**
+   * Only available when QueueType takes a priority, e.g.
+   * PriorityDispatchThread. fn runs before every queued task of lower
+   * priority.
+   * @return false if fn is empty or the thread has been killed
+   */
+  bool PostToDispatch( Fn fn, size_t priority )
+  {
+    if( fn ) {
+      return EnQueue( std::move( fn ), priority );
+    }
+    return false;
+  }
+
+  /**
+   * Only available when QueueType is a ReactorQueue, i.e.
+   * ReactorDispatchThread. Runs fn( events ) on the dispatch thread whenever
+   * fd is ready, between the posted tasks, see ReactorQueue::WatchFd().
+   * @return token to stop watching, empty if fd could not be watched
+   */
+  template<typename F>
+  weak_ptr<ACancelableToken> WatchFd( int fd, uint32_t events, F&& fn )
+  {
+    return m_queue.WatchFd( fd, events, std::forward<F>( fn ) );
+  }
+
+  /**
+   * Posts a pre-allocated task. The task is linked into a lock free intrusive
+   * queue and the thread is only woken through the regular queue when no
+   * wake up is already pending, so steady state posting does not allocate.
+   * Ordering relative to tasks posted as Fn is not preserved.
+   * @return false if pTask is null or the thread has been killed, the task
+   * was not linked then. A task that was linked runs, or is dropped by a
+   * drop mode shutdown, before the thread exits.
+   */
+  bool PostToDispatch( DispatchTask* pTask )
+  {
+    if( !pTask ) {
+      return false;
+    }
+    // The thread closes m_dispatchTasksClosed and then waits for the posters
+    // that got past the check, so every task linked here is seen by its last
+    // drain
+    m_dispatchTaskPosters.fetch_add( 1 );
+    if( m_dispatchTasksClosed.load() || m_queue.IsClosed() ) {
+      m_dispatchTaskPosters.fetch_sub( 1, memory_order_release );
+      return false;
+    }
+    m_dispatchTasks.Push( pTask );
+    if( !m_dispatchTasksPending.exchange( true, memory_order_acq_rel ) ) {
+      // an empty Fn is the wake up call, PostToDispatch( Fn ) never queues
+      // one. Once the queue is closed the final drain rings instead
+      m_queue.EnQueue( Fn() );
+    }
+    m_dispatchTaskPosters.fetch_sub( 1, memory_order_release );
+    return true;
+  }
+  /**
+   * Runs fn on the dispatch thread once delay has passed. The thread keeps
+   * running other tasks in the meantime.
+   * @return token to cancel the timer, empty if fn is empty or the thread has
+   *         been killed. It expires once the timer has fired or been dropped.
+   */
+  template<typename Rep, typename Period>
+  weak_ptr<ACancelableToken> PostDelayed( const chrono::duration<Rep, Period>& delay, Fn fn )
+  {
+    return PostAt( chrono::steady_clock::now() + delay, std::move( fn ) );
+  }
+
+  /**
+   * Runs fn on the dispatch thread at deadline, or right away if it has
+   * passed already.
+   */
+  template<typename Duration>
+  weak_ptr<ACancelableToken> PostAt( const chrono::time_point<chrono::steady_clock, Duration>& deadline, Fn fn )
+  {
+    return AddTimer( chrono::time_point_cast<chrono::steady_clock::duration>( deadline ),
+                     chrono::steady_clock::duration::zero(),
+                     std::move( fn ) );
+  }
+
+  /**
+   * Runs fn every period, the first time one period from now, until the
+   * returned token is canceled or the thread is killed. Ticks missed while
+   * the thread was busy are skipped rather than run back to back.
+   */
+  template<typename Rep, typename Period>
+  weak_ptr<ACancelableToken> PostPeriodic( const chrono::duration<Rep, Period>& period, Fn fn )
+  {
+    auto tick = chrono::duration_cast<chrono::steady_clock::duration>( period );
+    if( tick <= chrono::steady_clock::duration::zero() ) {
+      return weak_ptr<ACancelableToken>();
     }
+    return AddTimer( chrono::steady_clock::now() + tick, tick, std::move( fn ) );
   }
+
 private:
-  shared_ptr<thread> m_spThread;
-  TsQueue<std::function<void(void)>> m_tsQueue;
-  bool m_keepRunning = true;
+  struct SyncCompletion
+  {
+    mutex m_mtx;
+    condition_variable m_cond;
+    bool m_done = false;
+    bool m_ran = false;
+  };
+
+  // Signals the waiting caller when it goes away, whether or not it ran
+  template<typename F>
+  class SyncTask
+  {
+  public:
+    SyncTask( F& fn, SyncCompletion& completion ) : m_pFn{ &fn }, m_pCompletion{ &completion }
+    { }
+
+    SyncTask( SyncTask&& other ) noexcept : m_pFn{ other.m_pFn }, m_pCompletion{ other.m_pCompletion }
+    {
+      other.m_pCompletion = nullptr;
+    }
+
+    ~SyncTask()
+    {
+      if( m_pCompletion ) {
+        // Notify with the lock held, the completion dies as soon as the
+        // caller sees m_done
+        lock_guard<mutex> lk( m_pCompletion->m_mtx );
+        m_pCompletion->m_done = true;
+        m_pCompletion->m_cond.notify_one();
+      }
+    }
+
+    void operator()()
+    {
+      ( *m_pFn )();
+      m_pCompletion->m_ran = true;
+    }
+
+  private:
+    F* m_pFn;
+    SyncCompletion* m_pCompletion;
+  };
+
+  // Hands a timer to the dispatch thread, the only one touching m_timers
+  struct AddTimerTask
+  {
+    DispatchTimers<Fn>* m_pTimers;
+    chrono::steady_clock::time_point m_deadline;
+    chrono::steady_clock::duration m_period;
+    Fn m_fn;
+    shared_ptr<DispatchTimerToken> m_spToken;
+
+    void operator()()
+    {
+      m_pTimers->Add( m_deadline, m_period, std::move( m_fn ), std::move( m_spToken ) );
+    }
+  };
+
+  // Counts every non empty task that enters the queue
+  template<typename... Args>
+  bool EnQueue( Fn&& fn, Args... args )
+  {
+    m_stats.OnPost();
+    if( m_queue.EnQueue( std::move( fn ), args... ) ) {
+      return true;
+    }
+    m_stats.OnRejected();
+    return false;
+  }
+
+  void Close( EShutdownMode mode )
+  {
+    if( mode == eSHUTDOWN_MODE_DROP ) {
+      m_dropping.store( true, memory_order_release );
+    }
+    m_queue.Close();
+  }
+
+  weak_ptr<ACancelableToken> AddTimer( chrono::steady_clock::time_point deadline,
+                                       chrono::steady_clock::duration period,
+                                       Fn fn )
+  {
+    weak_ptr<ACancelableToken> retval;
+    if( fn ) {
+      auto spToken = make_shared<DispatchTimerToken>();
+      AddTimerTask task{ &m_timers, deadline, period, std::move( fn ), spToken };
+      if( EnQueue( Fn( std::move( task ) ) ) ) {
+        retval = spToken;
+      }
+    }
+    return retval;
+  }
+
+  void Run()
+  {
+    Fn fn;
+    for( ;; ) {
+      bool dequeued = m_timers.Empty() ? m_queue.DeQueue( fn ) : m_queue.DeQueueUntil( fn, m_timers.NextDeadline() );
+      bool dropping = m_dropping.load( memory_order_acquire );
+      if( dequeued ) {
+        if( !fn ) {
+          RunDispatchTasks( dropping );
+        } else if( dropping ) {
+          m_stats.OnDropped();
+          m_dropped.fetch_add( 1, memory_order_release );
+        } else {
+          auto stamp = m_stats.OnDequeue( fn );
+          fn();
+          m_stats.OnRun( stamp );
+        }
+        fn = Fn();
+      } else if( m_queue.IsClosed() ) {
+        break;
+      }
+      if( !dropping && !m_timers.Empty() ) {
+        m_timers.RunExpired( chrono::steady_clock::now() );
+      }
+    }
+    m_dispatchTasksClosed.store( true );
+    while( m_dispatchTaskPosters.load() ) {
+      this_thread::yield();
+    }
+    RunDispatchTasks( m_dropping.load( memory_order_acquire ) );
+    SignalStopped();
+  }
+
+  void SignalStopped()
+  {
+    lock_guard<mutex> lk( m_shutdownMtx );
+    m_stopped = true;
+    for( auto& stopped : m_shutdownPromises ) {
+      stopped.set_value( eSHUTDOWN_STATUS_SUCCESS );
+    }
+    m_shutdownPromises.clear();
+  }
+
+  void RunDispatchTasks( bool dropping )
+  {
+    // Clear first, a task that lands after the drain rings again
+    m_dispatchTasksPending.exchange( false, memory_order_acq_rel );
+    while( DispatchTask* pTask = m_dispatchTasks.Pop() ) {
+      if( dropping ) {
+        m_dropped.fetch_add( 1, memory_order_release );
+      } else {
+        pTask->Run();
+      }
+    }
+  }
+
+  string m_name;
+  shared_ptr<ConfiguredThread> m_spThread;
+  thread::id m_threadId;
+  QueueType m_queue;
+  IntrusiveMpscQueue<DispatchTask> m_dispatchTasks;
+  // Dispatch thread only
+  DispatchTimers<Fn> m_timers;
+  atomic<bool> m_dispatchTasksPending{ false };
+  atomic<bool> m_dispatchTasksClosed{ false };
+  atomic<size_t> m_dispatchTaskPosters{ 0 };
+  StatsType m_stats;
+  atomic<bool> m_dropping{ false };
+  atomic<size_t> m_dropped{ 0 };
+  // Guards the futures handed out by Shutdown()
+  mutex m_shutdownMtx;
+  bool m_stopped = false;
+  vector<promise<EShutdownStatus>> m_shutdownPromises;
 };
 
+/**
+ * The general purpose dispatch thread, any number of threads may post to it.
+ */
+using DispatchThread = BasicDispatchThread<TsQueue<DispatchFn>>;
+
+/**
+ * Dispatch thread for single producer pipelines. Exactly one thread may queue
+ * work on it, whichever member it uses: PostToDispatch(), PostDelayed(),
+ * PostAt(), PostPeriodic(), Submit(), DispatchSync() from another thread and
+ * posting a DispatchTask all push into the same ring.
+ */
+using SpscDispatchThread = BasicDispatchThread<SpscQueue<DispatchFn>>;
+
+/**
+ * Dispatch thread for bursty workloads, its queue recycles memory instead of
+ * allocating and freeing as the backlog grows and shrinks.
+ */
+using SegmentedDispatchThread = BasicDispatchThread<SegmentedQueue<DispatchFn>>;
+
+
+/**
+ * Dispatch thread with priority bands, see PriorityTsQueue. Control messages
+ * posted with PostToDispatch( fn, priority ) overtake the bulk work that was
+ * posted at the default priority 0.
+ */
+using PriorityDispatchThread = BasicDispatchThread<PriorityTsQueue<DispatchFn>>;
+
+#if defined( __linux__ )
+/**
+ * Dispatch thread that is also an epoll event loop: WatchFd() callbacks and
+ * posted tasks run on the same thread, with no hand off between an I/O
+ * thread and the logic thread. Linux only.
+ */
+using ReactorDispatchThread = BasicDispatchThread<ReactorQueue<DispatchFn>>;
+#endif
+
+/**
+ * DispatchThread with DispatchStats: queue wait and run time histograms,
+ * queue depth and tasks per second, read with Stats().Snapshot().
+ */
+using InstrumentedDispatchThread = BasicDispatchThread<TsQueue<TimedTask<DispatchFn>>, DispatchStats>;
+
 }
 
 #endif // __DISPATH_THREAD_H__
@@ -0,0 +1,234 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __DISPATCH_THREAD_OPTIONS_H__
+#define __DISPATCH_THREAD_OPTIONS_H__
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined( __unix__ ) || defined( __APPLE__ )
+#define CPPUTILS_HAS_PTHREAD 1
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace CppUtils {
+
+enum ESchedPolicy {
+  eSCHED_POLICY_DEFAULT = 0,
+  eSCHED_POLICY_FIFO = 1,
+  eSCHED_POLICY_RR = 2,
+};
+
+/**
+ * How a dispatch thread, or every worker of a pool, is started. The defaults
+ * give a plain std::thread equivalent. Options the platform does not support
+ * are ignored: everything but the name needs pthreads, the cpu set Linux.
+ */
+struct DispatchThreadOptions
+{
+  // Shown by top, perf and gdb, Linux keeps the first 15 characters. Pool
+  // workers get "-<index>" appended.
+  std::string m_name;
+  // CPUs the thread may run on, empty for all of them
+  std::vector<int> m_cpus;
+  // Real time policies usually need CAP_SYS_NICE or root
+  ESchedPolicy m_schedPolicy = eSCHED_POLICY_DEFAULT;
+  // Priority for the real time policies, 1 to 99 on Linux
+  int m_schedPriority = 0;
+  // In bytes, 0 for the platform default
+  size_t m_stackSize = 0;
+};
+
+/**
+ * ConfiguredThread - a joinable thread started with DispatchThreadOptions.
+ *
+ * Stack size, cpu set and scheduling are thread attributes, applied before
+ * the thread runs any code; the name is set first thing on the thread.
+ * Throws std::system_error if the thread cannot be created with the
+ * options, e.g. EPERM for a real time policy without the privilege or
+ * EINVAL for a stack below PTHREAD_STACK_MIN.
+ */
+class ConfiguredThread
+{
+public:
+  ConfiguredThread( const DispatchThreadOptions& options, std::function<void()> body )
+  {
+#if defined( CPPUTILS_HAS_PTHREAD )
+    Start start( options.m_name, std::move( body ) );
+    pthread_attr_t attr;
+    pthread_attr_init( &attr );
+    int err = ApplyOptions( options, attr );
+    if( !err ) {
+      err = pthread_create( &m_handle, &attr, &Entry, &start );
+    }
+    pthread_attr_destroy( &attr );
+    if( err ) {
+      throw std::system_error( err, std::generic_category(), "ConfiguredThread" );
+    }
+    m_joinable = true;
+    std::unique_lock<std::mutex> lk( start.m_mtx );
+    start.m_cond.wait( lk, [&start]() { return start.m_started; } );
+    m_id = start.m_id;
+#else
+    m_thread = std::thread( std::move( body ) );
+    m_id = m_thread.get_id();
+#endif
+  }
+
+  ~ConfiguredThread()
+  {
+#if defined( CPPUTILS_HAS_PTHREAD )
+    if( m_joinable ) {
+      pthread_detach( m_handle );
+    }
+#else
+    if( m_thread.joinable() ) {
+      m_thread.detach();
+    }
+#endif
+  }
+
+  ConfiguredThread( const ConfiguredThread& ) = delete;
+  ConfiguredThread& operator=( const ConfiguredThread& ) = delete;
+
+  std::thread::id GetId() const
+  {
+    return m_id;
+  }
+
+  void Join()
+  {
+#if defined( CPPUTILS_HAS_PTHREAD )
+    if( m_joinable ) {
+      pthread_join( m_handle, nullptr );
+      m_joinable = false;
+    }
+#else
+    if( m_thread.joinable() ) {
+      m_thread.join();
+    }
+#endif
+  }
+
+private:
+#if defined( CPPUTILS_HAS_PTHREAD )
+  // Lives on the creating thread's stack until the new thread has started
+  struct Start
+  {
+    Start( const std::string& name, std::function<void()> body ) : m_name( name ), m_body( std::move( body ) )
+    { }
+
+    std::string m_name;
+    std::function<void()> m_body;
+    std::mutex m_mtx;
+    std::condition_variable m_cond;
+    bool m_started = false;
+    std::thread::id m_id;
+  };
+
+  static int ApplyOptions( const DispatchThreadOptions& options, pthread_attr_t& attr )
+  {
+    int err = 0;
+    if( options.m_stackSize ) {
+      err = pthread_attr_setstacksize( &attr, options.m_stackSize );
+    }
+#if defined( __linux__ )
+    if( !err && !options.m_cpus.empty() ) {
+      cpu_set_t cpus;
+      CPU_ZERO( &cpus );
+      for( int cpu : options.m_cpus ) {
+        if( cpu < 0 || cpu >= CPU_SETSIZE ) {
+          return EINVAL;
+        }
+        CPU_SET( cpu, &cpus );
+      }
+      err = pthread_attr_setaffinity_np( &attr, sizeof( cpus ), &cpus );
+    }
+#endif
+    if( !err && options.m_schedPolicy != eSCHED_POLICY_DEFAULT ) {
+      sched_param param = sched_param();
+      param.sched_priority = options.m_schedPriority;
+      err = pthread_attr_setinheritsched( &attr, PTHREAD_EXPLICIT_SCHED );
+      if( !err ) {
+        err = pthread_attr_setschedpolicy( &attr, options.m_schedPolicy == eSCHED_POLICY_FIFO ? SCHED_FIFO : SCHED_RR );
+      }
+      if( !err ) {
+        err = pthread_attr_setschedparam( &attr, &param );
+      }
+    }
+    return err;
+  }
+
+  static void* Entry( void* pArg )
+  {
+    Start& start = *static_cast<Start*>( pArg );
+    std::function<void()> body = std::move( start.m_body );
+    SetName( start.m_name );
+    {
+      // Notify with the lock held, start dies as soon as the creator wakes
+      std::lock_guard<std::mutex> lk( start.m_mtx );
+      start.m_id = std::this_thread::get_id();
+      start.m_started = true;
+      start.m_cond.notify_one();
+    }
+    try {
+      body();
+    } catch( ... ) {
+      // Same as an exception escaping a std::thread
+      std::terminate();
+    }
+    return nullptr;
+  }
+
+  static void SetName( const std::string& name )
+  {
+    if( name.empty() ) {
+      return;
+    }
+#if defined( __linux__ )
+    pthread_setname_np( pthread_self(), name.substr( 0, 15 ).c_str() );
+#elif defined( __APPLE__ )
+    pthread_setname_np( name.c_str() );
+#endif
+  }
+
+  pthread_t m_handle;
+  bool m_joinable = false;
+#else
+  std::thread m_thread;
+#endif
+  std::thread::id m_id;
+};
+
+}
+
+#endif // __DISPATCH_THREAD_OPTIONS_H__
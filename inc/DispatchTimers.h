@@ -0,0 +1,162 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __DISPATCH_TIMERS_H__
+#define __DISPATCH_TIMERS_H__
+
+#include <ACancelable.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace CppUtils {
+
+/**
+ * Handed out for every timer. Cancel() may be called from any thread; a timer
+ * that is already running finishes but is not rescheduled.
+ */
+class DispatchTimerToken : public ACancelableToken
+{
+public:
+  DispatchTimerToken() : m_canceled{ false }
+  { }
+
+  virtual ~DispatchTimerToken()
+  { }
+
+  virtual void Cancel()
+  {
+    m_canceled.store( true, std::memory_order_release );
+  }
+
+  bool IsCanceled() const
+  {
+    return m_canceled.load( std::memory_order_acquire );
+  }
+
+private:
+  std::atomic<bool> m_canceled;
+};
+
+/**
+ * DispatchTimers - min-heap of deadlines owned by a single (dispatch) thread.
+ *
+ * Not thread safe, other threads hand their timers to the owner through its
+ * task queue. The owner sleeps until NextDeadline() and then calls
+ * RunExpired(). Canceled timers are dropped lazily when they come due.
+ *
+ * @tparam Fn - Callable as void(void), invoked every time a timer fires
+ */
+template<typename Fn>
+class DispatchTimers
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  DispatchTimers() : m_seq{ 0 }
+  { }
+
+  /**
+   * @param period - zero for a one shot timer
+   */
+  void Add( Clock::time_point deadline, Clock::duration period, Fn fn, std::shared_ptr<DispatchTimerToken> spToken )
+  {
+    Timer timer;
+    timer.m_deadline = deadline;
+    timer.m_period = period;
+    timer.m_fn = std::move( fn );
+    timer.m_spToken = std::move( spToken );
+    Push( std::move( timer ) );
+  }
+
+  bool Empty() const { return m_heap.empty(); }
+
+  size_t Size() const { return m_heap.size(); }
+
+  /**
+   * Expects !Empty()
+   */
+  Clock::time_point NextDeadline() const { return m_heap.front().m_deadline; }
+
+  /**
+   * Runs every timer that is due at now, in deadline order. Periodic timers
+   * are rescheduled one period after their deadline, or one period from now
+   * if they fell that far behind, so a stalled thread does not cause a burst.
+   */
+  void RunExpired( Clock::time_point now )
+  {
+    while( !m_heap.empty() && m_heap.front().m_deadline <= now ) {
+      std::pop_heap( m_heap.begin(), m_heap.end(), Later() );
+      Timer timer = std::move( m_heap.back() );
+      m_heap.pop_back();
+      if( timer.m_spToken->IsCanceled() ) {
+        continue;
+      }
+      timer.m_fn();
+      if( timer.m_period > Clock::duration::zero() && !timer.m_spToken->IsCanceled() ) {
+        timer.m_deadline += timer.m_period;
+        if( timer.m_deadline <= now ) {
+          timer.m_deadline = now + timer.m_period;
+        }
+        Push( std::move( timer ) );
+      }
+    }
+  }
+
+private:
+  struct Timer
+  {
+    Clock::time_point m_deadline;
+    Clock::duration m_period;
+    uint64_t m_seq;
+    Fn m_fn;
+    std::shared_ptr<DispatchTimerToken> m_spToken;
+  };
+
+  // Heap order, the sequence number keeps timers with equal deadlines FIFO
+  struct Later
+  {
+    bool operator()( const Timer& lhs, const Timer& rhs ) const
+    {
+      return lhs.m_deadline != rhs.m_deadline ? lhs.m_deadline > rhs.m_deadline : lhs.m_seq > rhs.m_seq;
+    }
+  };
+
+  void Push( Timer&& timer )
+  {
+    timer.m_seq = m_seq++;
+    m_heap.push_back( std::move( timer ) );
+    std::push_heap( m_heap.begin(), m_heap.end(), Later() );
+  }
+
+  std::vector<Timer> m_heap;
+  uint64_t m_seq;
+};
+
+}
+
+#endif // __DISPATCH_TIMERS_H__
@@ -0,0 +1,145 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __DISPATCH_WATCHDOG_H__
+#define __DISPATCH_WATCHDOG_H__
+
+#include <DispatchThread.h>
+#include <DispatchStats.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace CppUtils {
+
+/**
+ * Handed to the watchdog's callback for every task that overran.
+ */
+struct DispatchWatchdogReport
+{
+  string m_threadName;
+  // m_pFile is null if the task was posted without CPPUTILS_TASK_SITE
+  TaskSite m_site;
+  chrono::steady_clock::duration m_runningFor;
+};
+
+/**
+ * DispatchWatchdog - finds tasks that hog a dispatch thread.
+ *
+ * Every interval the watchdog samples what each watched thread is running
+ * and calls back once per task that has been running longer than threshold,
+ * while it is still running. Watched threads publish their current task
+ * through DispatchStats, i.e. they are InstrumentedDispatchThreads; post with
+ * PostToDispatch( CPPUTILS_TASK_SITE, fn ) for reports to say where a task
+ * came from.
+ *
+ * Sampling and the callback happen on the watchdog's own dispatch thread. A
+ * watched thread must be unwatched before it is destroyed.
+ */
+class DispatchWatchdog
+{
+public:
+  using Callback = function<void( const DispatchWatchdogReport& )>;
+
+  DispatchWatchdog( chrono::steady_clock::duration threshold,
+                    Callback callback,
+                    chrono::steady_clock::duration interval = chrono::milliseconds( 10 ) )
+    : m_threshold( threshold ), m_callback( std::move( callback ) )
+  {
+    m_thread.PostPeriodic( interval, [this]() { Sample(); } );
+  }
+
+  ~DispatchWatchdog()
+  {
+    m_thread.Kill();
+  }
+
+  /**
+   * Reports overruns on thr under its DispatchThreadOptions name.
+   */
+  template<typename DispatchThreadType>
+  void Watch( DispatchThreadType& thr )
+  {
+    Watch( thr, thr.Name() );
+  }
+
+  template<typename DispatchThreadType>
+  void Watch( DispatchThreadType& thr, string name )
+  {
+    const DispatchTaskProbe* pProbe = &thr.Stats().Probe();
+    m_thread.DispatchSync( [this, pProbe, &name]() {
+      m_watched.push_back( Watched{ pProbe, std::move( name ), 0 } );
+    } );
+  }
+
+  /**
+   * Stops sampling thr. Once this returns thr may be destroyed.
+   */
+  template<typename DispatchThreadType>
+  void Unwatch( DispatchThreadType& thr )
+  {
+    const DispatchTaskProbe* pProbe = &thr.Stats().Probe();
+    m_thread.DispatchSync( [this, pProbe]() {
+      m_watched.erase( remove_if( m_watched.begin(), m_watched.end(),
+                                  [pProbe]( const Watched& watched ) { return watched.m_pProbe == pProbe; } ),
+                       m_watched.end() );
+    } );
+  }
+
+private:
+  struct Watched
+  {
+    const DispatchTaskProbe* m_pProbe;
+    string m_name;
+    // The task last reported, so an overrun is reported once
+    uint64_t m_reported;
+  };
+
+  void Sample()
+  {
+    auto now = chrono::steady_clock::now();
+    DispatchTaskProbe::Sample sample;
+    for( auto& watched : m_watched ) {
+      if( !watched.m_pProbe->Read( sample ) || sample.m_task == watched.m_reported ) {
+        continue;
+      }
+      auto runningFor = now - sample.m_startedAt;
+      if( runningFor >= m_threshold ) {
+        watched.m_reported = sample.m_task;
+        m_callback( DispatchWatchdogReport{ watched.m_name, sample.m_site, runningFor } );
+      }
+    }
+  }
+
+  chrono::steady_clock::duration m_threshold;
+  Callback m_callback;
+  // Watchdog thread only
+  vector<Watched> m_watched;
+  DispatchThread m_thread;
+};
+
+}
+
+#endif // __DISPATCH_WATCHDOG_H__
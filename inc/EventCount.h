@@ -0,0 +1,147 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __EVENT_COUNT_H__
+#define __EVENT_COUNT_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace CppUtils {
+
+/**
+ * EventCount - lets threads park on an arbitrary lock-free condition.
+ *
+ * Notifiers only touch the mutex when somebody is actually parked, so the
+ * uncontended fast path of a lock-free producer is a fence and a load.
+ * The predicate passed to Wait() is evaluated without any lock held and may
+ * have side effects (typically a TryDeQueue()). It must return true exactly
+ * when the waiter is done.
+ */
+class EventCount
+{
+public:
+  EventCount() : m_waiters{ 0 }, m_epoch{ 0 }
+  { }
+
+  EventCount( const EventCount& ) = delete;
+  EventCount& operator=( const EventCount& ) = delete;
+
+  void NotifyOne()
+  {
+    if( Advance() ) {
+      m_cond.notify_one();
+    }
+  }
+
+  void NotifyAll()
+  {
+    if( Advance() ) {
+      m_cond.notify_all();
+    }
+  }
+
+  template<typename Pred>
+  void Wait( Pred ready )
+  {
+    while( !ready() ) {
+      unsigned key = PrepareWait();
+      if( ready() ) {
+        CancelWait();
+        return;
+      }
+      std::unique_lock<std::mutex> lk( m_mtx );
+      while( m_epoch.load( std::memory_order_relaxed ) == key ) {
+        m_cond.wait( lk );
+      }
+      lk.unlock();
+      CancelWait();
+    }
+  }
+
+  /**
+   * Waits until ready() returns true or the deadline passes.
+   * @return the last value returned by ready()
+   */
+  template<typename Pred, typename Clock, typename Duration>
+  bool WaitUntil( Pred ready, const std::chrono::time_point<Clock, Duration>& deadline )
+  {
+    while( !ready() ) {
+      unsigned key = PrepareWait();
+      if( ready() ) {
+        CancelWait();
+        return true;
+      }
+      bool timedOut = false;
+      std::unique_lock<std::mutex> lk( m_mtx );
+      while( !timedOut && m_epoch.load( std::memory_order_relaxed ) == key ) {
+        timedOut = ( m_cond.wait_until( lk, deadline ) == std::cv_status::timeout );
+      }
+      lk.unlock();
+      CancelWait();
+      if( timedOut ) {
+        return ready();
+      }
+    }
+    return true;
+  }
+
+private:
+  unsigned PrepareWait()
+  {
+    m_waiters.fetch_add( 1, std::memory_order_relaxed );
+    // Pairs with the fence in Advance(): either the notifier sees us
+    // registered or our second look at the predicate sees its update.
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    return m_epoch.load( std::memory_order_relaxed );
+  }
+
+  void CancelWait()
+  {
+    m_waiters.fetch_sub( 1, std::memory_order_relaxed );
+  }
+
+  bool Advance()
+  {
+    std::atomic_thread_fence( std::memory_order_seq_cst );
+    if( m_waiters.load( std::memory_order_relaxed ) == 0 ) {
+      return false;
+    }
+    // Bumping the epoch under the mutex guarantees a waiter either sees the
+    // new epoch before sleeping or is already blocked in wait().
+    std::lock_guard<std::mutex> lk( m_mtx );
+    m_epoch.fetch_add( 1, std::memory_order_relaxed );
+    return true;
+  }
+
+  std::atomic<unsigned> m_waiters;
+  std::atomic<unsigned> m_epoch;
+  std::mutex m_mtx;
+  std::condition_variable m_cond;
+};
+
+}
+
+#endif // __EVENT_COUNT_H__
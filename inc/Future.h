@@ -0,0 +1,583 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __FUTURE_H__
+#define __FUTURE_H__
+
+#include <EventCount.h>
+#include <Task.h>
+#include <atomic>
+#include <exception>
+#include <future>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace CppUtils {
+
+template<typename T> class Future;
+template<typename T> class Promise;
+
+// Stands in for the value of a Future<void>
+struct FutureUnit
+{ };
+
+template<typename T>
+struct FutureTraits
+{
+  using Stored = T;
+
+  static T Take( Stored& value ) { return std::move( value ); }
+
+  template<typename F>
+  static auto Call( F& fn, Stored& value ) -> decltype( fn( std::move( value ) ) )
+  {
+    return fn( std::move( value ) );
+  }
+};
+
+template<>
+struct FutureTraits<void>
+{
+  using Stored = FutureUnit;
+
+  static void Take( Stored& ) { }
+
+  template<typename F>
+  static auto Call( F& fn, Stored& ) -> decltype( fn() )
+  {
+    return fn();
+  }
+};
+
+/**
+ * What Future<T>::Then( executor, fn ) returns a future of.
+ */
+template<typename T, typename F>
+using ThenResult = decltype( FutureTraits<T>::Call( std::declval<typename std::decay<F>::type&>(),
+                                                    std::declval<typename FutureTraits<T>::Stored&>() ) );
+
+/**
+ * What Submit( fn ) returns a future of.
+ */
+template<typename F>
+using SubmitResult = decltype( std::declval<typename std::decay<F>::type&>()() );
+
+/**
+ * FutureState - the state a Promise and its Future share.
+ *
+ * States are recycled through a free list owned by the thread that acquired
+ * them. The last Release() usually happens on another thread, which hands
+ * the state back to its owner through a lock-free stack, so a Submit()
+ * round trip does not allocate in steady state. The value and the
+ * continuation race to be set first through one atomic word: whichever
+ * comes second runs the continuation.
+ */
+template<typename T>
+class FutureState
+{
+public:
+  using Stored = typename FutureTraits<T>::Stored;
+
+  static FutureState* Acquire()
+  {
+    FreeList& freeList = Cache();
+    if( !freeList.m_pOwner ) {
+      freeList.m_pOwner = new Owner;
+    }
+    Owner* pOwner = freeList.m_pOwner;
+    if( !pOwner->m_pLocal ) {
+      pOwner->m_pLocal = pOwner->m_pReturned.exchange( nullptr, std::memory_order_acquire );
+    }
+    FutureState* pState = pOwner->m_pLocal;
+    if( pState ) {
+      pOwner->m_pLocal = pState->m_pNext;
+    } else {
+      pState = new FutureState;
+    }
+    pState->m_pOwner = pOwner;
+    pOwner->m_refs.fetch_add( 1, std::memory_order_relaxed );
+    pState->m_refs.store( 1, std::memory_order_relaxed );
+    pState->m_flags.store( 0, std::memory_order_relaxed );
+    return pState;
+  }
+
+  void AddRef()
+  {
+    m_refs.fetch_add( 1, std::memory_order_relaxed );
+  }
+
+  void Release()
+  {
+    if( m_refs.fetch_sub( 1, std::memory_order_acq_rel ) != 1 ) {
+      return;
+    }
+    if( m_flags.load( std::memory_order_relaxed ) & kHasValue ) {
+      Value().~Stored();
+    }
+    m_error = nullptr;
+    m_then = nullptr;
+    Owner* pOwner = m_pOwner;
+    if( pOwner == Cache().m_pOwner ) {
+      // The owner holds a reference of its own while it is alive
+      m_pNext = pOwner->m_pLocal;
+      pOwner->m_pLocal = this;
+      pOwner->m_refs.fetch_sub( 1, std::memory_order_relaxed );
+      return;
+    }
+    FutureState* pHead = pOwner->m_pReturned.load( std::memory_order_relaxed );
+    do {
+      m_pNext = pHead;
+    } while( !pOwner->m_pReturned.compare_exchange_weak( pHead, this, std::memory_order_release,
+                                                         std::memory_order_relaxed ) );
+    if( pOwner->m_refs.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+      DeleteOwner( pOwner );
+    }
+  }
+
+  template<typename... Args>
+  void SetValue( Args&&... args )
+  {
+    new ( &m_storage ) Stored( std::forward<Args>( args )... );
+    Complete( kHasValue );
+  }
+
+  void SetException( std::exception_ptr error )
+  {
+    m_error = std::move( error );
+    Complete( 0 );
+  }
+
+  /**
+   * then runs on the thread that completes the state, or right here if it is
+   * complete already.
+   */
+  void SetContinuation( Task then )
+  {
+    m_then = std::move( then );
+    if( m_flags.fetch_or( kHasContinuation, std::memory_order_acq_rel ) & kReady ) {
+      RunContinuation();
+    }
+  }
+
+  bool IsReady() const
+  {
+    return ( m_flags.load( std::memory_order_acquire ) & kReady ) != 0;
+  }
+
+  void Wait()
+  {
+    m_readyEvent.Wait( [this]() { return IsReady(); } );
+  }
+
+  // Expects IsReady()
+  T Take()
+  {
+    if( m_error ) {
+      std::rethrow_exception( m_error );
+    }
+    return FutureTraits<T>::Take( Value() );
+  }
+
+  // Expects IsReady()
+  std::exception_ptr Error() const { return m_error; }
+  Stored& Value() { return *reinterpret_cast<Stored*>( &m_storage ); }
+
+private:
+  static const unsigned kReady = 1;
+  static const unsigned kHasValue = 2;
+  static const unsigned kHasContinuation = 4;
+
+  // The free list of one thread. Only the owning thread touches m_pLocal,
+  // other threads push onto m_pReturned and the owner takes it all at once,
+  // which keeps the stack free of ABA. m_refs counts the owning thread and
+  // the states it handed out that have not come back yet, whoever drops the
+  // last one frees the lot.
+  struct Owner
+  {
+    FutureState* m_pLocal = nullptr;
+    std::atomic<FutureState*> m_pReturned{ nullptr };
+    std::atomic<size_t> m_refs{ 1 };
+  };
+
+  struct FreeList
+  {
+    ~FreeList()
+    {
+      if( !m_pOwner ) {
+        return;
+      }
+      DeleteList( m_pOwner->m_pLocal );
+      m_pOwner->m_pLocal = nullptr;
+      if( m_pOwner->m_refs.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+        DeleteOwner( m_pOwner );
+      }
+    }
+
+    Owner* m_pOwner = nullptr;
+  };
+
+  static FreeList& Cache()
+  {
+    static thread_local FreeList freeList;
+    return freeList;
+  }
+
+  static void DeleteList( FutureState* pState )
+  {
+    while( pState ) {
+      FutureState* pNext = pState->m_pNext;
+      delete pState;
+      pState = pNext;
+    }
+  }
+
+  static void DeleteOwner( Owner* pOwner )
+  {
+    DeleteList( pOwner->m_pReturned.exchange( nullptr, std::memory_order_acquire ) );
+    delete pOwner;
+  }
+
+  void Complete( unsigned flags )
+  {
+    unsigned prev = m_flags.fetch_or( kReady | flags, std::memory_order_acq_rel );
+    m_readyEvent.NotifyAll();
+    if( prev & kHasContinuation ) {
+      RunContinuation();
+    }
+  }
+
+  void RunContinuation()
+  {
+    Task then = std::move( m_then );
+    then();
+  }
+
+  std::atomic<unsigned> m_refs;
+  std::atomic<unsigned> m_flags;
+  typename std::aligned_storage<sizeof( Stored ), alignof( Stored )>::type m_storage;
+  std::exception_ptr m_error;
+  Task m_then;
+  EventCount m_readyEvent;
+  Owner* m_pOwner = nullptr;
+  FutureState* m_pNext = nullptr;
+};
+
+/**
+ * Promise - the producing end of a Future. Destroying a promise that was
+ * never satisfied hands its future a future_error( broken_promise ).
+ */
+template<typename T>
+class Promise
+{
+public:
+  Promise() : m_pState{ FutureState<T>::Acquire() }, m_futureTaken{ false }
+  { }
+
+  Promise( Promise&& other ) noexcept : m_pState{ other.m_pState }, m_futureTaken{ other.m_futureTaken }
+  {
+    other.m_pState = nullptr;
+  }
+
+  Promise& operator=( Promise&& other ) noexcept
+  {
+    if( this != &other ) {
+      Abandon();
+      m_pState = other.m_pState;
+      m_futureTaken = other.m_futureTaken;
+      other.m_pState = nullptr;
+    }
+    return *this;
+  }
+
+  Promise( const Promise& ) = delete;
+  Promise& operator=( const Promise& ) = delete;
+
+  ~Promise()
+  {
+    Abandon();
+  }
+
+  /**
+   * May be called once
+   */
+  Future<T> GetFuture()
+  {
+    m_futureTaken = true;
+    m_pState->AddRef();
+    return Future<T>( m_pState );
+  }
+
+  template<typename... Args>
+  void SetValue( Args&&... args )
+  {
+    FutureState<T>* pState = Detach();
+    pState->SetValue( std::forward<Args>( args )... );
+    pState->Release();
+  }
+
+  void SetException( std::exception_ptr error )
+  {
+    FutureState<T>* pState = Detach();
+    pState->SetException( std::move( error ) );
+    pState->Release();
+  }
+
+private:
+  FutureState<T>* Detach()
+  {
+    FutureState<T>* pState = m_pState;
+    m_pState = nullptr;
+    return pState;
+  }
+
+  void Abandon()
+  {
+    if( m_pState ) {
+      if( m_futureTaken ) {
+        SetException( std::make_exception_ptr( std::future_error( std::future_errc::broken_promise ) ) );
+      } else {
+        Detach()->Release();
+      }
+    }
+  }
+
+  FutureState<T>* m_pState;
+  bool m_futureTaken;
+};
+
+/**
+ * Fulfils promise with the result of fn(), or the exception it threw.
+ */
+template<typename R>
+struct FutureFulfil
+{
+  template<typename F>
+  static void Run( Promise<R>& promise, F&& fn )
+  {
+    try {
+      promise.SetValue( fn() );
+    } catch( ... ) {
+      promise.SetException( std::current_exception() );
+    }
+  }
+};
+
+template<>
+struct FutureFulfil<void>
+{
+  template<typename F>
+  static void Run( Promise<void>& promise, F&& fn )
+  {
+    try {
+      fn();
+      promise.SetValue();
+    } catch( ... ) {
+      promise.SetException( std::current_exception() );
+    }
+  }
+};
+
+/**
+ * Future - the consuming end of a Promise.
+ *
+ * Move-only. Either block on Get(), or chain a continuation with Then(),
+ * which hands the value to fn on an executor once it is there and returns
+ * the future of fn's result. Exceptions skip the continuations and surface
+ * at the end of the chain.
+ */
+template<typename T>
+class Future
+{
+public:
+  Future() : m_pState{ nullptr }
+  { }
+
+  Future( Future&& other ) noexcept : m_pState{ other.m_pState }
+  {
+    other.m_pState = nullptr;
+  }
+
+  Future& operator=( Future&& other ) noexcept
+  {
+    if( this != &other ) {
+      Reset();
+      m_pState = other.m_pState;
+      other.m_pState = nullptr;
+    }
+    return *this;
+  }
+
+  Future( const Future& ) = delete;
+  Future& operator=( const Future& ) = delete;
+
+  ~Future()
+  {
+    Reset();
+  }
+
+  /**
+   * @return false once Get() or Then() consumed the future
+   */
+  bool Valid() const { return m_pState != nullptr; }
+
+  bool IsReady() const { return m_pState && m_pState->IsReady(); }
+
+  void Wait() const { m_pState->Wait(); }
+
+  /**
+   * Blocks until the value is there and moves it out, rethrows the exception
+   * instead if there is one. Invalidates the future.
+   */
+  T Get()
+  {
+    m_pState->Wait();
+    StateRef state( m_pState );
+    m_pState = nullptr;
+    return state->Take();
+  }
+
+  /**
+   * Runs fn( value ) - fn() for Future<void> - on executor once the value is
+   * there. Invalidates this future.
+   *
+   * @param executor - Anything with PostToDispatch( Task ), must outlive the
+   *                   chain. If it rejects the task the returned future
+   *                   gets a future_error( broken_promise ).
+   * @return future of what fn returns
+   */
+  template<typename Executor, typename F>
+  Future<ThenResult<T, F>> Then( Executor& executor, F&& fn )
+  {
+    using R = ThenResult<T, F>;
+    Promise<R> promise;
+    Future<R> retval = promise.GetFuture();
+    FutureState<T>* pState = m_pState;
+    m_pState = nullptr;
+    using Fn = typename std::decay<F>::type;
+    pState->SetContinuation(
+        Task( Continuation<Executor, Fn, R>{ &executor, StateRef( pState ), std::forward<F>( fn ), std::move( promise ) } ) );
+    return retval;
+  }
+
+private:
+  template<typename> friend class Promise;
+
+  explicit Future( FutureState<T>* pState ) : m_pState{ pState }
+  { }
+
+  // Owns one reference to a state
+  class StateRef
+  {
+  public:
+    explicit StateRef( FutureState<T>* pState ) : m_pState{ pState } { }
+    StateRef( StateRef&& other ) noexcept : m_pState{ other.m_pState } { other.m_pState = nullptr; }
+    StateRef( const StateRef& ) = delete;
+    StateRef& operator=( const StateRef& ) = delete;
+    ~StateRef()
+    {
+      if( m_pState ) {
+        m_pState->Release();
+      }
+    }
+    FutureState<T>* operator->() const { return m_pState; }
+
+  private:
+    FutureState<T>* m_pState;
+  };
+
+  template<typename Fn, typename R>
+  struct Run
+  {
+    StateRef m_state;
+    Fn m_fn;
+    Promise<R> m_promise;
+
+    void operator()()
+    {
+      if( m_state->Error() ) {
+        m_promise.SetException( m_state->Error() );
+        return;
+      }
+      FutureState<T>* pState = m_state.operator->();
+      Fn& fn = m_fn;
+      FutureFulfil<R>::Run( m_promise, [pState, &fn]() { return FutureTraits<T>::Call( fn, pState->Value() ); } );
+    }
+  };
+
+  template<typename Executor, typename Fn, typename R>
+  struct Continuation
+  {
+    Executor* m_pExecutor;
+    StateRef m_state;
+    Fn m_fn;
+    Promise<R> m_promise;
+
+    // Runs where the value was set, hops over to the executor
+    void operator()()
+    {
+      m_pExecutor->PostToDispatch( Task( Run<Fn, R>{ std::move( m_state ), std::move( m_fn ), std::move( m_promise ) } ) );
+    }
+  };
+
+  void Reset()
+  {
+    if( m_pState ) {
+      m_pState->Release();
+      m_pState = nullptr;
+    }
+  }
+
+  FutureState<T>* m_pState;
+};
+
+template<typename Fn, typename R>
+struct SubmitTask
+{
+  Fn m_fn;
+  Promise<R> m_promise;
+
+  void operator()()
+  {
+    FutureFulfil<R>::Run( m_promise, m_fn );
+  }
+};
+
+/**
+ * Posts fn to executor (anything with PostToDispatch( Task )).
+ * @return future of what fn returns, a future_error( broken_promise ) if the
+ *         executor rejected it
+ */
+template<typename Executor, typename F>
+Future<SubmitResult<F>> SubmitTo( Executor& executor, F&& fn )
+{
+  using R = SubmitResult<F>;
+  Promise<R> promise;
+  Future<R> retval = promise.GetFuture();
+  executor.PostToDispatch( Task( SubmitTask<typename std::decay<F>::type, R>{ std::forward<F>( fn ), std::move( promise ) } ) );
+  return retval;
+}
+
+}
+
+#endif // __FUTURE_H__
@@ -0,0 +1,130 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __INTRUSIVE_MPSC_QUEUE_H__
+#define __INTRUSIVE_MPSC_QUEUE_H__
+
+#include <CpuUtils.h>
+#include <atomic>
+
+namespace CppUtils {
+
+/**
+ * The link an item needs to sit in an IntrusiveMpscQueue. Derive from it.
+ */
+class MpscNode
+{
+public:
+  MpscNode() : m_pNext{ nullptr }
+  { }
+
+  MpscNode( const MpscNode& ) : m_pNext{ nullptr }
+  { }
+
+  MpscNode& operator=( const MpscNode& ) { return *this; }
+
+private:
+  template<typename T> friend class IntrusiveMpscQueue;
+  std::atomic<MpscNode*> m_pNext;
+};
+
+/**
+ * IntrusiveMpscQueue - Dmitry Vyukov's intrusive multi-producer single-consumer
+ * queue. Items carry their own link (MpscNode), so Push() is one atomic
+ * exchange plus a store and never allocates.
+ *
+ * The queue does not own its items. An item must not be pushed again or
+ * destroyed until Pop() has returned it. Pop() may only be called from one
+ * thread at a time and can return nullptr while a concurrent Push() is half
+ * way through; that Push() is visible once it returns.
+ *
+ * @tparam T - Must derive (non virtually) from MpscNode
+ */
+template<typename T>
+class IntrusiveMpscQueue
+{
+public:
+  IntrusiveMpscQueue() : m_pHead{ &m_stub }, m_pTail{ &m_stub }
+  { }
+
+  IntrusiveMpscQueue( const IntrusiveMpscQueue& ) = delete;
+  IntrusiveMpscQueue& operator=( const IntrusiveMpscQueue& ) = delete;
+
+  /**
+   * Any thread
+   */
+  void Push( T* pItem )
+  {
+    PushNode( pItem );
+  }
+
+  /**
+   * Consumer thread only
+   * @return the oldest item or nullptr
+   */
+  T* Pop()
+  {
+    MpscNode* pTail = m_pTail;
+    MpscNode* pNext = pTail->m_pNext.load( std::memory_order_acquire );
+    if( pTail == &m_stub ) {
+      if( !pNext ) {
+        return nullptr;
+      }
+      m_pTail = pNext;
+      pTail = pNext;
+      pNext = pNext->m_pNext.load( std::memory_order_acquire );
+    }
+    if( pNext ) {
+      m_pTail = pNext;
+      return static_cast<T*>( pTail );
+    }
+    if( pTail != m_pHead.load( std::memory_order_acquire ) ) {
+      // A producer has swapped the head but not linked its item yet
+      return nullptr;
+    }
+    PushNode( &m_stub );
+    pNext = pTail->m_pNext.load( std::memory_order_acquire );
+    if( pNext ) {
+      m_pTail = pNext;
+      return static_cast<T*>( pTail );
+    }
+    return nullptr;
+  }
+
+private:
+  void PushNode( MpscNode* pNode )
+  {
+    pNode->m_pNext.store( nullptr, std::memory_order_relaxed );
+    MpscNode* pPrev = m_pHead.exchange( pNode, std::memory_order_acq_rel );
+    pPrev->m_pNext.store( pNode, std::memory_order_release );
+  }
+
+  std::atomic<MpscNode*> m_pHead;
+  char m_pad[ CPPUTILS_CACHE_LINE_SIZE - sizeof( std::atomic<MpscNode*> ) ];
+  MpscNode* m_pTail;
+  MpscNode m_stub;
+};
+
+}
+
+#endif // __INTRUSIVE_MPSC_QUEUE_H__
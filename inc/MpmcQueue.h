@@ -0,0 +1,176 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __MPMC_QUEUE_H__
+#define __MPMC_QUEUE_H__
+
+#include <ABlockingQueue.h>
+#include <CpuUtils.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace CppUtils {
+
+/**
+ * MpmcQueue - Bounded, lock-free, multi-producer multi-consumer ring buffer.
+ *
+ * Every slot carries a sequence number (Dmitry Vyukov's bounded MPMC queue)
+ * so producers and consumers only contend on their own cache-line padded
+ * position counter. The capacity is rounded up to a power of two.
+ *
+ * TryEnQueue()/TryDeQueue() never block. EnQueue()/DeQueue() have the same
+ * shape as TsQueue and block (spin briefly, then park) while the queue is
+ * full or empty, so an MpmcQueue can replace a TsQueue where a bound on the
+ * number of queued items is acceptable. See ABlockingQueue for the rest of
+ * the API.
+ *
+ * @tparam T - Must be move constructible. DeQueue() additionally requires a
+ *             default constructor.
+ * @tparam WaitStrategy - What blocked threads do, see WaitStrategy.h
+ */
+template<typename T, typename WaitStrategy = SpinThenParkWait<>>
+class MpmcQueue : public ABlockingQueue<MpmcQueue<T, WaitStrategy>, T, WaitStrategy>
+{
+  friend class ABlockingQueue<MpmcQueue<T, WaitStrategy>, T, WaitStrategy>;
+
+public:
+  explicit MpmcQueue( size_t capacity = 1024 ) :
+      m_mask{ RoundUpToPowerOfTwo( capacity ) - 1 },
+      m_pCells{ new Cell[ m_mask + 1 ] },
+      m_enqueuePos{ 0 },
+      m_dequeuePos{ 0 }
+  {
+    for( size_t i = 0; i <= m_mask; i++ ) {
+      m_pCells[ i ].m_seq.store( i, std::memory_order_relaxed );
+    }
+  }
+
+  ~MpmcQueue()
+  {
+    size_t pos = m_dequeuePos.load( std::memory_order_relaxed );
+    size_t end = m_enqueuePos.load( std::memory_order_relaxed );
+    for( ; pos != end; pos++ ) {
+      m_pCells[ pos & m_mask ].Item()->~T();
+    }
+  }
+
+  MpmcQueue( const MpmcQueue& ) = delete;
+  MpmcQueue& operator=( const MpmcQueue& ) = delete;
+
+  size_t Capacity() const { return m_mask + 1; }
+
+  /**
+   * Approximate number of queued items. Exact only when the queue is quiescent.
+   */
+  size_t Size() const
+  {
+    size_t deq = m_dequeuePos.load( std::memory_order_relaxed );
+    size_t enq = m_enqueuePos.load( std::memory_order_relaxed );
+    return enq > deq ? enq - deq : 0;
+  }
+
+private:
+  struct Cell
+  {
+    std::atomic<size_t> m_seq;
+    typename std::aligned_storage<sizeof( T ), alignof( T )>::type m_storage;
+
+    T* Item() { return reinterpret_cast<T*>( &m_storage ); }
+  };
+
+  static size_t RoundUpToPowerOfTwo( size_t n )
+  {
+    size_t retval = 2;
+    while( retval < n ) {
+      retval <<= 1;
+    }
+    return retval;
+  }
+
+  template<typename... Args>
+  bool TryPush( Args&&... args )
+  {
+    Cell* pCell;
+    size_t pos = m_enqueuePos.load( std::memory_order_relaxed );
+    for( ;; ) {
+      pCell = &m_pCells[ pos & m_mask ];
+      size_t seq = pCell->m_seq.load( std::memory_order_acquire );
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if( diff == 0 ) {
+        if( m_enqueuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+          break;
+        }
+      } else if( diff < 0 ) {
+        return false;
+      } else {
+        pos = m_enqueuePos.load( std::memory_order_relaxed );
+      }
+    }
+    new ( &pCell->m_storage ) T( std::forward<Args>( args )... );
+    pCell->m_seq.store( pos + 1, std::memory_order_release );
+    return true;
+  }
+
+  bool TryPop( T& out )
+  {
+    Cell* pCell;
+    size_t pos = m_dequeuePos.load( std::memory_order_relaxed );
+    for( ;; ) {
+      pCell = &m_pCells[ pos & m_mask ];
+      size_t seq = pCell->m_seq.load( std::memory_order_acquire );
+      intptr_t diff = (intptr_t)seq - (intptr_t)( pos + 1 );
+      if( diff == 0 ) {
+        if( m_dequeuePos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+          break;
+        }
+      } else if( diff < 0 ) {
+        return false;
+      } else {
+        pos = m_dequeuePos.load( std::memory_order_relaxed );
+      }
+    }
+    T* pItem = pCell->Item();
+    out = std::move( *pItem );
+    pItem->~T();
+    pCell->m_seq.store( pos + m_mask + 1, std::memory_order_release );
+    return true;
+  }
+
+  char m_pad0[ CPPUTILS_CACHE_LINE_SIZE ];
+  const size_t m_mask;
+  const std::unique_ptr<Cell[]> m_pCells;
+  char m_pad1[ CPPUTILS_CACHE_LINE_SIZE ];
+  std::atomic<size_t> m_enqueuePos;
+  char m_pad2[ CPPUTILS_CACHE_LINE_SIZE - sizeof( std::atomic<size_t> ) ];
+  std::atomic<size_t> m_dequeuePos;
+  char m_pad3[ CPPUTILS_CACHE_LINE_SIZE - sizeof( std::atomic<size_t> ) ];
+};
+
+}
+
+#endif // __MPMC_QUEUE_H__
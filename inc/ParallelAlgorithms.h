@@ -0,0 +1,324 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __PARALLEL_ALGORITHMS_H__
+#define __PARALLEL_ALGORITHMS_H__
+
+#include <CpuUtils.h>
+#include <DispatchPool.h>
+#include <EventCount.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace CppUtils {
+
+/**
+ * ForkJoin - the shared state of one parallel algorithm call.
+ *
+ * Work is counted in elements. Jobs are posted to the pool as they are
+ * split off; whoever finishes the last element wakes the caller, which runs
+ * pool tasks itself while it waits. The first exception thrown by a job is
+ * rethrown from Join(), the other jobs still run.
+ *
+ * @tparam Pool - a BasicDispatchPool
+ */
+template<typename Pool>
+class ForkJoin : public std::enable_shared_from_this<ForkJoin<Pool>>
+{
+public:
+  ForkJoin( Pool& pool, size_t elements ) : m_pool( pool ), m_remaining{ elements }
+  { }
+
+  Pool& GetPool() { return m_pool; }
+
+  /**
+   * Posts job, or runs it right away if the pool has been killed.
+   */
+  template<typename Job>
+  void Spawn( Job job )
+  {
+    if( !m_pool.PostToDispatch( typename Pool::Fn( Guarded<Job>{ this->shared_from_this(), job } ) ) ) {
+      Run( job );
+    }
+  }
+
+  /**
+   * Runs job, recording an exception rather than letting it escape.
+   */
+  template<typename Job>
+  void Run( Job& job )
+  {
+    try {
+      job();
+    } catch( ... ) {
+      std::lock_guard<std::mutex> lk( m_errorMtx );
+      if( !m_error ) {
+        m_error = std::current_exception();
+      }
+    }
+  }
+
+  /**
+   * Marks elements as done, by jobs that finished them or gave up on them.
+   */
+  void Done( size_t elements )
+  {
+    if( elements && m_remaining.fetch_sub( elements, std::memory_order_acq_rel ) == elements ) {
+      m_done.NotifyAll();
+    }
+  }
+
+  /**
+   * Helps the pool until every element is done.
+   */
+  void Join()
+  {
+    while( !IsDone() ) {
+      if( m_pool.TryRunOne() ) {
+        continue;
+      }
+      // Nothing to steal, the rest is running on the workers
+      for( int spins = 0; spins < 64 && !IsDone(); spins++ ) {
+        CPPUTILS_CPU_RELAX();
+      }
+      if( !IsDone() && !m_pool.TryRunOne() ) {
+        m_done.Wait( [this]() { return IsDone(); } );
+      }
+    }
+    if( m_error ) {
+      std::rethrow_exception( m_error );
+    }
+  }
+
+private:
+  template<typename Job>
+  struct Guarded
+  {
+    std::shared_ptr<ForkJoin> m_spForkJoin;
+    Job m_job;
+
+    void operator()()
+    {
+      m_spForkJoin->Run( m_job );
+    }
+  };
+
+  bool IsDone() const { return m_remaining.load( std::memory_order_acquire ) == 0; }
+
+  Pool& m_pool;
+  std::atomic<size_t> m_remaining;
+  EventCount m_done;
+  std::mutex m_errorMtx;
+  std::exception_ptr m_error;
+};
+
+// Halves [begin, end) until a piece is at most grain long, posting the upper
+// halves so thieves take the big pieces, then runs the piece that is left
+template<typename Pool, typename F>
+struct ParallelForJob
+{
+  ForkJoin<Pool>* m_pForkJoin;
+  F* m_pFn;
+  size_t m_begin;
+  size_t m_end;
+  size_t m_grain;
+
+  void operator()()
+  {
+    // Whatever is left in [m_begin, m_end) is counted as done on the way
+    // out, even if fn or a Spawn() threw, so Join() returns and rethrows
+    struct DoneOnExit
+    {
+      ParallelForJob* m_pJob;
+      ~DoneOnExit() { m_pJob->m_pForkJoin->Done( m_pJob->m_end - m_pJob->m_begin ); }
+    } doneOnExit{ this };
+    while( m_end - m_begin > m_grain ) {
+      size_t mid = m_begin + ( m_end - m_begin ) / 2;
+      m_pForkJoin->Spawn( ParallelForJob{ m_pForkJoin, m_pFn, mid, m_end, m_grain } );
+      m_end = mid;
+    }
+    ( *m_pFn )( m_begin, m_end );
+  }
+};
+
+/**
+ * Calls fn( b, e ) for consecutive pieces [b, e) covering [begin, end), in
+ * parallel on pool and on the calling thread, and returns once all have
+ * returned. Pieces are at most grain long, pick grain so a piece takes a few
+ * microseconds at least. May be called from inside a pool task.
+ *
+ *   ParallelFor( pool, 0, v.size(), 1024, [&]( size_t b, size_t e ) {
+ *     for( size_t i = b; i < e; i++ ) { v[ i ] *= 2; }
+ *   } );
+ *
+ * Rethrows the first exception fn threw, after every piece has run.
+ */
+template<typename Pool, typename F>
+void ParallelFor( Pool& pool, size_t begin, size_t end, size_t grain, F&& fn )
+{
+  if( begin >= end ) {
+    return;
+  }
+  grain = grain ? grain : 1;
+  if( end - begin <= grain ) {
+    fn( begin, end );
+    return;
+  }
+  auto spForkJoin = std::make_shared<ForkJoin<Pool>>( pool, end - begin );
+  using Job = ParallelForJob<Pool, typename std::remove_reference<F>::type>;
+  Job job{ spForkJoin.get(), &fn, begin, end, grain };
+  spForkJoin->Run( job );
+  spForkJoin->Join();
+}
+
+// A partial result of ParallelReduce on a cache line of its own. Also keeps
+// a reduction to bool from sharing the words of a vector<bool>
+template<typename T>
+struct ReducePartial
+{
+  T m_value;
+  char m_pad[ CPPUTILS_CACHE_LINE_SIZE - sizeof( T ) % CPPUTILS_CACHE_LINE_SIZE ];
+};
+
+/**
+ * Reduces [begin, end) in parallel: map( b, e ) reduces a piece to a T, the
+ * pieces are then folded left to right with combine, starting at identity.
+ * combine has to be associative but need not be commutative. Pieces are at
+ * least grain long, and no more than 64 per thread are made.
+ */
+template<typename Pool, typename T, typename Map, typename Combine>
+T ParallelReduce( Pool& pool, size_t begin, size_t end, size_t grain, T identity, Map&& map, Combine&& combine )
+{
+  if( begin >= end ) {
+    return identity;
+  }
+  size_t size = end - begin;
+  size_t pieceSize = grain ? grain : 1;
+  size_t maxPieces = ( pool.ThreadCount() + 1 ) * 64;
+  if( ( size + pieceSize - 1 ) / pieceSize > maxPieces ) {
+    pieceSize = ( size + maxPieces - 1 ) / maxPieces;
+  }
+  size_t pieces = ( size + pieceSize - 1 ) / pieceSize;
+  std::vector<ReducePartial<T>> partials( pieces, ReducePartial<T>{ identity, {} } );
+  ParallelFor( pool, 0, pieces, 1, [&]( size_t first, size_t last ) {
+    for( size_t piece = first; piece < last; piece++ ) {
+      size_t b = begin + piece * pieceSize;
+      partials[ piece ].m_value = map( b, std::min( b + pieceSize, end ) );
+    }
+  } );
+  T retval = std::move( identity );
+  for( auto& partial : partials ) {
+    retval = combine( std::move( retval ), std::move( partial.m_value ) );
+  }
+  return retval;
+}
+
+// Quicksort that posts one side of every partition as a job of its own.
+// Ranges of at most grain elements, or past the depth limit, go to std::sort
+template<typename Pool, typename RandomIt, typename Compare>
+struct ParallelSortJob
+{
+  ForkJoin<Pool>* m_pForkJoin;
+  RandomIt m_first;
+  RandomIt m_last;
+  Compare m_comp;
+  size_t m_grain;
+  int m_depth;
+
+  void operator()()
+  {
+    using Value = typename std::iterator_traits<RandomIt>::value_type;
+    // Whatever is left in [m_first, m_last) is counted as done on the way
+    // out, sorted or not if comp or a Spawn() threw
+    struct DoneOnExit
+    {
+      ParallelSortJob* m_pJob;
+      ~DoneOnExit() { m_pJob->m_pForkJoin->Done( static_cast<size_t>( m_pJob->m_last - m_pJob->m_first ) ); }
+    } doneOnExit{ this };
+    while( static_cast<size_t>( m_last - m_first ) > m_grain && m_depth > 0 ) {
+      m_depth--;
+      RandomIt mid = m_first + ( m_last - m_first ) / 2;
+      Value pivot = MedianOf3( *m_first, *mid, *( m_last - 1 ) );
+      // [ < pivot | == pivot | > pivot ], the middle is in place already
+      RandomIt lower = std::partition( m_first, m_last, [this, &pivot]( const Value& v ) { return m_comp( v, pivot ); } );
+      RandomIt upper = std::partition( lower, m_last, [this, &pivot]( const Value& v ) { return !m_comp( pivot, v ); } );
+      m_pForkJoin->Spawn( ParallelSortJob{ m_pForkJoin, upper, m_last, m_comp, m_grain, m_depth } );
+      m_last = lower;
+      m_pForkJoin->Done( static_cast<size_t>( upper - lower ) );
+    }
+    std::sort( m_first, m_last, m_comp );
+  }
+
+  const typename std::iterator_traits<RandomIt>::value_type&
+  MedianOf3( const typename std::iterator_traits<RandomIt>::value_type& a,
+             const typename std::iterator_traits<RandomIt>::value_type& b,
+             const typename std::iterator_traits<RandomIt>::value_type& c )
+  {
+    if( m_comp( a, b ) ) {
+      return m_comp( b, c ) ? b : ( m_comp( a, c ) ? c : a );
+    }
+    return m_comp( a, c ) ? a : ( m_comp( b, c ) ? c : b );
+  }
+};
+
+/**
+ * Sorts [first, last) with comp in parallel on pool and the calling thread.
+ * Not stable. Ranges of up to grain elements are sorted with std::sort.
+ */
+template<typename Pool, typename RandomIt, typename Compare>
+void ParallelSort( Pool& pool, RandomIt first, RandomIt last, Compare comp, size_t grain = 1 << 14 )
+{
+  size_t size = static_cast<size_t>( last - first );
+  grain = grain ? grain : 1;
+  if( size <= grain ) {
+    std::sort( first, last, comp );
+    return;
+  }
+  // Like introsort, give up on partitioning once it keeps going badly
+  int depth = 0;
+  for( size_t n = size; n > 1; n >>= 1 ) {
+    depth += 2;
+  }
+  auto spForkJoin = std::make_shared<ForkJoin<Pool>>( pool, size );
+  ParallelSortJob<Pool, RandomIt, Compare> job{ spForkJoin.get(), first, last, comp, grain, depth };
+  spForkJoin->Run( job );
+  spForkJoin->Join();
+}
+
+template<typename Pool, typename RandomIt>
+void ParallelSort( Pool& pool, RandomIt first, RandomIt last )
+{
+  ParallelSort( pool, first, last, std::less<typename std::iterator_traits<RandomIt>::value_type>() );
+}
+
+}
+
+#endif // __PARALLEL_ALGORITHMS_H__
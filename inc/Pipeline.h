@@ -0,0 +1,432 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <DispatchThreadOptions.h>
+#include <MpmcQueue.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace CppUtils {
+
+/**
+ * What a push into a full stage queue does.
+ */
+enum EBackpressure {
+  // Wait for room, which slows the producer down to the pace of the stage
+  eBACKPRESSURE_BLOCK = 0,
+  // Drop the item and carry on, counted in PipelineStageStats::m_shed
+  eBACKPRESSURE_SHED = 1,
+};
+
+struct PipelineStageOptions
+{
+  // Also names the workers, "<name>-<index>"
+  std::string m_name;
+  // Number of workers. A single worker keeps the items in order, several
+  // process them in parallel and in no particular order
+  size_t m_concurrency = 1;
+  // Items the input queue holds, rounded up to a power of two
+  size_t m_capacity = 1024;
+  EBackpressure m_backpressure = eBACKPRESSURE_BLOCK;
+  // Cpu set, scheduling and stack size of the workers, m_name is ignored
+  DispatchThreadOptions m_threadOptions;
+};
+
+/**
+ * Counters of one stage. Rates cover the time since the previous Stats().
+ */
+struct PipelineStageStats
+{
+  std::string m_name;
+  size_t m_concurrency;
+  size_t m_capacity;
+  // Items waiting in the input queue
+  size_t m_queued;
+  // Workers inside the stage function
+  size_t m_busy;
+  uint64_t m_processed;
+  // Pushes that found the input queue full, blocked or shed
+  uint64_t m_full;
+  uint64_t m_shed;
+  double m_itemsPerSecond;
+};
+
+class APipelineStage
+{
+public:
+  virtual ~APipelineStage() { }
+
+  /**
+   * Starts the workers. Throws std::system_error if they cannot be started.
+   */
+  virtual void Start() = 0;
+
+  /**
+   * Rejects new items. The workers finish the queued ones, then exit and
+   * close the next stage.
+   */
+  virtual void Close() = 0;
+
+  virtual void Join() = 0;
+  virtual PipelineStageStats Stats() = 0;
+};
+
+template<typename T>
+class APipelineInput : public APipelineStage
+{
+public:
+  /**
+   * @return false if the item was shed or the stage is closed
+   */
+  virtual bool Push( T&& t ) = 0;
+};
+
+template<typename T>
+class APipelineOutput
+{
+public:
+  void Connect( APipelineInput<T>* pNext ) { m_pNext = pNext; }
+
+protected:
+  APipelineInput<T>* m_pNext = nullptr;
+};
+
+// Sinks have nowhere to send to
+template<>
+class APipelineOutput<void>
+{ };
+
+/**
+ * PipelineStage - a bounded MpmcQueue drained by m_concurrency workers that
+ * call fn( In ) and push the result into the next stage. Out is void for the
+ * last stage.
+ */
+template<typename In, typename Out, typename F>
+class PipelineStage : public APipelineInput<In>, public APipelineOutput<Out>
+{
+public:
+  PipelineStage( const PipelineStageOptions& options, F fn ) :
+    m_options( options ),
+    m_fn( std::move( fn ) ),
+    m_queue( options.m_capacity ),
+    m_running{ 0 },
+    m_busy{ 0 },
+    m_processed{ 0 },
+    m_full{ 0 },
+    m_shed{ 0 },
+    m_lastProcessed( 0 ),
+    m_lastStats( std::chrono::steady_clock::now() )
+  {
+    m_options.m_concurrency = m_options.m_concurrency ? m_options.m_concurrency : 1;
+  }
+
+  ~PipelineStage()
+  {
+    Close();
+    Join();
+  }
+
+  void Start() override
+  {
+    DispatchThreadOptions threadOptions = m_options.m_threadOptions;
+    m_running = m_options.m_concurrency;
+    for( size_t i = 0; i < m_options.m_concurrency; i++ ) {
+      threadOptions.m_name = m_options.m_name.empty() ? std::string() : m_options.m_name + "-" + std::to_string( i );
+      try {
+        m_threads.emplace_back( new ConfiguredThread( threadOptions, [this]() { Run(); } ) );
+      } catch( ... ) {
+        m_running -= m_options.m_concurrency - i;
+        throw;
+      }
+    }
+  }
+
+  bool Push( In&& t ) override
+  {
+    if( m_queue.TryEnQueue( std::move( t ) ) ) {
+      return true;
+    }
+    if( m_queue.IsClosed() ) {
+      return false;
+    }
+    m_full.fetch_add( 1, std::memory_order_relaxed );
+    if( m_options.m_backpressure == eBACKPRESSURE_SHED ) {
+      m_shed.fetch_add( 1, std::memory_order_relaxed );
+      return false;
+    }
+    return m_queue.EnQueue( std::move( t ) );
+  }
+
+  void Close() override
+  {
+    m_queue.Close();
+  }
+
+  void Join() override
+  {
+    for( auto& spThread : m_threads ) {
+      spThread->Join();
+    }
+    m_threads.clear();
+  }
+
+  PipelineStageStats Stats() override
+  {
+    PipelineStageStats stats;
+    stats.m_name = m_options.m_name;
+    stats.m_concurrency = m_options.m_concurrency;
+    stats.m_capacity = m_queue.Capacity();
+    stats.m_queued = m_queue.Size();
+    stats.m_busy = m_busy.load( std::memory_order_relaxed );
+    stats.m_processed = m_processed.load( std::memory_order_relaxed );
+    stats.m_full = m_full.load( std::memory_order_relaxed );
+    stats.m_shed = m_shed.load( std::memory_order_relaxed );
+
+    std::lock_guard<std::mutex> lk( m_statsMtx );
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>( now - m_lastStats ).count();
+    stats.m_itemsPerSecond = seconds > 0 ? ( stats.m_processed - m_lastProcessed ) / seconds : 0;
+    m_lastProcessed = stats.m_processed;
+    m_lastStats = now;
+    return stats;
+  }
+
+private:
+  using IsSink = std::is_void<Out>;
+
+  void Run()
+  {
+    In item;
+    while( m_queue.DeQueue( item ) ) {
+      m_busy.fetch_add( 1, std::memory_order_relaxed );
+      Process( std::move( item ), IsSink() );
+      m_busy.fetch_sub( 1, std::memory_order_relaxed );
+      m_processed.fetch_add( 1, std::memory_order_relaxed );
+    }
+    // The last worker out lets the next stage drain and stop in turn
+    if( m_running.fetch_sub( 1, std::memory_order_acq_rel ) == 1 ) {
+      CloseNext( IsSink() );
+    }
+  }
+
+  void Process( In&& item, std::true_type )
+  {
+    m_fn( std::move( item ) );
+  }
+
+  void Process( In&& item, std::false_type )
+  {
+    this->m_pNext->Push( m_fn( std::move( item ) ) );
+  }
+
+  void CloseNext( std::true_type )
+  { }
+
+  void CloseNext( std::false_type )
+  {
+    this->m_pNext->Close();
+  }
+
+  PipelineStageOptions m_options;
+  F m_fn;
+  MpmcQueue<In> m_queue;
+  std::vector<std::unique_ptr<ConfiguredThread>> m_threads;
+  std::atomic<size_t> m_running;
+  std::atomic<size_t> m_busy;
+  std::atomic<uint64_t> m_processed;
+  std::atomic<uint64_t> m_full;
+  std::atomic<uint64_t> m_shed;
+  std::mutex m_statsMtx;
+  uint64_t m_lastProcessed;
+  std::chrono::steady_clock::time_point m_lastStats;
+};
+
+/**
+ * Pipeline - stages connected by bounded queues, built with PipelineBuilder.
+ *
+ * Memory stays bounded by the stage capacities: a stage whose queue is full
+ * either blocks whoever pushes into it, all the way back to Push(), or sheds
+ * the item, see EBackpressure. Stats() shows where items pile up.
+ *
+ * Close() drains: every item pushed before it still passes through all
+ * stages. The destructor closes and joins.
+ *
+ * @tparam In - What Push() takes. Every stage input type must be default
+ *              constructible and movable.
+ */
+template<typename In>
+class Pipeline : public APipelineOutput<In>
+{
+public:
+  Pipeline() { }
+
+  ~Pipeline()
+  {
+    Close();
+    Join();
+  }
+
+  Pipeline( const Pipeline& ) = delete;
+  Pipeline& operator=( const Pipeline& ) = delete;
+
+  /**
+   * Pushes into the first stage, according to its EBackpressure.
+   * @return false if the item was shed or the pipeline is closed
+   */
+  bool Push( In t )
+  {
+    return this->m_pNext->Push( std::move( t ) );
+  }
+
+  /**
+   * Rejects new items and lets the stages drain one after the other.
+   */
+  void Close()
+  {
+    if( this->m_pNext ) {
+      this->m_pNext->Close();
+    }
+  }
+
+  /**
+   * Blocks until every stage has drained, call Close() first.
+   */
+  void Join()
+  {
+    for( auto& spStage : m_stages ) {
+      spStage->Join();
+    }
+  }
+
+  /**
+   * One entry per stage, in pipeline order.
+   */
+  std::vector<PipelineStageStats> Stats()
+  {
+    std::vector<PipelineStageStats> retval;
+    for( auto& spStage : m_stages ) {
+      retval.push_back( spStage->Stats() );
+    }
+    return retval;
+  }
+
+private:
+  template<typename, typename>
+  friend class PipelineBuilder;
+
+  void Add( std::unique_ptr<APipelineStage> spStage )
+  {
+    m_stages.push_back( std::move( spStage ) );
+  }
+
+  void Start()
+  {
+    try {
+      for( auto& spStage : m_stages ) {
+        spStage->Start();
+      }
+    } catch( ... ) {
+      // Nothing was pushed yet, so no stage waits on an upstream one
+      for( auto& spStage : m_stages ) {
+        spStage->Close();
+      }
+      Join();
+      throw;
+    }
+  }
+
+  std::vector<std::unique_ptr<APipelineStage>> m_stages;
+};
+
+/**
+ * PipelineBuilder - adds stages front to back and starts the pipeline.
+ *
+ *   auto spPipeline = PipelineBuilder<std::string>()
+ *     .Stage( parseOptions, []( std::string line ) { return Parse( line ); } )
+ *     .Stage( scoreOptions, []( Record r ) { return Score( r ); } )
+ *     .Sink( storeOptions, [&]( Score s ) { store.Add( s ); } );
+ *   spPipeline->Push( line );
+ *
+ * @tparam In - What the pipeline takes
+ * @tparam Cur - What the last stage added so far produces
+ */
+template<typename In, typename Cur = In>
+class PipelineBuilder
+{
+public:
+  PipelineBuilder() : m_spPipeline( new Pipeline<In>() ), m_pTail( m_spPipeline.get() )
+  { }
+
+  /**
+   * Adds a stage that maps every item with fn( Cur ).
+   */
+  template<typename F, typename Out = typename std::decay<decltype( std::declval<F&>()( std::declval<Cur>() ) )>::type>
+  PipelineBuilder<In, Out> Stage( const PipelineStageOptions& options, F fn )
+  {
+    static_assert( !std::is_void<Out>::value, "Stage functions must return the next item, use Sink() to end" );
+    std::unique_ptr<PipelineStage<Cur, Out, F>> spStage( new PipelineStage<Cur, Out, F>( options, std::move( fn ) ) );
+    auto pStage = spStage.get();
+    m_pTail->Connect( pStage );
+    m_spPipeline->Add( std::move( spStage ) );
+    return PipelineBuilder<In, Out>( std::move( m_spPipeline ), pStage );
+  }
+
+  /**
+   * Adds the last stage, which consumes items with fn( Cur ), and starts the
+   * workers of every stage. Throws std::system_error if one cannot start.
+   */
+  template<typename F>
+  std::unique_ptr<Pipeline<In>> Sink( const PipelineStageOptions& options, F fn )
+  {
+    std::unique_ptr<PipelineStage<Cur, void, F>> spStage( new PipelineStage<Cur, void, F>( options, std::move( fn ) ) );
+    m_pTail->Connect( spStage.get() );
+    m_spPipeline->Add( std::move( spStage ) );
+    m_spPipeline->Start();
+    return std::move( m_spPipeline );
+  }
+
+private:
+  template<typename, typename>
+  friend class PipelineBuilder;
+
+  PipelineBuilder( std::unique_ptr<Pipeline<In>> spPipeline, APipelineOutput<Cur>* pTail ) :
+    m_spPipeline( std::move( spPipeline ) ), m_pTail( pTail )
+  { }
+
+  std::unique_ptr<Pipeline<In>> m_spPipeline;
+  APipelineOutput<Cur>* m_pTail;
+};
+
+}
+
+#endif // __PIPELINE_H__
@@ -0,0 +1,153 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __PRIORITY_TS_QUEUE_H__
+#define __PRIORITY_TS_QUEUE_H__
+
+#include <ABlockingQueue.h>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace CppUtils {
+
+/**
+ * PriorityTsQueue - unbounded thread safe queue with a fixed number of
+ * priority bands.
+ *
+ * Every band is a FIFO. DeQueue hands out the oldest item of the highest non
+ * empty band, so both ends stay O(1) (well, O(Bands)) instead of the
+ * O(log n) of a heap, and items of equal priority keep their order. Lower
+ * bands are starved for as long as higher bands have work.
+ *
+ * Priority 0 is the lowest band and the one the plain EnQueue / Emplace calls
+ * use. Priorities above Bands - 1 are clamped.
+ *
+ * @tparam Bands - Number of priority levels
+ * @tparam WaitStrategy - What a blocked consumer does, see WaitStrategy.h
+ */
+template<typename T, size_t Bands = 4, typename WaitStrategy = BlockingWait>
+class PriorityTsQueue : public ABlockingQueue<PriorityTsQueue<T, Bands, WaitStrategy>, T, WaitStrategy>
+{
+  using Base = ABlockingQueue<PriorityTsQueue<T, Bands, WaitStrategy>, T, WaitStrategy>;
+  friend Base;
+
+  static_assert( Bands > 0, "PriorityTsQueue needs at least one band" );
+
+  // Tags the band in the argument list that ABlockingQueue forwards to TryPush
+  struct Band
+  {
+    size_t m_index;
+  };
+
+public:
+  static constexpr size_t kBands = Bands;
+
+  PriorityTsQueue() : m_size{ 0 }
+  { }
+
+  PriorityTsQueue( const PriorityTsQueue& ) = delete;
+  PriorityTsQueue& operator=( const PriorityTsQueue& ) = delete;
+
+  using Base::EnQueue;
+  using Base::TryEnQueue;
+
+  /**
+   * @return false if the queue is closed
+   */
+  bool EnQueue( const T& t, size_t priority ) { return this->Emplace( ToBand( priority ), t ); }
+  bool EnQueue( T&& t, size_t priority ) { return this->Emplace( ToBand( priority ), std::move( t ) ); }
+
+  bool TryEnQueue( const T& t, size_t priority ) { return this->TryEmplace( ToBand( priority ), t ); }
+  bool TryEnQueue( T&& t, size_t priority ) { return this->TryEmplace( ToBand( priority ), std::move( t ) ); }
+
+  /**
+   * Constructs the item in place in the band for priority.
+   * @return false if the queue is closed
+   */
+  template<typename... Args>
+  bool EmplaceWithPriority( size_t priority, Args&&... args )
+  {
+    return this->Emplace( ToBand( priority ), std::forward<Args>( args )... );
+  }
+
+  /**
+   * Approximate number of queued items across all bands.
+   */
+  size_t Size() const { return m_size.load( std::memory_order_acquire ); }
+
+private:
+  static Band ToBand( size_t priority )
+  {
+    return Band{ priority < Bands ? priority : Bands - 1 };
+  }
+
+  template<typename... Args>
+  bool TryPush( Band band, Args&&... args )
+  {
+    std::lock_guard<std::mutex> lk( m_mtx );
+    m_bands[ band.m_index ].emplace_back( std::forward<Args>( args )... );
+    m_size.store( m_size.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+    return true;
+  }
+
+  template<typename... Args>
+  bool TryPush( Args&&... args )
+  {
+    return TryPush( Band{ 0 }, std::forward<Args>( args )... );
+  }
+
+  bool TryPop( T& out )
+  {
+    // Spinning consumers poll here, keep them off the mutex while empty
+    if( m_size.load( std::memory_order_acquire ) == 0 ) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lk( m_mtx );
+    for( size_t band = Bands; band-- > 0; ) {
+      std::deque<T>& q = m_bands[ band ];
+      if( !q.empty() ) {
+        out = std::move( q.front() );
+        q.pop_front();
+        m_size.store( m_size.load( std::memory_order_relaxed ) - 1, std::memory_order_release );
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::mutex m_mtx;
+  std::array<std::deque<T>, Bands> m_bands;
+  // Only written with m_mtx held
+  std::atomic<size_t> m_size;
+};
+
+template<typename T, size_t Bands, typename WaitStrategy>
+constexpr size_t PriorityTsQueue<T, Bands, WaitStrategy>::kBands;
+
+}
+
+#endif // __PRIORITY_TS_QUEUE_H__
@@ -0,0 +1,324 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __REACTOR_QUEUE_H__
+#define __REACTOR_QUEUE_H__
+
+#if !defined( __linux__ )
+#error "ReactorQueue needs epoll and eventfd"
+#endif
+
+#include <ACancelable.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <utility>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace CppUtils {
+
+/**
+ * ReactorQueue - a task queue whose consumer sleeps in epoll_wait, so file
+ * descriptor readiness and posted tasks are served by the same thread.
+ *
+ * Producers wake the consumer through an eventfd. While the consumer waits
+ * in DeQueue() or DeQueueUntil() it runs the callbacks of ready fds
+ * registered with WatchFd(), and it polls them once more before every batch
+ * of tasks so a steady stream of posts does not starve I/O. Meant to be the
+ * queue of a dispatch thread, see ReactorDispatchThread.
+ *
+ * Linux only. Throws std::system_error if epoll or the eventfd cannot be
+ * created.
+ */
+template<typename T>
+class ReactorQueue
+{
+public:
+  using ValueType = T;
+  // Called on the consumer thread with the ready events, e.g. EPOLLIN
+  using FdCallback = std::function<void( uint32_t )>;
+
+  ReactorQueue() : m_epollFd( epoll_create1( EPOLL_CLOEXEC ) ), m_wakeFd( eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) )
+  {
+    epoll_event event = epoll_event();
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if( m_epollFd < 0 || m_wakeFd < 0 || epoll_ctl( m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &event ) != 0 ) {
+      int err = errno;
+      CloseFds();
+      throw std::system_error( err, std::generic_category(), "ReactorQueue" );
+    }
+  }
+
+  ~ReactorQueue()
+  {
+    CloseFds();
+  }
+
+  ReactorQueue( const ReactorQueue& ) = delete;
+  ReactorQueue& operator=( const ReactorQueue& ) = delete;
+
+  /**
+   * @return false if the queue has been closed
+   */
+  template<typename... Args>
+  bool EnQueue( Args&&... args )
+  {
+    bool wasEmpty;
+    {
+      std::lock_guard<std::mutex> lk( m_mtx );
+      if( m_closed ) {
+        return false;
+      }
+      wasEmpty = m_pending.empty();
+      m_pending.emplace_back( std::forward<Args>( args )... );
+    }
+    // Only the first post of a batch rings, the consumer takes them all
+    if( wasEmpty ) {
+      Wake();
+    }
+    return true;
+  }
+
+  /**
+   * Consumer only. Blocks, serving fd callbacks, until a task arrives.
+   * @return false once the queue is closed and drained
+   */
+  bool DeQueue( T& out )
+  {
+    return Wait( out, nullptr );
+  }
+
+  /**
+   * Consumer only. Like DeQueue() but gives up at deadline.
+   */
+  template<typename Clock, typename Duration>
+  bool DeQueueUntil( T& out, const std::chrono::time_point<Clock, Duration>& deadline )
+  {
+    auto steadyDeadline = std::chrono::steady_clock::now() +
+                          std::chrono::duration_cast<std::chrono::steady_clock::duration>( deadline - Clock::now() );
+    return Wait( out, &steadyDeadline );
+  }
+
+  template<typename Rep, typename Period>
+  bool DeQueueFor( T& out, const std::chrono::duration<Rep, Period>& timeout )
+  {
+    return DeQueueUntil( out, std::chrono::steady_clock::now() + timeout );
+  }
+
+  void Close()
+  {
+    {
+      std::lock_guard<std::mutex> lk( m_mtx );
+      m_closed = true;
+    }
+    Wake();
+  }
+
+  bool IsClosed() const
+  {
+    std::lock_guard<std::mutex> lk( m_mtx );
+    return m_closed;
+  }
+
+  /**
+   * Runs fn on the consumer thread whenever fd is ready for events (EPOLLIN,
+   * EPOLLOUT, EPOLLET, ...). May be called from any thread. Cancel the watch
+   * before closing fd; once canceled fn is not called again, even if it was
+   * already reported ready.
+   * @return token to stop watching, empty if epoll rejected fd. It expires
+   *         once the watch has been canceled and released.
+   */
+  std::weak_ptr<ACancelableToken> WatchFd( int fd, uint32_t events, FdCallback fn )
+  {
+    std::weak_ptr<ACancelableToken> retval;
+    if( !fn ) {
+      return retval;
+    }
+    auto spWatch = std::make_shared<FdWatch>( *this, fd, std::move( fn ) );
+    std::lock_guard<std::mutex> lk( m_mtx );
+    epoll_event event = epoll_event();
+    event.events = events;
+    event.data.ptr = spWatch.get();
+    if( epoll_ctl( m_epollFd, EPOLL_CTL_ADD, fd, &event ) == 0 ) {
+      m_watches.push_back( spWatch );
+      retval = spWatch;
+    }
+    return retval;
+  }
+
+private:
+  class FdWatch : public ACancelableToken
+  {
+  public:
+    FdWatch( ReactorQueue& queue, int fd, FdCallback fn ) : m_queue( queue ), m_fd( fd ), m_fn( std::move( fn ) )
+    { }
+
+    virtual void Cancel()
+    {
+      if( !m_canceled.exchange( true, std::memory_order_acq_rel ) ) {
+        m_queue.Unwatch( this );
+      }
+    }
+
+    bool IsCanceled() const
+    {
+      return m_canceled.load( std::memory_order_acquire );
+    }
+
+    ReactorQueue& m_queue;
+    int m_fd;
+    FdCallback m_fn;
+
+  private:
+    std::atomic<bool> m_canceled{ false };
+  };
+
+  bool Wait( T& out, const std::chrono::steady_clock::time_point* pDeadline )
+  {
+    bool polled = false;
+    for( ;; ) {
+      if( !m_local.empty() ) {
+        out = std::move( m_local.front() );
+        m_local.pop_front();
+        return true;
+      }
+      bool closed;
+      {
+        std::lock_guard<std::mutex> lk( m_mtx );
+        m_local.swap( m_pending );
+        closed = m_closed;
+      }
+      if( !m_local.empty() ) {
+        // I/O gets its turn before every batch of tasks
+        if( !polled ) {
+          Poll( 0 );
+        }
+        continue;
+      }
+      if( closed ) {
+        return false;
+      }
+      int timeout = -1;
+      if( pDeadline ) {
+        auto remaining = *pDeadline - std::chrono::steady_clock::now();
+        if( remaining <= std::chrono::steady_clock::duration::zero() ) {
+          return false;
+        }
+        // Round up, waking early would just spin until the deadline
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    remaining + std::chrono::milliseconds( 1 ) - std::chrono::nanoseconds( 1 ) ).count();
+        timeout = ms < INT_MAX ? static_cast<int>( ms ) : INT_MAX;
+      }
+      Poll( timeout );
+      polled = true;
+    }
+  }
+
+  void Poll( int timeout )
+  {
+    // Canceled watches are only freed here, between two batches of events,
+    // so a pointer epoll handed out is never dangling
+    ReleaseRetired();
+    epoll_event events[ 64 ];
+    int count = epoll_wait( m_epollFd, events, 64, timeout );
+    for( int i = 0; i < count; i++ ) {
+      FdWatch* pWatch = static_cast<FdWatch*>( events[ i ].data.ptr );
+      if( !pWatch ) {
+        uint64_t value;
+        while( read( m_wakeFd, &value, sizeof( value ) ) == sizeof( value ) ) {
+        }
+      } else if( !pWatch->IsCanceled() ) {
+        pWatch->m_fn( events[ i ].events );
+      }
+    }
+  }
+
+  void Unwatch( FdWatch* pWatch )
+  {
+    // Fails harmlessly if fd was closed already
+    epoll_ctl( m_epollFd, EPOLL_CTL_DEL, pWatch->m_fd, nullptr );
+    std::lock_guard<std::mutex> lk( m_mtx );
+    for( auto it = m_watches.begin(); it != m_watches.end(); ++it ) {
+      if( it->get() == pWatch ) {
+        m_retired.push_back( std::move( *it ) );
+        m_watches.erase( it );
+        break;
+      }
+    }
+  }
+
+  void ReleaseRetired()
+  {
+    std::vector<std::shared_ptr<FdWatch>> retired;
+    {
+      std::lock_guard<std::mutex> lk( m_mtx );
+      if( m_retired.empty() ) {
+        return;
+      }
+      retired.swap( m_retired );
+    }
+  }
+
+  void Wake()
+  {
+    uint64_t one = 1;
+    ssize_t written = write( m_wakeFd, &one, sizeof( one ) );
+    // EAGAIN means the counter is saturated, the consumer is woken anyway
+    (void)written;
+  }
+
+  void CloseFds()
+  {
+    if( m_epollFd >= 0 ) {
+      close( m_epollFd );
+    }
+    if( m_wakeFd >= 0 ) {
+      close( m_wakeFd );
+    }
+  }
+
+  int m_epollFd;
+  int m_wakeFd;
+  mutable std::mutex m_mtx;
+  bool m_closed = false;
+  std::deque<T> m_pending;
+  std::vector<std::shared_ptr<FdWatch>> m_watches;
+  std::vector<std::shared_ptr<FdWatch>> m_retired;
+  // Consumer only
+  std::deque<T> m_local;
+};
+
+}
+
+#endif // __REACTOR_QUEUE_H__
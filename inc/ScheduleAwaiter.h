@@ -0,0 +1,84 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __SCHEDULE_AWAITER_H__
+#define __SCHEDULE_AWAITER_H__
+
+#include <Task.h>
+
+namespace CppUtils {
+
+/**
+ * ScheduleAwaiter - what Schedule() on a dispatch thread, pool or strand
+ * returns. In a C++20 coroutine
+ *
+ *   co_await thr.Schedule();
+ *
+ * suspends and resumes the coroutine as a task on that executor. The header
+ * itself stays C++11: await_suspend is a template over the handle type.
+ *
+ * co_await yields false if the executor rejected the task (it has been
+ * killed), the coroutine then simply keeps running where it was. A task that
+ * is dropped after it was accepted never resumes its coroutine.
+ */
+template<typename Executor>
+class ScheduleAwaiter
+{
+public:
+  explicit ScheduleAwaiter( Executor& executor ) : m_executor( executor ), m_scheduled{ false }
+  { }
+
+  bool await_ready() const noexcept { return false; }
+
+  template<typename Handle>
+  bool await_suspend( Handle handle )
+  {
+    // The coroutine may resume, and this awaiter vanish, before
+    // PostToDispatch() even returns
+    m_scheduled = true;
+    Executor& executor = m_executor;
+    if( executor.PostToDispatch( Task( Resume<Handle>{ handle } ) ) ) {
+      return true;
+    }
+    m_scheduled = false;
+    return false;
+  }
+
+  bool await_resume() const noexcept { return m_scheduled; }
+
+private:
+  template<typename Handle>
+  struct Resume
+  {
+    Handle m_handle;
+
+    void operator()() { m_handle.resume(); }
+  };
+
+  Executor& m_executor;
+  bool m_scheduled;
+};
+
+}
+
+#endif // __SCHEDULE_AWAITER_H__
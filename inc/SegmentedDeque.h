@@ -0,0 +1,191 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __SEGMENTED_DEQUE_H__
+#define __SEGMENTED_DEQUE_H__
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace CppUtils {
+
+/**
+ * SegmentedDeque - FIFO container made of linked, fixed size segments.
+ *
+ * Drained segments go back to a small free-list (up to MaxFreeSegments) and
+ * are reused before anything new is allocated, so a queue whose depth moves
+ * up and down within a few segments does no allocation in steady state.
+ *
+ * It only offers what std::queue needs (front, back, push_back, emplace_back,
+ * pop_front, empty, size), so it is meant to be used through std::queue or
+ * TsQueue, see SegmentedQueue in TsQueue.h.
+ */
+template<typename T, size_t SegmentSize = 64, size_t MaxFreeSegments = 4>
+class SegmentedDeque
+{
+public:
+  using value_type = T;
+  using reference = T&;
+  using const_reference = const T&;
+  using size_type = size_t;
+
+  SegmentedDeque() { }
+
+  SegmentedDeque( SegmentedDeque&& other ) { Swap( other ); }
+
+  SegmentedDeque& operator=( SegmentedDeque&& other )
+  {
+    SegmentedDeque tmp( std::move( other ) );
+    Swap( tmp );
+    return *this;
+  }
+
+  SegmentedDeque( const SegmentedDeque& ) = delete;
+  SegmentedDeque& operator=( const SegmentedDeque& ) = delete;
+
+  ~SegmentedDeque()
+  {
+    while( !empty() ) {
+      pop_front();
+    }
+    FreeList( m_pHead );
+    FreeList( m_pFree );
+  }
+
+  bool empty() const { return m_size == 0; }
+  size_t size() const { return m_size; }
+
+  T& front() { return *m_pHead->Item( m_headIdx ); }
+  const T& front() const { return *m_pHead->Item( m_headIdx ); }
+  T& back() { return *m_pTail->Item( m_tailIdx - 1 ); }
+  const T& back() const { return *m_pTail->Item( m_tailIdx - 1 ); }
+
+  void push_back( const T& t ) { emplace_back( t ); }
+  void push_back( T&& t ) { emplace_back( std::move( t ) ); }
+
+  template<typename... Args>
+  void emplace_back( Args&&... args )
+  {
+    if( !m_pTail ) {
+      m_pHead = m_pTail = Acquire();
+    } else if( m_tailIdx == SegmentSize ) {
+      Segment* pSeg = Acquire();
+      m_pTail->m_pNext = pSeg;
+      m_pTail = pSeg;
+      m_tailIdx = 0;
+    }
+    new ( m_pTail->Item( m_tailIdx ) ) T( std::forward<Args>( args )... );
+    m_tailIdx++;
+    m_size++;
+  }
+
+  void pop_front()
+  {
+    m_pHead->Item( m_headIdx )->~T();
+    m_headIdx++;
+    m_size--;
+    if( m_size == 0 ) {
+      // Keep the last segment around, the next push reuses it from the start
+      m_headIdx = m_tailIdx = 0;
+    } else if( m_headIdx == SegmentSize ) {
+      Segment* pSeg = m_pHead;
+      m_pHead = m_pHead->m_pNext;
+      m_headIdx = 0;
+      Release( pSeg );
+    }
+  }
+
+  /**
+   * Number of drained segments waiting to be reused
+   */
+  size_t FreeSegments() const { return m_freeCount; }
+
+  friend void swap( SegmentedDeque& a, SegmentedDeque& b ) { a.Swap( b ); }
+
+private:
+  struct Segment
+  {
+    Segment* m_pNext = nullptr;
+    typename std::aligned_storage<sizeof( T ), alignof( T )>::type m_items[ SegmentSize ];
+
+    T* Item( size_t idx ) { return reinterpret_cast<T*>( &m_items[ idx ] ); }
+    const T* Item( size_t idx ) const { return reinterpret_cast<const T*>( &m_items[ idx ] ); }
+  };
+
+  Segment* Acquire()
+  {
+    if( !m_pFree ) {
+      return new Segment;
+    }
+    Segment* pSeg = m_pFree;
+    m_pFree = pSeg->m_pNext;
+    m_freeCount--;
+    pSeg->m_pNext = nullptr;
+    return pSeg;
+  }
+
+  void Release( Segment* pSeg )
+  {
+    if( m_freeCount < MaxFreeSegments ) {
+      pSeg->m_pNext = m_pFree;
+      m_pFree = pSeg;
+      m_freeCount++;
+    } else {
+      delete pSeg;
+    }
+  }
+
+  static void FreeList( Segment* pSeg )
+  {
+    while( pSeg ) {
+      Segment* pNext = pSeg->m_pNext;
+      delete pSeg;
+      pSeg = pNext;
+    }
+  }
+
+  void Swap( SegmentedDeque& other )
+  {
+    std::swap( m_pHead, other.m_pHead );
+    std::swap( m_pTail, other.m_pTail );
+    std::swap( m_headIdx, other.m_headIdx );
+    std::swap( m_tailIdx, other.m_tailIdx );
+    std::swap( m_size, other.m_size );
+    std::swap( m_pFree, other.m_pFree );
+    std::swap( m_freeCount, other.m_freeCount );
+  }
+
+  Segment* m_pHead = nullptr;
+  Segment* m_pTail = nullptr;
+  size_t m_headIdx = 0;
+  size_t m_tailIdx = 0;
+  size_t m_size = 0;
+  Segment* m_pFree = nullptr;
+  size_t m_freeCount = 0;
+};
+
+}
+
+#endif // __SEGMENTED_DEQUE_H__
@@ -0,0 +1,159 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __SPSC_QUEUE_H__
+#define __SPSC_QUEUE_H__
+
+#include <ABlockingQueue.h>
+#include <CpuUtils.h>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace CppUtils {
+
+/**
+ * SpscQueue - Bounded, wait-free, single-producer single-consumer ring buffer.
+ *
+ * The producer owns the tail index and the consumer owns the head index. Each
+ * side keeps a private cached copy of the other side's index and only reloads
+ * it (with acquire) when the cached value says the ring is full / empty, so
+ * in steady state the two threads do not touch each other's cache lines.
+ *
+ * Items must only ever be enqueued from one thread and dequeued from one
+ * (possibly different) thread. The ring itself needs only acquire/release
+ * ordering; the blocking wrappers from ABlockingQueue add a fence per
+ * operation so that a parked peer can be woken up. Close() may be called
+ * from any thread.
+ *
+ * @tparam T - Must be move constructible. DeQueue() additionally requires a
+ *             default constructor.
+ * @tparam WaitStrategy - What blocked threads do, see WaitStrategy.h
+ */
+template<typename T, typename WaitStrategy = SpinThenParkWait<>>
+class SpscQueue : public ABlockingQueue<SpscQueue<T, WaitStrategy>, T, WaitStrategy>
+{
+  friend class ABlockingQueue<SpscQueue<T, WaitStrategy>, T, WaitStrategy>;
+
+public:
+  explicit SpscQueue( size_t capacity = 1024 ) :
+      m_mask{ RoundUpToPowerOfTwo( capacity ) - 1 },
+      m_pSlots{ new Slot[ m_mask + 1 ] },
+      m_head{ 0 },
+      m_tailCache{ 0 },
+      m_tail{ 0 },
+      m_headCache{ 0 }
+  { }
+
+  ~SpscQueue()
+  {
+    size_t head = m_head.load( std::memory_order_relaxed );
+    size_t tail = m_tail.load( std::memory_order_relaxed );
+    for( ; head != tail; head++ ) {
+      m_pSlots[ head & m_mask ].Item()->~T();
+    }
+  }
+
+  SpscQueue( const SpscQueue& ) = delete;
+  SpscQueue& operator=( const SpscQueue& ) = delete;
+
+  size_t Capacity() const { return m_mask + 1; }
+
+  /**
+   * Approximate number of queued items.
+   */
+  size_t Size() const
+  {
+    size_t head = m_head.load( std::memory_order_acquire );
+    size_t tail = m_tail.load( std::memory_order_acquire );
+    return tail > head ? tail - head : 0;
+  }
+
+private:
+  struct Slot
+  {
+    typename std::aligned_storage<sizeof( T ), alignof( T )>::type m_storage;
+
+    T* Item() { return reinterpret_cast<T*>( &m_storage ); }
+  };
+
+  static size_t RoundUpToPowerOfTwo( size_t n )
+  {
+    size_t retval = 2;
+    while( retval < n ) {
+      retval <<= 1;
+    }
+    return retval;
+  }
+
+  template<typename... Args>
+  bool TryPush( Args&&... args )
+  {
+    size_t tail = m_tail.load( std::memory_order_relaxed );
+    if( tail - m_headCache > m_mask ) {
+      m_headCache = m_head.load( std::memory_order_acquire );
+      if( tail - m_headCache > m_mask ) {
+        return false;
+      }
+    }
+    new ( &m_pSlots[ tail & m_mask ].m_storage ) T( std::forward<Args>( args )... );
+    m_tail.store( tail + 1, std::memory_order_release );
+    return true;
+  }
+
+  bool TryPop( T& out )
+  {
+    size_t head = m_head.load( std::memory_order_relaxed );
+    if( head == m_tailCache ) {
+      m_tailCache = m_tail.load( std::memory_order_acquire );
+      if( head == m_tailCache ) {
+        return false;
+      }
+    }
+    T* pItem = m_pSlots[ head & m_mask ].Item();
+    out = std::move( *pItem );
+    pItem->~T();
+    m_head.store( head + 1, std::memory_order_release );
+    return true;
+  }
+
+  char m_pad0[ CPPUTILS_CACHE_LINE_SIZE ];
+  const size_t m_mask;
+  const std::unique_ptr<Slot[]> m_pSlots;
+  char m_pad1[ CPPUTILS_CACHE_LINE_SIZE ];
+  // Consumer side
+  std::atomic<size_t> m_head;
+  size_t m_tailCache;
+  char m_pad2[ CPPUTILS_CACHE_LINE_SIZE - sizeof( std::atomic<size_t> ) - sizeof( size_t ) ];
+  // Producer side
+  std::atomic<size_t> m_tail;
+  size_t m_headCache;
+  char m_pad3[ CPPUTILS_CACHE_LINE_SIZE - sizeof( std::atomic<size_t> ) - sizeof( size_t ) ];
+};
+
+}
+
+#endif // __SPSC_QUEUE_H__
@@ -0,0 +1,255 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __STRAND_H__
+#define __STRAND_H__
+
+#include <DispatchPool.h>
+#include <EventCount.h>
+#include <IntrusiveMpscQueue.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+namespace CppUtils
+{
+
+/**
+ * BasicStrand - DispatchThread ordering without the thread.
+ *
+ * Tasks posted to a strand run one at a time, in posting order, on the
+ * workers of a shared executor (anything with PostToDispatch( Fn ), usually a
+ * DispatchPool). A strand is a small heap block: an intrusive task queue and
+ * a word that packs the number of queued tasks with a closed flag. Whoever
+ * posts into an idle strand schedules a drain on the executor, the drain runs
+ * up to kDrainBatch tasks and then yields the worker by rescheduling itself.
+ *
+ * Kill() has DispatchThread semantics. On a worker of the executor it runs
+ * executor tasks until the strand is drained instead of blocking the worker
+ * the drain is queued for. If the executor rejects the drain
+ * (it has been killed) the tasks run on the posting thread instead, so they
+ * are never lost.
+ *
+ * @tparam ExecutorType - Must outlive the strand
+ */
+template<typename ExecutorType>
+class BasicStrand
+{
+public:
+  using Fn = typename ExecutorType::Fn;
+
+  static const size_t kDrainBatch = 64;
+
+  explicit BasicStrand( ExecutorType& executor ) : m_spState{ make_shared<State>( executor ) }
+  { }
+
+  virtual ~BasicStrand()
+  {
+    Kill();
+  }
+
+  BasicStrand( const BasicStrand& ) = delete;
+  BasicStrand& operator=( const BasicStrand& ) = delete;
+
+  /**
+   * Stops accepting new tasks. The tasks that are already queued still run.
+   * Blocks until then unless called from a task of this strand. A worker of
+   * the executor helps run the queued tasks while it waits.
+   */
+  void Kill()
+  {
+    m_spState->m_state.fetch_or( kClosed, memory_order_acq_rel );
+    if( IsCurrent() ) {
+      return;
+    }
+    State& state = *m_spState;
+    auto idle = [&state]() { return ( state.m_state.load( memory_order_acquire ) >> 1 ) == 0; };
+    if( !HelpUntil( state.m_executor, idle, 0 ) ) {
+      state.m_idle.Wait( idle );
+    }
+  }
+
+  /**
+   * @return false if fn is empty or the strand has been killed
+   */
+  bool PostToDispatch( Fn fn )
+  {
+    if( !fn ) {
+      return false;
+    }
+    State& state = *m_spState;
+    uint64_t prev = state.m_state.load( memory_order_relaxed );
+    do {
+      if( prev & kClosed ) {
+        return false;
+      }
+    } while( !state.m_state.compare_exchange_weak( prev, prev + kTask, memory_order_acq_rel, memory_order_relaxed ) );
+    state.m_tasks.Push( new Node( std::move( fn ) ) );
+    if( ( prev >> 1 ) == 0 ) {
+      if( !state.m_executor.PostToDispatch( Fn( Drainer{ m_spState } ) ) ) {
+        Drain( m_spState );
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Runs fn on the strand and hands its result back through a Future, see
+   * Future.h.
+   */
+  template<typename F>
+  Future<SubmitResult<F>> Submit( F&& fn )
+  {
+    return SubmitTo( *this, std::forward<F>( fn ) );
+  }
+
+  /**
+   * co_await Schedule() resumes a C++20 coroutine on the strand, see
+   * ScheduleAwaiter.h.
+   */
+  ScheduleAwaiter<BasicStrand> Schedule()
+  {
+    return ScheduleAwaiter<BasicStrand>( *this );
+  }
+
+  /**
+   * @return true if called from a task running on this strand
+   */
+  bool IsCurrent() const
+  {
+    return Current() == m_spState.get();
+  }
+
+private:
+  static const uint64_t kClosed = 1;
+  static const uint64_t kTask = 2;
+
+  struct Node : public MpscNode
+  {
+    explicit Node( Fn&& fn ) : m_fn{ std::move( fn ) }
+    { }
+
+    Fn m_fn;
+  };
+
+  struct State
+  {
+    explicit State( ExecutorType& executor ) : m_executor( executor ), m_state{ 0 }
+    { }
+
+    ~State()
+    {
+      while( Node* pNode = m_tasks.Pop() ) {
+        delete pNode;
+      }
+    }
+
+    ExecutorType& m_executor;
+    // Queued task count << 1 | kClosed
+    atomic<uint64_t> m_state;
+    IntrusiveMpscQueue<Node> m_tasks;
+    EventCount m_idle;
+  };
+
+  struct Drainer
+  {
+    shared_ptr<State> m_spState;
+
+    void operator()()
+    {
+      Drain( m_spState );
+    }
+  };
+
+  static const void*& Current()
+  {
+    static thread_local const void* pCurrent = nullptr;
+    return pCurrent;
+  }
+
+  // A worker of the executor may be the one the drain is queued for, so it
+  // runs executor tasks rather than park. Yields while the drain runs on
+  // another worker, or is still being posted by another thread.
+  template<typename Executor, typename Pred>
+  static auto HelpUntil( Executor& executor, Pred& done, int ) -> decltype( executor.IsWorkerThread(), executor.TryRunOne(), bool() )
+  {
+    if( !executor.IsWorkerThread() ) {
+      return false;
+    }
+    while( !done() ) {
+      if( !executor.TryRunOne() ) {
+        this_thread::yield();
+      }
+    }
+    return true;
+  }
+
+  // Executors that cannot run tasks on the caller
+  template<typename Executor, typename Pred>
+  static bool HelpUntil( Executor&, Pred&, long )
+  {
+    return false;
+  }
+
+  // Only one thread at a time gets here, the one that took the count from 0
+  static void Drain( const shared_ptr<State>& spState )
+  {
+    State& state = *spState;
+    const void* pPrev = Current();
+    Current() = &state;
+    for( size_t budget = kDrainBatch;; ) {
+      Node* pNode = nullptr;
+      // The poster counts before it links the node, wait for the link
+      while( !( pNode = state.m_tasks.Pop() ) ) {
+        this_thread::yield();
+      }
+      pNode->m_fn();
+      delete pNode;
+      if( ( state.m_state.fetch_sub( kTask, memory_order_acq_rel ) >> 1 ) == 1 ) {
+        Current() = pPrev;
+        state.m_idle.NotifyAll();
+        return;
+      }
+      if( --budget == 0 ) {
+        Current() = pPrev;
+        if( state.m_executor.PostToDispatch( Fn( Drainer{ spState } ) ) ) {
+          return;
+        }
+        Current() = &state;
+        budget = kDrainBatch;
+      }
+    }
+  }
+
+  shared_ptr<State> m_spState;
+};
+
+template<typename ExecutorType>
+const size_t BasicStrand<ExecutorType>::kDrainBatch;
+
+using Strand = BasicStrand<DispatchPool>;
+
+}
+
+#endif // __STRAND_H__
@@ -0,0 +1,206 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __TASK_H__
+#define __TASK_H__
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace CppUtils {
+
+/**
+ * BasicTask - move-only type erased void(void) callable.
+ *
+ * Unlike std::function it takes move-only captures, and any callable of up
+ * to InlineSize bytes (pointer aligned, nothrow movable) is stored inline, so
+ * building, queueing and running a typical lambda does not allocate. Bigger
+ * callables fall back to the heap.
+ *
+ * Calling an empty task is undefined, test it first like std::function.
+ *
+ * @tparam InlineSize - Bytes of inline storage
+ */
+template<size_t InlineSize = 64>
+class BasicTask
+{
+  static const size_t kAlign = alignof( void* );
+
+  template<typename F>
+  using StoredInline = std::integral_constant<bool, sizeof( F ) <= InlineSize && alignof( F ) <= kAlign &&
+                                                        std::is_nothrow_move_constructible<F>::value>;
+
+  template<typename F>
+  using EnableIfCallable = typename std::enable_if<!std::is_same<typename std::decay<F>::type, BasicTask>::value>::type;
+
+public:
+  BasicTask() noexcept : m_pOps{ nullptr }
+  { }
+
+  BasicTask( std::nullptr_t ) noexcept : m_pOps{ nullptr }
+  { }
+
+  template<typename F, typename = EnableIfCallable<F>>
+  BasicTask( F&& f ) : m_pOps{ nullptr }
+  {
+    using Fn = typename std::decay<F>::type;
+    if( !IsNull( f ) ) {
+      Store<Fn>( std::forward<F>( f ), StoredInline<Fn>() );
+    }
+  }
+
+  BasicTask( BasicTask&& other ) noexcept : m_pOps{ other.m_pOps }
+  {
+    if( m_pOps ) {
+      m_pOps->m_move( &m_storage, &other.m_storage );
+      other.m_pOps = nullptr;
+    }
+  }
+
+  BasicTask& operator=( BasicTask&& other ) noexcept
+  {
+    if( this != &other ) {
+      Reset();
+      if( other.m_pOps ) {
+        other.m_pOps->m_move( &m_storage, &other.m_storage );
+        m_pOps = other.m_pOps;
+        other.m_pOps = nullptr;
+      }
+    }
+    return *this;
+  }
+
+  BasicTask& operator=( std::nullptr_t ) noexcept
+  {
+    Reset();
+    return *this;
+  }
+
+  BasicTask( const BasicTask& ) = delete;
+  BasicTask& operator=( const BasicTask& ) = delete;
+
+  ~BasicTask()
+  {
+    Reset();
+  }
+
+  void operator()()
+  {
+    m_pOps->m_invoke( &m_storage );
+  }
+
+  explicit operator bool() const noexcept { return m_pOps != nullptr; }
+
+  /**
+   * @return true if an F is stored without a heap allocation
+   */
+  template<typename F>
+  static constexpr bool IsInline()
+  {
+    return StoredInline<typename std::decay<F>::type>::value;
+  }
+
+private:
+  struct Ops
+  {
+    void ( *m_invoke )( void* );
+    // Move constructs into dst and destroys src
+    void ( *m_move )( void* dst, void* src );
+    void ( *m_destroy )( void* );
+  };
+
+  template<typename F>
+  struct InlineOps
+  {
+    static void Invoke( void* p ) { ( *static_cast<F*>( p ) )(); }
+    static void Move( void* dst, void* src ) noexcept
+    {
+      new ( dst ) F( std::move( *static_cast<F*>( src ) ) );
+      static_cast<F*>( src )->~F();
+    }
+    static void Destroy( void* p ) noexcept { static_cast<F*>( p )->~F(); }
+    static constexpr Ops kOps = { &Invoke, &Move, &Destroy };
+  };
+
+  template<typename F>
+  struct HeapOps
+  {
+    static void Invoke( void* p ) { ( **static_cast<F**>( p ) )(); }
+    static void Move( void* dst, void* src ) noexcept { *static_cast<F**>( dst ) = *static_cast<F**>( src ); }
+    static void Destroy( void* p ) noexcept { delete *static_cast<F**>( p ); }
+    static constexpr Ops kOps = { &Invoke, &Move, &Destroy };
+  };
+
+  template<typename Fn, typename F>
+  void Store( F&& f, std::true_type )
+  {
+    new ( &m_storage ) Fn( std::forward<F>( f ) );
+    m_pOps = &InlineOps<Fn>::kOps;
+  }
+
+  template<typename Fn, typename F>
+  void Store( F&& f, std::false_type )
+  {
+    *reinterpret_cast<Fn**>( &m_storage ) = new Fn( std::forward<F>( f ) );
+    m_pOps = &HeapOps<Fn>::kOps;
+  }
+
+  void Reset() noexcept
+  {
+    if( m_pOps ) {
+      m_pOps->m_destroy( &m_storage );
+      m_pOps = nullptr;
+    }
+  }
+
+  // Empty function pointers and std::functions make an empty task
+  template<typename F>
+  static bool IsNull( const F& ) { return false; }
+  template<typename R, typename... Args>
+  static bool IsNull( R ( *pFn )( Args... ) ) { return pFn == nullptr; }
+  template<typename R, typename... Args>
+  static bool IsNull( const std::function<R( Args... )>& fn ) { return !fn; }
+
+  typename std::aligned_storage<InlineSize < sizeof( void* ) ? sizeof( void* ) : InlineSize, kAlign>::type m_storage;
+  const Ops* m_pOps;
+};
+
+template<size_t InlineSize>
+template<typename F>
+constexpr typename BasicTask<InlineSize>::Ops BasicTask<InlineSize>::InlineOps<F>::kOps;
+
+template<size_t InlineSize>
+template<typename F>
+constexpr typename BasicTask<InlineSize>::Ops BasicTask<InlineSize>::HeapOps<F>::kOps;
+
+/**
+ * The task type the dispatch threads, pools and strands queue.
+ */
+using Task = BasicTask<>;
+
+}
+
+#endif // __TASK_H__
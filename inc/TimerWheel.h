@@ -0,0 +1,315 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __TIMER_WHEEL_H__
+#define __TIMER_WHEEL_H__
+
+#include <ACancelable.h>
+#include <DispatchThread.h>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace CppUtils {
+
+/**
+ * BasicTimerWheel - hashed hierarchical timer wheel for large numbers of
+ * mostly canceled timeouts.
+ *
+ * Four levels of 256 slots each cover 2^32 ticks; a timer sits in the level
+ * that matches how far out it is and moves down a level each time the level
+ * below wraps around. Arm() and Cancel() are O(1) (a lock and a list splice),
+ * expiring is O(1) amortized per timer. Longer timeouts are parked in the top
+ * level until they come within range.
+ *
+ * The wheel ticks on the given dispatch thread through PostPeriodic() and the
+ * timer callbacks run there, up to one tick late. Arm() may be called from
+ * any thread. Timers still pending when the wheel is destroyed are dropped.
+ *
+ * @tparam DispatchThreadType - BasicDispatchThread instantiation that ticks
+ */
+template<typename DispatchThreadType>
+class BasicTimerWheel
+{
+public:
+  using Fn = typename DispatchThreadType::Fn;
+  using Clock = chrono::steady_clock;
+
+  /**
+   * @param thr - Must outlive the wheel
+   * @param tick - Resolution of the wheel
+   */
+  explicit BasicTimerWheel( DispatchThreadType& thr, Clock::duration tick = chrono::milliseconds( 1 ) ) :
+      m_spWheel{ make_shared<Wheel>( tick ) }
+  {
+    m_wpTicker = thr.PostPeriodic( tick, Ticker{ m_spWheel } );
+  }
+
+  ~BasicTimerWheel()
+  {
+    LOCK_AND_CANCEL( m_wpTicker );
+  }
+
+  BasicTimerWheel( const BasicTimerWheel& ) = delete;
+  BasicTimerWheel& operator=( const BasicTimerWheel& ) = delete;
+
+  /**
+   * Runs fn on the dispatch thread once timeout has passed.
+   * @return token to cancel the timer, empty if fn is empty. It expires once
+   *         the timer has fired or been canceled.
+   */
+  template<typename Rep, typename Period>
+  weak_ptr<ACancelableToken> Arm( const chrono::duration<Rep, Period>& timeout, Fn fn )
+  {
+    weak_ptr<ACancelableToken> retval;
+    if( fn ) {
+      retval = m_spWheel->Arm( Clock::now() + chrono::duration_cast<Clock::duration>( timeout ), std::move( fn ) );
+    }
+    return retval;
+  }
+
+  /**
+   * @return the number of armed timers
+   */
+  size_t Size() const
+  {
+    return m_spWheel->Size();
+  }
+
+private:
+  static const size_t kLevels = 4;
+  static const size_t kSlotBits = 8;
+  static const size_t kSlots = 1 << kSlotBits;
+  static const uint64_t kSlotMask = kSlots - 1;
+
+  class Wheel;
+
+  struct Link
+  {
+    Link* m_pPrev = nullptr;
+    Link* m_pNext = nullptr;
+  };
+
+  // A timer is its own token. While armed it keeps itself alive through
+  // m_spSelf, the slot lists only hold raw links.
+  class Timer : public Link, public ACancelableToken
+  {
+  public:
+    Timer( weak_ptr<Wheel> wpWheel, uint64_t expiry, Fn fn ) :
+        m_wpWheel{ std::move( wpWheel ) }, m_expiry{ expiry }, m_fn{ std::move( fn ) }
+    { }
+
+    virtual void Cancel()
+    {
+      auto spWheel = m_wpWheel.lock();
+      if( spWheel ) {
+        spWheel->Cancel( *this );
+      }
+    }
+
+    weak_ptr<Wheel> m_wpWheel;
+    uint64_t m_expiry;
+    Fn m_fn;
+    shared_ptr<Timer> m_spSelf;
+  };
+
+  class Wheel : public enable_shared_from_this<Wheel>
+  {
+  public:
+    explicit Wheel( Clock::duration tick ) : m_start{ Clock::now() }, m_tick{ tick }, m_now{ 0 }, m_size{ 0 }
+    {
+      for( auto& level : m_slots ) {
+        for( auto& head : level ) {
+          head.m_pPrev = head.m_pNext = &head;
+        }
+      }
+    }
+
+    ~Wheel()
+    {
+      for( auto& level : m_slots ) {
+        for( auto& head : level ) {
+          for( Link* pLink = head.m_pNext; pLink != &head; ) {
+            Timer* pTimer = static_cast<Timer*>( pLink );
+            pLink = pLink->m_pNext;
+            shared_ptr<Timer> spTimer = std::move( pTimer->m_spSelf );
+          }
+        }
+      }
+    }
+
+    weak_ptr<ACancelableToken> Arm( Clock::time_point deadline, Fn fn )
+    {
+      auto spTimer = make_shared<Timer>( this->shared_from_this(), ToTick( deadline ), std::move( fn ) );
+      lock_guard<mutex> lk( m_mtx );
+      if( spTimer->m_expiry <= m_now ) {
+        spTimer->m_expiry = m_now + 1;
+      }
+      spTimer->m_spSelf = spTimer;
+      Insert( *spTimer );
+      m_size++;
+      return spTimer;
+    }
+
+    void Cancel( Timer& timer )
+    {
+      shared_ptr<Timer> spTimer;
+      lock_guard<mutex> lk( m_mtx );
+      if( timer.m_spSelf ) {
+        Unlink( timer );
+        m_size--;
+        // Released after the lock, along with fn and whatever it captured
+        spTimer = std::move( timer.m_spSelf );
+      }
+    }
+
+    // Dispatch thread only
+    void Advance( Clock::time_point now )
+    {
+      {
+        lock_guard<mutex> lk( m_mtx );
+        uint64_t target = ToTick( now );
+        if( m_size == 0 && target > m_now ) {
+          m_now = target;
+        }
+        while( m_now < target ) {
+          Step();
+        }
+      }
+      for( auto& spTimer : m_expired ) {
+        spTimer->m_fn();
+      }
+      m_expired.clear();
+    }
+
+    size_t Size() const
+    {
+      lock_guard<mutex> lk( m_mtx );
+      return m_size;
+    }
+
+  private:
+    uint64_t ToTick( Clock::time_point tp ) const
+    {
+      auto elapsed = ( tp - m_start ).count();
+      return elapsed <= 0 ? 0 : ( elapsed + m_tick.count() - 1 ) / m_tick.count();
+    }
+
+    // Expects m_mtx to be held
+    void Insert( Timer& timer )
+    {
+      uint64_t expiry = timer.m_expiry < m_now ? m_now : timer.m_expiry;
+      uint64_t delta = expiry - m_now;
+      size_t level = 0;
+      while( level + 1 < kLevels && delta >= ( uint64_t( 1 ) << ( kSlotBits * ( level + 1 ) ) ) ) {
+        level++;
+      }
+      if( delta >= ( uint64_t( 1 ) << ( kSlotBits * kLevels ) ) ) {
+        // Out of range, wait in the furthest slot and be re-filed from there
+        expiry = m_now + ( uint64_t( 1 ) << ( kSlotBits * kLevels ) ) - 1;
+      }
+      Link& head = m_slots[ level ][ ( expiry >> ( kSlotBits * level ) ) & kSlotMask ];
+      timer.m_pPrev = head.m_pPrev;
+      timer.m_pNext = &head;
+      head.m_pPrev->m_pNext = &timer;
+      head.m_pPrev = &timer;
+    }
+
+    static void Unlink( Link& link )
+    {
+      link.m_pPrev->m_pNext = link.m_pNext;
+      link.m_pNext->m_pPrev = link.m_pPrev;
+      link.m_pPrev = link.m_pNext = nullptr;
+    }
+
+    // Expects m_mtx to be held
+    void Step()
+    {
+      m_now++;
+      for( size_t level = 1; level < kLevels && ( m_now & ( ( uint64_t( 1 ) << ( kSlotBits * level ) ) - 1 ) ) == 0; level++ ) {
+        Link& head = m_slots[ level ][ ( m_now >> ( kSlotBits * level ) ) & kSlotMask ];
+        Link pending;
+        Splice( head, pending );
+        while( pending.m_pNext != &pending ) {
+          Timer& timer = static_cast<Timer&>( *pending.m_pNext );
+          Unlink( timer );
+          Insert( timer );
+        }
+      }
+      Link& head = m_slots[ 0 ][ m_now & kSlotMask ];
+      while( head.m_pNext != &head ) {
+        Timer& timer = static_cast<Timer&>( *head.m_pNext );
+        Unlink( timer );
+        m_size--;
+        m_expired.push_back( std::move( timer.m_spSelf ) );
+      }
+    }
+
+    // Moves every link of from to the empty list to
+    static void Splice( Link& from, Link& to )
+    {
+      if( from.m_pNext == &from ) {
+        to.m_pPrev = to.m_pNext = &to;
+        return;
+      }
+      to.m_pNext = from.m_pNext;
+      to.m_pPrev = from.m_pPrev;
+      to.m_pNext->m_pPrev = &to;
+      to.m_pPrev->m_pNext = &to;
+      from.m_pPrev = from.m_pNext = &from;
+    }
+
+    const Clock::time_point m_start;
+    const Clock::duration m_tick;
+    mutable mutex m_mtx;
+    Link m_slots[ kLevels ][ kSlots ];
+    uint64_t m_now;
+    size_t m_size;
+    vector<shared_ptr<Timer>> m_expired;
+  };
+
+  struct Ticker
+  {
+    weak_ptr<Wheel> m_wpWheel;
+
+    void operator()()
+    {
+      auto spWheel = m_wpWheel.lock();
+      if( spWheel ) {
+        spWheel->Advance( Clock::now() );
+      }
+    }
+  };
+
+  shared_ptr<Wheel> m_spWheel;
+  weak_ptr<ACancelableToken> m_wpTicker;
+};
+
+using TimerWheel = BasicTimerWheel<DispatchThread>;
+
+}
+
+#endif // __TIMER_WHEEL_H__
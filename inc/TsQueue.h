@@ -24,42 +24,310 @@
 #ifndef __TS_QUEUE_H__
 #define __TS_QUEUE_H__
 
+#include <SegmentedDeque.h>
+#include <WaitStrategy.h>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <queue>
+#include <utility>
 
 using namespace std;
 
 namespace CppUtils {
   
-template<typename T>
+/**
+ * TsQueue - unbounded thread safe queue.
+ *
+ * Once Close() is called every EnQueue fails and every waiter wakes up.
+ * Consumers keep receiving the items that are still queued, after that the
+ * dequeue calls fail instead of blocking.
+ *
+ * @tparam WaitStrategy - What a consumer does while the queue is empty, see
+ *                        WaitStrategy.h. Spinning strategies poll a lock-free
+ *                        item count so they don't hammer the mutex.
+ * @tparam Container - Underlying std::queue container.
+ */
+template<typename T, typename WaitStrategy = BlockingWait, typename Container = deque<T>>
 class TsQueue
 {
 private:
   condition_variable m_cond;
-  mutex m_mtx;
-  queue<T> m_q;
+  mutable mutex m_mtx;
+  queue<T, Container> m_q;
+  // Mirrors of m_q.size() and the closed state for spinning consumers,
+  // only written with m_mtx held
+  atomic<size_t> m_size{ 0 };
+  atomic<bool> m_closed{ false };
   
 public:
-  void EnQueue( T t )
+  using ValueType = T;
+
+  /**
+   * @return false if the queue is closed
+   */
+  bool EnQueue( const T& t )
+  {
+    return Emplace( t );
+  }
+
+  bool EnQueue( T&& t )
+  {
+    return Emplace( std::move( t ) );
+  }
+
+  /**
+   * Constructs the item in place from args.
+   * @return false if the queue is closed
+   */
+  template<typename... Args>
+  bool Emplace( Args&&... args )
   {
     unique_lock<mutex> lk(m_mtx);
-    m_q.push( t );
+    if( m_closed ) {
+      return false;
+    }
+    m_q.emplace( std::forward<Args>( args )... );
+    UpdateSize();
     lk.unlock();
-    m_cond.notify_one();
+    if( WaitStrategy::kMayPark ) {
+      m_cond.notify_one();
+    }
+    return true;
   }
   
+  /**
+   * Blocks until an item is available and moves it out of the queue.
+   * Returns a value initialized T once the queue is closed and drained, use
+   * DeQueue( T& ) to tell the difference.
+   */
   T DeQueue()
+  {
+    T t{};
+    DeQueue( t );
+    return t;
+  }
+
+  /**
+   * Blocks until an item is available and moves it to out.
+   * @return false once the queue is closed and drained
+   */
+  bool DeQueue( T& out )
   {
     unique_lock<mutex> lk( m_mtx );
-    if( m_q.empty() ){
-      m_cond.wait( lk, [=](){ return !m_q.empty(); } );
+    WaitNotEmpty( lk );
+    return Pop( out );
+  }
+
+  /**
+   * @return false if the queue is empty
+   */
+  bool TryDeQueue( T& out )
+  {
+    // Pollers of an empty queue stay off the mutex
+    if( !IsReady() ) {
+      return false;
+    }
+    unique_lock<mutex> lk( m_mtx );
+    return Pop( out );
+  }
+
+  /**
+   * @return false if nothing arrived before the deadline or the queue is
+   *         closed and drained
+   */
+  template<typename Clock, typename Duration>
+  bool DeQueueUntil( T& out, const chrono::time_point<Clock, Duration>& deadline )
+  {
+    unique_lock<mutex> lk( m_mtx );
+    WaitNotEmptyUntil( lk, deadline );
+    return Pop( out );
+  }
+
+  template<typename Rep, typename Period>
+  bool DeQueueFor( T& out, const chrono::duration<Rep, Period>& timeout )
+  {
+    return DeQueueUntil( out, chrono::steady_clock::now() + timeout );
+  }
+
+  /**
+   * Rejects further EnQueues and wakes up every waiter.
+   */
+  void Close()
+  {
+    unique_lock<mutex> lk( m_mtx );
+    m_closed.store( true, memory_order_release );
+    lk.unlock();
+    m_cond.notify_all();
+  }
+
+  bool IsClosed() const
+  {
+    return m_closed.load( memory_order_acquire );
+  }
+
+  /**
+   * Pushes [first, last) with a single lock acquisition and a single notify.
+   * @return false if the queue is closed
+   */
+  template<typename InputIt>
+  bool EnQueueRange( InputIt first, InputIt last )
+  {
+    size_t count = 0;
+    unique_lock<mutex> lk( m_mtx );
+    if( m_closed ) {
+      return false;
+    }
+    for( ; first != last; ++first, ++count ) {
+      m_q.push( *first );
+    }
+    UpdateSize();
+    lk.unlock();
+    if( !WaitStrategy::kMayPark ) {
+      return true;
+    }
+    if( count > 1 ) {
+      m_cond.notify_all();
+    } else if( count == 1 ) {
+      m_cond.notify_one();
     }
-    T t = m_q.front();
+    return true;
+  }
+
+  /**
+   * Blocks until the queue is not empty and then hands every queued item to
+   * out. The internal container is swapped out under one lock acquisition,
+   * so producers are only held off for the swap.
+   *
+   * @return the number of items written to out, 0 once the queue is closed
+   *         and drained
+   */
+  template<typename OutputIt>
+  size_t DeQueueAll( OutputIt out )
+  {
+    queue<T, Container> batch;
+    unique_lock<mutex> lk( m_mtx );
+    WaitNotEmpty( lk );
+    m_q.swap( batch );
+    UpdateSize();
+    lk.unlock();
+    return Drain( batch, out );
+  }
+
+  /**
+   * Same as DeQueueAll() but hands at most n items to out.
+   *
+   * @return the number of items written to out
+   */
+  template<typename OutputIt>
+  size_t DeQueueUpTo( size_t n, OutputIt out )
+  {
+    if( n == 0 ) {
+      return 0;
+    }
+    queue<T, Container> batch;
+    unique_lock<mutex> lk( m_mtx );
+    WaitNotEmpty( lk );
+    if( m_q.size() <= n ) {
+      m_q.swap( batch );
+    } else {
+      for( size_t i = 0; i < n; i++ ) {
+        batch.push( std::move( m_q.front() ) );
+        m_q.pop();
+      }
+    }
+    UpdateSize();
+    lk.unlock();
+    return Drain( batch, out );
+  }
+
+private:
+  // Expects m_mtx to be held
+  bool Pop( T& out )
+  {
+    if( m_q.empty() ) {
+      return false;
+    }
+    out = std::move( m_q.front() );
     m_q.pop();
-    return t;
+    UpdateSize();
+    return true;
+  }
+
+  // Expects m_mtx to be held
+  void UpdateSize()
+  {
+    m_size.store( m_q.size(), memory_order_release );
+  }
+
+  bool IsReady() const
+  {
+    return m_size.load( memory_order_acquire ) != 0 || m_closed.load( memory_order_acquire );
+  }
+
+  /**
+   * Lets the wait strategy poll with lk released. Returns with lk held.
+   * @return true if the queue looked ready, false if the strategy wants to
+   *         park or the deadline passed
+   */
+  template<typename Clock, typename Duration>
+  bool SpinUntilReady( unique_lock<mutex>& lk, const chrono::time_point<Clock, Duration>* pDeadline )
+  {
+    if( !WaitStrategy::kMaySpin ) {
+      return false;
+    }
+    typename WaitStrategy::Waiter waiter;
+    bool retval = false;
+    lk.unlock();
+    while( !( retval = IsReady() ) && ( !pDeadline || Clock::now() < *pDeadline ) && waiter.Spin() );
+    lk.lock();
+    return retval;
+  }
+
+  // Expects lk to hold m_mtx
+  void WaitNotEmpty( unique_lock<mutex>& lk )
+  {
+    while( m_q.empty() && !m_closed ) {
+      if( !SpinUntilReady( lk, (chrono::steady_clock::time_point*)nullptr ) ) {
+        m_cond.wait( lk, [this](){ return !m_q.empty() || m_closed; } );
+      }
+    }
+  }
+
+  // Expects lk to hold m_mtx
+  template<typename Clock, typename Duration>
+  void WaitNotEmptyUntil( unique_lock<mutex>& lk, const chrono::time_point<Clock, Duration>& deadline )
+  {
+    while( m_q.empty() && !m_closed ) {
+      if( !SpinUntilReady( lk, &deadline ) ) {
+        m_cond.wait_until( lk, deadline, [this](){ return !m_q.empty() || m_closed; } );
+        return;
+      }
+    }
+  }
+
+  template<typename OutputIt>
+  static size_t Drain( queue<T, Container>& batch, OutputIt& out )
+  {
+    size_t count = batch.size();
+    for( ; !batch.empty(); batch.pop() ) {
+      *out = std::move( batch.front() );
+      ++out;
+    }
+    return count;
   }
 };
+
+/**
+ * Unbounded TsQueue built from linked fixed size segments that are recycled
+ * through a small free-list, so steady state operation does not allocate.
+ * Prefer DeQueue()/TryDeQueue() for draining, DeQueueAll() hands the
+ * segments to the caller's batch.
+ */
+template<typename T, typename WaitStrategy = BlockingWait>
+using SegmentedQueue = TsQueue<T, WaitStrategy, SegmentedDeque<T>>;
   
 }
 
-#endif //__TS_QUEUE_H__
\ No newline at end of file
+#endif //__TS_QUEUE_H__
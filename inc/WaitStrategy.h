@@ -0,0 +1,153 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef __WAIT_STRATEGY_H__
+#define __WAIT_STRATEGY_H__
+
+#include <CpuUtils.h>
+#include <thread>
+
+namespace CppUtils {
+
+/**
+ * Wait strategies decide what a thread does while its queue is empty (or
+ * while a bounded queue is full). Every blocking call creates a Waiter and
+ * calls Spin() between polls of the queue. When Spin() returns false the
+ * thread parks until it is notified.
+ *
+ * kMaySpin  - false if Spin() always returns false, lets the queue skip the
+ *             polling loop altogether.
+ * kMayPark  - false if Spin() never returns false, lets producers skip the
+ *             wake up of parked consumers altogether.
+ *
+ * Pick per queue: the spinning strategies trade CPU for wake up latency.
+ */
+
+/**
+ * Polls in a tight loop. Lowest latency, burns a core while idle.
+ */
+struct BusySpinWait
+{
+  static const bool kMaySpin = true;
+  static const bool kMayPark = false;
+
+  class Waiter
+  {
+  public:
+    bool Spin() { return true; }
+  };
+};
+
+/**
+ * Polls with a CPU pause hint between polls, which is kinder to a sibling
+ * hyper-thread and saves some power. Still burns a core while idle.
+ */
+struct SpinPauseWait
+{
+  static const bool kMaySpin = true;
+  static const bool kMayPark = false;
+
+  class Waiter
+  {
+  public:
+    bool Spin()
+    {
+      CPPUTILS_CPU_RELAX();
+      return true;
+    }
+  };
+};
+
+/**
+ * Gives up the time slice between polls. The core is shared with other
+ * runnable threads, but an idle consumer still shows up as busy.
+ */
+struct YieldWait
+{
+  static const bool kMaySpin = true;
+  static const bool kMayPark = false;
+
+  class Waiter
+  {
+  public:
+    bool Spin()
+    {
+      std::this_thread::yield();
+      return true;
+    }
+  };
+};
+
+/**
+ * Spins SpinCount times, then yields YieldCount times and then parks.
+ * Catches items that arrive shortly after the queue drained without paying
+ * for a wake up, without burning a core while the queue stays idle.
+ */
+template<unsigned SpinCount = 64, unsigned YieldCount = 0>
+struct SpinThenParkWait
+{
+  static const bool kMaySpin = true;
+  static const bool kMayPark = true;
+
+  class Waiter
+  {
+  public:
+    bool Spin()
+    {
+      if( m_count < SpinCount ) {
+        m_count++;
+        CPPUTILS_CPU_RELAX();
+        return true;
+      }
+      if( m_count < SpinCount + YieldCount ) {
+        m_count++;
+        std::this_thread::yield();
+        return true;
+      }
+      return false;
+    }
+
+  private:
+    unsigned m_count = 0;
+  };
+};
+
+/**
+ * Parks straight away. No CPU while idle, every wake up costs a futex call
+ * and a context switch.
+ */
+struct BlockingWait
+{
+  static const bool kMaySpin = false;
+  static const bool kMayPark = true;
+
+  class Waiter
+  {
+  public:
+    bool Spin() { return false; }
+  };
+};
+
+}
+
+#endif // __WAIT_STRATEGY_H__
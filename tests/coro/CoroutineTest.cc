@@ -0,0 +1,270 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <Coroutine.h>
+#include <DispatchPool.h>
+#include <DispatchThread.h>
+#include <Strand.h>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace CppUtils;
+
+namespace {
+
+Coro::Task<thread::id> HopTo( DispatchThread& thr )
+{
+  bool scheduled = co_await thr.Schedule();
+  EXPECT_TRUE( scheduled );
+  co_return this_thread::get_id();
+}
+
+using IntQueue = Coro::AsyncQueue<int, DispatchThread>;
+
+Coro::Task<int> PopTwo( IntQueue& q )
+{
+  int a = co_await q.Pop();
+  int b = 0;
+  bool got = co_await q.Pop( b );
+  co_return got ? a + b : -1;
+}
+
+Coro::Task<int> Add( int a, int b )
+{
+  co_return a + b;
+}
+
+Coro::Task<int> Chain()
+{
+  int x = co_await Add( 1, 2 );
+  int y = co_await Add( x, 3 );
+  co_return y;
+}
+
+Coro::Task<void> Throws()
+{
+  throw runtime_error( "boom" );
+  co_return;
+}
+
+Coro::Task<bool> Catches()
+{
+  try {
+    co_await Throws();
+  } catch( const runtime_error& ) {
+    co_return true;
+  }
+  co_return false;
+}
+
+atomic<int> g_allocations{ 0 };
+atomic<int> g_deallocations{ 0 };
+
+template<typename T>
+struct CountingAllocator
+{
+  using value_type = T;
+
+  CountingAllocator() = default;
+  template<typename U>
+  CountingAllocator( const CountingAllocator<U>& ) { }
+
+  T* allocate( size_t n )
+  {
+    ++g_allocations;
+    return std::allocator<T>().allocate( n );
+  }
+
+  void deallocate( T* p, size_t n )
+  {
+    ++g_deallocations;
+    std::allocator<T>().deallocate( p, n );
+  }
+
+  bool operator==( const CountingAllocator& ) const { return true; }
+  bool operator!=( const CountingAllocator& ) const { return false; }
+};
+
+Coro::Task<int> Allocated( allocator_arg_t, CountingAllocator<char>, int value )
+{
+  co_return value * 2;
+}
+
+Coro::Task<int> AllocatedByRef( allocator_arg_t, const CountingAllocator<char>&, const string& value )
+{
+  co_return static_cast<int>( value.size() );
+}
+
+struct Worker
+{
+  Coro::Task<int> Allocated( allocator_arg_t, CountingAllocator<char>, int value )
+  {
+    co_return value + m_offset;
+  }
+
+  int m_offset = 10;
+};
+
+}
+
+TEST( CoroutineShould, HopOntoADispatchThread )
+{
+  DispatchThread thr;
+  thread::id ran = Coro::SyncWait( HopTo( thr ) );
+  EXPECT_NE( ran, this_thread::get_id() );
+  EXPECT_TRUE( thr.DispatchSync( [ran]() { return this_thread::get_id() == ran; } ) );
+}
+
+TEST( CoroutineShould, HopOntoAPoolAndAStrand )
+{
+  DispatchPool pool( 2 );
+  Strand strand( pool );
+  auto hop = []( DispatchPool& pool, Strand& strand ) -> Coro::Task<bool> {
+    bool onPool = co_await pool.Schedule();
+    bool isWorker = pool.IsWorkerThread();
+    bool onStrand = co_await strand.Schedule();
+    co_return onPool && isWorker && onStrand && strand.IsCurrent();
+  };
+  EXPECT_TRUE( Coro::SyncWait( hop( pool, strand ) ) );
+}
+
+TEST( CoroutineShould, NotResumeOnAKilledThread )
+{
+  DispatchThread thr;
+  thr.Kill();
+  auto hop = []( DispatchThread& thr ) -> Coro::Task<bool> {
+    bool scheduled = co_await thr.Schedule();
+    co_return scheduled;
+  };
+  EXPECT_FALSE( Coro::SyncWait( hop( thr ) ) );
+}
+
+TEST( CoroutineShould, PopAnItemAlreadyQueued )
+{
+  DispatchThread thr;
+  IntQueue q( thr );
+  q.EnQueue( 4 );
+  q.EnQueue( 5 );
+  EXPECT_EQ( 9, Coro::SyncWait( PopTwo( q ) ) );
+}
+
+TEST( CoroutineShould, SuspendUntilAnItemIsPushed )
+{
+  DispatchThread thr;
+  IntQueue q( thr );
+  thread producer( [&q]() {
+    this_thread::sleep_for( chrono::milliseconds( 20 ) );
+    q.EnQueue( 1 );
+    this_thread::sleep_for( chrono::milliseconds( 20 ) );
+    q.EnQueue( 2 );
+  } );
+  EXPECT_EQ( 3, Coro::SyncWait( PopTwo( q ) ) );
+  producer.join();
+}
+
+TEST( CoroutineShould, ServeEverySuspendedPopper )
+{
+  DispatchThread thr;
+  IntQueue q( thr );
+  vector<thread> consumers;
+  vector<int> got( 3, 0 );
+  for( int i = 0; i < 3; i++ ) {
+    consumers.emplace_back( [&q, &got, i]() {
+      auto pop = []( IntQueue& q ) -> Coro::Task<int> { co_return co_await q.Pop(); };
+      got[i] = Coro::SyncWait( pop( q ) );
+    } );
+  }
+  this_thread::sleep_for( chrono::milliseconds( 50 ) );
+  q.EnQueue( 1 );
+  q.EnQueue( 2 );
+  q.EnQueue( 4 );
+  for( auto& t : consumers ) {
+    t.join();
+  }
+  EXPECT_EQ( 7, got[0] + got[1] + got[2] );
+  int left;
+  EXPECT_FALSE( q.TryDeQueue( left ) );
+}
+
+TEST( CoroutineShould, WakeSuspendedPoppersOnClose )
+{
+  DispatchThread thr;
+  IntQueue q( thr );
+  auto pop = []( IntQueue& q ) -> Coro::Task<bool> {
+    int out = 0;
+    co_return co_await q.Pop( out );
+  };
+  thread closer( [&q]() {
+    this_thread::sleep_for( chrono::milliseconds( 20 ) );
+    q.Close();
+  } );
+  EXPECT_FALSE( Coro::SyncWait( pop( q ) ) );
+  closer.join();
+}
+
+TEST( CoroutineShould, ResumePoppersOnTheExecutor )
+{
+  DispatchThread thr;
+  IntQueue q( thr );
+  auto pop = []( IntQueue& q ) -> Coro::Task<thread::id> {
+    co_await q.Pop();
+    co_return this_thread::get_id();
+  };
+  thread producer( [&q]() {
+    this_thread::sleep_for( chrono::milliseconds( 20 ) );
+    q.EnQueue( 1 );
+  } );
+  thread::id resumedOn = Coro::SyncWait( pop( q ) );
+  thread::id producerId = producer.get_id();
+  producer.join();
+  EXPECT_NE( producerId, resumedOn );
+  EXPECT_EQ( thr.Submit( []() { return this_thread::get_id(); } ).Get(), resumedOn );
+}
+
+TEST( CoroutineShould, ChainTasks )
+{
+  EXPECT_EQ( 6, Coro::SyncWait( Chain() ) );
+}
+
+TEST( CoroutineShould, PropagateExceptions )
+{
+  EXPECT_TRUE( Coro::SyncWait( Catches() ) );
+  EXPECT_THROW( Coro::SyncWait( Throws() ), runtime_error );
+}
+
+TEST( CoroutineShould, AllocateFramesFromTheGivenAllocator )
+{
+  g_allocations = g_deallocations = 0;
+  EXPECT_EQ( 42, Coro::SyncWait( Allocated( allocator_arg, CountingAllocator<char>(), 21 ) ) );
+  Worker worker;
+  EXPECT_EQ( 15, Coro::SyncWait( worker.Allocated( allocator_arg, CountingAllocator<char>(), 5 ) ) );
+  CountingAllocator<char> alloc;
+  EXPECT_EQ( 3, Coro::SyncWait( AllocatedByRef( allocator_arg, alloc, "abc" ) ) );
+  EXPECT_EQ( 3, g_allocations.load() );
+  EXPECT_EQ( 3, g_deallocations.load() );
+}
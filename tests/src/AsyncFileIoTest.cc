@@ -0,0 +1,209 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <AsyncFileIo.h>
+#include <DispatchThread.h>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <future>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace CppUtils;
+
+namespace {
+struct TempFile
+{
+  TempFile()
+  {
+    char path[] = "/tmp/AsyncFileIoTestXXXXXX";
+    m_fd = mkstemp( path );
+    EXPECT_GE( m_fd, 0 );
+    unlink( path );
+  }
+  ~TempFile() { close( m_fd ); }
+
+  int m_fd;
+};
+
+// Waits for a completion and checks it ran on the completion thread
+struct Result
+{
+  Result( DispatchThread& thr ) : m_thr( thr )
+  { }
+
+  AAsyncFileIo::Callback Callback()
+  {
+    return [this]( ssize_t result ) { m_result.set_value( m_thr.IsDispatchThread() ? result : -9999 ); };
+  }
+
+  ssize_t Get()
+  {
+    auto fut = m_result.get_future();
+    EXPECT_EQ( future_status::ready, fut.wait_for( chrono::seconds( 5 ) ) );
+    return fut.get();
+  }
+
+  DispatchThread& m_thr;
+  promise<ssize_t> m_result;
+};
+
+using MakeFn = unique_ptr<AAsyncFileIo> ( * )( DispatchThread&, const vector<iovec>& );
+
+unique_ptr<AAsyncFileIo> MakeDefault( DispatchThread& thr, const vector<iovec>& buffers )
+{
+  return MakeAsyncFileIo( thr, buffers );
+}
+
+unique_ptr<AAsyncFileIo> MakeThreadPool( DispatchThread& thr, const vector<iovec>& )
+{
+  return unique_ptr<AAsyncFileIo>(
+    new ThreadPoolFileIo( [&thr]( Task task ) { return thr.PostToDispatch( std::move( task ) ); } ) );
+}
+
+class AsyncFileIoShould : public ::testing::TestWithParam<MakeFn>
+{ };
+}
+
+TEST_P( AsyncFileIoShould, WriteSyncAndReadBackOnTheCompletionThread )
+{
+  DispatchThread thr;
+  TempFile file;
+  auto spIo = GetParam()( thr, vector<iovec>() );
+  const string text = "hello, async world";
+  Result written( thr );
+  ASSERT_TRUE( spIo->Write( file.m_fd, text.data(), text.size(), 0, written.Callback() ) );
+  ASSERT_EQ( static_cast<ssize_t>( text.size() ), written.Get() );
+  Result synced( thr );
+  ASSERT_TRUE( spIo->Fsync( file.m_fd, synced.Callback() ) );
+  ASSERT_EQ( 0, synced.Get() );
+  char buf[ 64 ] = {};
+  Result read( thr );
+  ASSERT_TRUE( spIo->Read( file.m_fd, buf, sizeof( buf ), 7, read.Callback() ) );
+  ASSERT_EQ( static_cast<ssize_t>( text.size() - 7 ), read.Get() );
+  ASSERT_STREQ( "async world", buf );
+}
+
+TEST_P( AsyncFileIoShould, UseRegisteredBuffers )
+{
+  DispatchThread thr;
+  TempFile file;
+  vector<char> buffer( 8192, 'x' );
+  auto spIo = GetParam()( thr, vector<iovec>{ iovec{ buffer.data(), buffer.size() } } );
+  Result written( thr );
+  ASSERT_TRUE( spIo->WriteFixed( file.m_fd, 0, buffer.data(), 4096, 0, written.Callback() ) );
+  ASSERT_EQ( 4096, written.Get() );
+  memset( buffer.data(), 0, buffer.size() );
+  Result read( thr );
+  ASSERT_TRUE( spIo->ReadFixed( file.m_fd, 0, buffer.data() + 4096, 4096, 0, read.Callback() ) );
+  ASSERT_EQ( 4096, read.Get() );
+  ASSERT_EQ( 'x', buffer[ 4096 ] );
+  ASSERT_EQ( 'x', buffer[ 8191 ] );
+}
+
+TEST_P( AsyncFileIoShould, ReportErrorsAsNegativeErrno )
+{
+  DispatchThread thr;
+  auto spIo = GetParam()( thr, vector<iovec>() );
+  char buf[ 16 ];
+  Result read( thr );
+  ASSERT_TRUE( spIo->Read( -1, buf, sizeof( buf ), 0, read.Callback() ) );
+  ASSERT_EQ( -EBADF, read.Get() );
+}
+
+TEST_P( AsyncFileIoShould, RejectRequestsLargerThanTheLimit )
+{
+  DispatchThread thr;
+  TempFile file;
+  auto spIo = GetParam()( thr, vector<iovec>() );
+  // Never touched, the request fails before it is issued
+  char buf[ 16 ];
+  size_t tooLarge = static_cast<size_t>( AAsyncFileIo::kMaxIoSize ) + 1;
+  Result read( thr );
+  ASSERT_TRUE( spIo->Read( file.m_fd, buf, tooLarge, 0, read.Callback() ) );
+  ASSERT_EQ( -EINVAL, read.Get() );
+  Result written( thr );
+  ASSERT_TRUE( spIo->Write( file.m_fd, buf, tooLarge, 0, written.Callback() ) );
+  ASSERT_EQ( -EINVAL, written.Get() );
+  Result fixed( thr );
+  ASSERT_TRUE( spIo->WriteFixed( file.m_fd, 0, buf, tooLarge, 0, fixed.Callback() ) );
+  ASSERT_EQ( -EINVAL, fixed.Get() );
+}
+
+TEST_P( AsyncFileIoShould, CompleteManyConcurrentWrites )
+{
+  DispatchThread thr;
+  TempFile file;
+  const int count = 2000;
+  vector<uint32_t> values( count );
+  atomic<int> completed{ 0 };
+  atomic<int> failed{ 0 };
+  promise<void> done;
+  {
+    auto spIo = GetParam()( thr, vector<iovec>() );
+    vector<thread> writers;
+    for( int w = 0; w < 4; w++ ) {
+      writers.emplace_back( [&, w]() {
+        for( int i = w; i < count; i += 4 ) {
+          values[ i ] = i;
+          spIo->Write( file.m_fd, &values[ i ], sizeof( uint32_t ), i * sizeof( uint32_t ), [&]( ssize_t result ) {
+            if( result != sizeof( uint32_t ) ) {
+              failed++;
+            }
+            if( ++completed == count ) {
+              done.set_value();
+            }
+          } );
+        }
+      } );
+    }
+    for( auto& t : writers ) {
+      t.join();
+    }
+    ASSERT_EQ( future_status::ready, done.get_future().wait_for( chrono::seconds( 10 ) ) );
+  }
+  ASSERT_EQ( 0, failed.load() );
+  vector<uint32_t> readBack( count );
+  ASSERT_EQ( static_cast<ssize_t>( count * sizeof( uint32_t ) ), pread( file.m_fd, readBack.data(), count * sizeof( uint32_t ), 0 ) );
+  ASSERT_EQ( values, readBack );
+}
+
+INSTANTIATE_TEST_CASE_P( Backends, AsyncFileIoShould, ::testing::Values( &MakeDefault, &MakeThreadPool ) );
+
+TEST( MakeAsyncFileIoShould, PickIoUringWhenTheKernelHasIt )
+{
+  DispatchThread thr;
+  bool haveUring = false;
+#if defined( CPPUTILS_HAS_IO_URING )
+  try {
+    UringFileIo probe( []( Task ) { return false; } );
+    haveUring = true;
+  } catch( const system_error& ) {
+  }
+#endif
+  ASSERT_STREQ( haveUring ? "io_uring" : "thread pool", MakeAsyncFileIo( thr )->Backend() );
+}
@@ -0,0 +1,203 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <ChaseLevDeque.h>
+#include <DispatchPool.h>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace CppUtils;
+using namespace std;
+
+TEST( ChaseLevDequeShould, PopLifoAndStealFifo )
+{
+  ChaseLevDeque<int> dq( 2 );
+  for( int i = 0; i < 10; i++ ) {
+    dq.Push( i );
+  }
+  ASSERT_EQ( 10u, dq.Size() );
+  int val = -1;
+  ASSERT_TRUE( dq.Pop( val ) );
+  ASSERT_EQ( 9, val );
+  ASSERT_TRUE( dq.Steal( val ) );
+  ASSERT_EQ( 0, val );
+  ASSERT_TRUE( dq.Steal( val ) );
+  ASSERT_EQ( 1, val );
+  while( dq.Pop( val ) );
+  ASSERT_TRUE( dq.Empty() );
+  ASSERT_FALSE( dq.Steal( val ) );
+}
+
+TEST( ChaseLevDequeShould, HandOutEveryItemExactlyOnceUnderStealing )
+{
+  const int count = 200000;
+  const int thieves = 3;
+  ChaseLevDeque<int> dq( 16 );
+  vector<atomic<int>> seen( count );
+  for( auto& s : seen ) {
+    s = 0;
+  }
+  atomic<bool> done{ false };
+  vector<thread> threads;
+  for( int t = 0; t < thieves; t++ ) {
+    threads.emplace_back( [&]() {
+      int val = 0;
+      while( !done || !dq.Empty() ) {
+        if( dq.Steal( val ) ) {
+          seen[ val ]++;
+        }
+      }
+    } );
+  }
+  int val = 0;
+  for( int i = 0; i < count; i++ ) {
+    dq.Push( i );
+    if( i % 3 == 0 && dq.Pop( val ) ) {
+      seen[ val ]++;
+    }
+  }
+  while( dq.Pop( val ) ) {
+    seen[ val ]++;
+  }
+  done = true;
+  for( auto& t : threads ) {
+    t.join();
+  }
+  bool once = true;
+  for( auto& s : seen ) {
+    once = once && s == 1;
+  }
+  ASSERT_TRUE( once );
+}
+
+TEST( DispatchPoolShould, RunTasksOnSeveralWorkersAtOnce )
+{
+  DispatchPool pool( 4 );
+  ASSERT_EQ( 4u, pool.ThreadCount() );
+  atomic<int> started{ 0 };
+  atomic<int> finished{ 0 };
+  for( int i = 0; i < 4; i++ ) {
+    pool.PostToDispatch( [&started, &finished]() {
+      started++;
+      // Only returns if all four run concurrently
+      while( started < 4 ) {
+        this_thread::yield();
+      }
+      finished++;
+    } );
+  }
+  pool.Kill();
+  ASSERT_EQ( 4, finished.load() );
+}
+
+TEST( DispatchPoolShould, RunTasksPostedFromInsideWorkers )
+{
+  const int fanOut = 1000;
+  atomic<int> leaves{ 0 };
+  atomic<bool> onWorker{ true };
+  DispatchPool pool( 4 );
+  promise<void> done;
+  pool.PostToDispatch( [&]() {
+    for( int i = 0; i < fanOut; i++ ) {
+      pool.PostToDispatch( [&]() {
+        onWorker = onWorker && pool.IsWorkerThread();
+        if( ++leaves == fanOut ) {
+          done.set_value();
+        }
+      } );
+    }
+  } );
+  ASSERT_EQ( future_status::ready, done.get_future().wait_for( chrono::seconds( 5 ) ) );
+  ASSERT_TRUE( onWorker.load() );
+  ASSERT_FALSE( pool.IsWorkerThread() );
+}
+
+TEST( DispatchPoolShould, RunQueuedTasksAndRejectNewOnesWhenKilled )
+{
+  const int producers = 4;
+  const int count = 20000;
+  atomic<int> runs{ 0 };
+  DispatchPool pool( 3 );
+  vector<thread> threads;
+  for( int p = 0; p < producers; p++ ) {
+    threads.emplace_back( [&]() {
+      for( int i = 0; i < count; i++ ) {
+        pool.PostToDispatch( [&runs]() { runs++; } );
+      }
+    } );
+  }
+  for( auto& t : threads ) {
+    t.join();
+  }
+  pool.Kill();
+  ASSERT_EQ( producers * count, runs.load() );
+  ASSERT_FALSE( pool.PostToDispatch( [&runs]() { runs++; } ) );
+}
+
+#if defined( __linux__ )
+TEST( DispatchPoolShould, NameAndPinEveryWorker )
+{
+  DispatchThreadOptions options;
+  options.m_name = "pool";
+  options.m_cpus = { 0 };
+  DispatchPool pool( 3, options );
+  atomic<int> started{ 0 };
+  mutex mtx;
+  set<string> names;
+  bool pinned = true;
+  for( int i = 0; i < 3; i++ ) {
+    pool.PostToDispatch( [&]() {
+      char name[ 16 ] = {};
+      cpu_set_t cpus;
+      pthread_getname_np( pthread_self(), name, sizeof( name ) );
+      pthread_getaffinity_np( pthread_self(), sizeof( cpus ), &cpus );
+      {
+        lock_guard<mutex> lk( mtx );
+        names.insert( name );
+        pinned = pinned && CPU_COUNT( &cpus ) == 1 && CPU_ISSET( 0, &cpus );
+      }
+      // Holds the worker until all three have a task
+      started++;
+      while( started < 3 ) {
+        this_thread::yield();
+      }
+    } );
+  }
+  pool.Kill();
+  ASSERT_EQ( ( set<string>{ "pool-0", "pool-1", "pool-2" } ), names );
+  ASSERT_TRUE( pinned );
+}
+#endif
+
+TEST( DispatchPoolShould, ThrowIfItsOptionsCannotBeApplied )
+{
+  DispatchThreadOptions options;
+  options.m_stackSize = 1;
+  ASSERT_THROW( DispatchPool pool( 2, options ), system_error );
+}
@@ -0,0 +1,129 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <DispatchThread.h>
+#include <DispatchStats.h>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace CppUtils;
+
+TEST( HdrHistogramShould, CountSmallValuesExactly )
+{
+  HdrHistogram histogram;
+  for( uint64_t i = 0; i < 100; i++ ) {
+    histogram.Record( i );
+  }
+  auto snapshot = histogram.Take();
+  ASSERT_EQ( 100u, snapshot.Count() );
+  ASSERT_EQ( 0u, snapshot.Min() );
+  ASSERT_EQ( 99u, snapshot.Max() );
+  ASSERT_DOUBLE_EQ( 49.5, snapshot.Mean() );
+  ASSERT_EQ( 49u, snapshot.ValueAtPercentile( 50 ) );
+  ASSERT_EQ( 99u, snapshot.ValueAtPercentile( 100 ) );
+}
+
+TEST( HdrHistogramShould, KeepLargeValuesWithinItsPrecision )
+{
+  for( uint64_t value = 128; value < HdrHistogram::kMaxValue / 3; value = value * 3 + 7 ) {
+    size_t bucket = HdrHistogram::BucketOf( value );
+    ASSERT_LT( bucket, HdrHistogram::kBucketCount );
+    uint64_t highest = HdrHistogram::HighestInBucket( bucket );
+    ASSERT_GE( highest, value );
+    ASSERT_LE( highest - value, value / 64 );
+    ASSERT_EQ( bucket, HdrHistogram::BucketOf( highest ) );
+    ASSERT_EQ( bucket + 1, HdrHistogram::BucketOf( highest + 1 ) );
+  }
+  ASSERT_EQ( HdrHistogram::kBucketCount - 1, HdrHistogram::BucketOf( HdrHistogram::kMaxValue ) );
+}
+
+TEST( HdrHistogramShould, RecordFromManyThreads )
+{
+  HdrHistogram histogram;
+  vector<thread> threads;
+  for( int t = 0; t < 4; t++ ) {
+    threads.emplace_back( [&histogram]() {
+      for( uint64_t i = 1; i <= 10000; i++ ) {
+        histogram.Record( i * 1000 );
+      }
+    } );
+  }
+  for( auto& t : threads ) {
+    t.join();
+  }
+  auto snapshot = histogram.Take();
+  ASSERT_EQ( 40000u, snapshot.Count() );
+  ASSERT_EQ( 1000u, snapshot.Min() );
+  ASSERT_EQ( 10000000u, snapshot.Max() );
+  uint64_t median = snapshot.ValueAtPercentile( 50 );
+  ASSERT_GE( median, 5000000u );
+  ASSERT_LE( median, 5000000u + 5000000u / 64 );
+}
+
+TEST( InstrumentedDispatchThreadShould, MeasureWaitRunTimeAndDepth )
+{
+  InstrumentedDispatchThread thr;
+  promise<void> release;
+  shared_future<void> released = release.get_future().share();
+  promise<void> started;
+  thr.PostToDispatch( [&started, released]() {
+    started.set_value();
+    released.wait();
+  } );
+  started.get_future().wait();
+  for( int i = 0; i < 10; i++ ) {
+    thr.PostToDispatch( []() { this_thread::sleep_for( chrono::milliseconds( 1 ) ); } );
+  }
+  auto during = thr.Stats().Snapshot();
+  ASSERT_EQ( 10u, during.m_depth );
+  ASSERT_EQ( 10u, during.m_maxDepth );
+  ASSERT_EQ( 0u, during.m_completed );
+
+  this_thread::sleep_for( chrono::milliseconds( 10 ) );
+  release.set_value();
+  ASSERT_TRUE( thr.DispatchSync( []() {} ) );
+  auto after = thr.Stats().Snapshot();
+  ASSERT_EQ( 0u, after.m_depth );
+  ASSERT_GE( after.m_maxDepth, 10u );
+  ASSERT_EQ( 12u, after.m_completed );
+  ASSERT_EQ( 12u, after.m_runTime.Count() );
+  ASSERT_EQ( 12u, after.m_queueWait.Count() );
+  // Every sleeper waited for the blocked task, and slept a millisecond
+  ASSERT_GE( after.m_queueWait.ValueAtPercentile( 50 ), 10000000u );
+  ASSERT_GE( after.m_runTime.ValueAtPercentile( 50 ), 1000000u );
+  ASSERT_GT( after.m_tasksPerSecond, 0.0 );
+}
+
+TEST( InstrumentedDispatchThreadShould, NotCountRejectedPosts )
+{
+  InstrumentedDispatchThread thr;
+  thr.Kill();
+  ASSERT_FALSE( thr.PostToDispatch( []() {} ) );
+  auto snapshot = thr.Stats().Snapshot();
+  ASSERT_EQ( 0u, snapshot.m_depth );
+  ASSERT_EQ( 0u, snapshot.m_completed );
+}
@@ -23,7 +23,10 @@
  */
 #include <gtest/gtest.h>
 #include <DispatchThread.h>
+#include <atomic>
 #include <future>
+#include <thread>
+#include <vector>
 
 using namespace std;
 using namespace CppUtils;
@@ -72,3 +75,400 @@ TEST( DispatchThreadShould, DISABLED_ExitProperly )
     pThr->PostToDispatch( fn ); } );
   delete pThr;
 }
+
+TEST( SpscDispatchThreadShould, RunTasksInPostingOrder )
+{
+  SpscDispatchThread thr;
+  promise<bool> success;
+  auto fut = success.get_future();
+  uint32_t expected = 0;
+  bool inOrder = true;
+  uint32_t termination = 1000;
+  for( uint32_t i = 0; i <= termination; i++ ) {
+    thr.PostToDispatch( [ &, i ]() {
+      inOrder = inOrder && ( i == expected++ );
+      if( i == termination ) {
+        success.set_value( inOrder );
+      }
+    } );
+  }
+  if( fut.wait_for( chrono::milliseconds( 500 ) ) != future_status::ready ) {
+    FAIL();
+  } else {
+    ASSERT_TRUE( fut.get() );
+  }
+}
+
+TEST( DispatchThreadShould, RunQueuedTasksAndRejectNewOnesWhenKilled )
+{
+  DispatchThread thr;
+  atomic<uint32_t> ran{ 0 };
+  for( uint32_t i = 0; i < 100; i++ ) {
+    ASSERT_TRUE( thr.PostToDispatch( [ &ran ]() { ran++; } ) );
+  }
+  thr.Kill();
+  ASSERT_EQ( 100u, ran.load() );
+  ASSERT_FALSE( thr.PostToDispatch( [ &ran ]() { ran++; } ) );
+}
+
+TEST( SegmentedDispatchThreadShould, RunATask )
+{
+  SegmentedDispatchThread thr;
+  promise<bool> success;
+  auto fut = success.get_future();
+  thr.PostToDispatch( [ &success ]() { success.set_value( true ); } );
+  ASSERT_EQ( future_status::ready, fut.wait_for( chrono::milliseconds( 500 ) ) );
+  ASSERT_TRUE( fut.get() );
+}
+
+namespace {
+struct CountingTask : public DispatchTask
+{
+  atomic<uint32_t>* pCount = nullptr;
+  void Run() override { ( *pCount )++; }
+};
+
+struct RepostingTask : public DispatchTask
+{
+  DispatchThread* pThread = nullptr;
+  uint32_t runsLeft = 0;
+  promise<void> done;
+  void Run() override
+  {
+    if( --runsLeft ) {
+      pThread->PostToDispatch( this );
+    } else {
+      done.set_value();
+    }
+  }
+};
+}
+
+TEST( DispatchThreadShould, RunPreAllocatedTasksFromManyThreads )
+{
+  const uint32_t producers = 4;
+  const uint32_t count = 10000;
+  atomic<uint32_t> runs{ 0 };
+  vector<vector<CountingTask>> tasks( producers, vector<CountingTask>( count ) );
+  {
+    DispatchThread thr;
+    vector<thread> threads;
+    for( uint32_t p = 0; p < producers; p++ ) {
+      threads.emplace_back( [&thr, &tasks, &runs, p]() {
+        for( auto& task : tasks[ p ] ) {
+          task.pCount = &runs;
+          thr.PostToDispatch( &task );
+        }
+      } );
+    }
+    for( auto& t : threads ) {
+      t.join();
+    }
+  }
+  ASSERT_EQ( producers * count, runs.load() );
+}
+
+TEST( DispatchThreadShould, LetATaskRepostItself )
+{
+  DispatchThread thr;
+  RepostingTask task;
+  task.pThread = &thr;
+  task.runsLeft = 1000;
+  auto fut = task.done.get_future();
+  ASSERT_TRUE( thr.PostToDispatch( &task ) );
+  ASSERT_EQ( future_status::ready, fut.wait_for( chrono::seconds( 5 ) ) );
+}
+
+TEST( DispatchThreadShould, RejectPreAllocatedTasksWhenKilled )
+{
+  DispatchThread thr;
+  atomic<uint32_t> runs{ 0 };
+  CountingTask task;
+  task.pCount = &runs;
+  thr.Kill();
+  ASSERT_FALSE( thr.PostToDispatch( &task ) );
+  ASSERT_FALSE( thr.PostToDispatch( static_cast<DispatchTask*>( nullptr ) ) );
+  ASSERT_EQ( 0u, runs.load() );
+}
+
+TEST( DispatchThreadShould, RunOrDropEveryPreAllocatedTaskItAccepted )
+{
+  const uint32_t producers = 3;
+  const uint32_t count = 2000;
+  for( int round = 0; round < 40; round++ ) {
+    atomic<uint32_t> runs{ 0 };
+    atomic<uint32_t> accepted{ 0 };
+    vector<vector<CountingTask>> tasks( producers, vector<CountingTask>( count ) );
+    DispatchThread thr;
+    vector<thread> threads;
+    for( uint32_t p = 0; p < producers; p++ ) {
+      threads.emplace_back( [&thr, &tasks, &runs, &accepted, p]() {
+        for( auto& task : tasks[ p ] ) {
+          task.pCount = &runs;
+          if( !thr.PostToDispatch( &task ) ) {
+            break;
+          }
+          accepted++;
+        }
+      } );
+    }
+    this_thread::sleep_for( chrono::microseconds( 50 * ( round % 8 ) ) );
+    bool drop = round % 2 == 1;
+    if( drop ) {
+      thr.Shutdown( eSHUTDOWN_MODE_DROP );
+    }
+    thr.Kill();
+    for( auto& t : threads ) {
+      t.join();
+    }
+    // A rejected task was never linked, an accepted one was run or dropped
+    ASSERT_EQ( accepted.load(), runs.load() + ( drop ? thr.DroppedCount() : 0 ) );
+  }
+}
+
+TEST( PriorityDispatchThreadShould, RunUrgentTasksAheadOfTheBacklog )
+{
+  PriorityDispatchThread thr;
+  promise<void> gate;
+  shared_future<void> opened = gate.get_future().share();
+  vector<int> order;
+  thr.PostToDispatch( [opened]() { opened.wait(); } );
+  for( int i = 0; i < 100; i++ ) {
+    thr.PostToDispatch( [&order]() { order.push_back( 0 ); } );
+  }
+  thr.PostToDispatch( [&order]() { order.push_back( 1 ); }, 1 );
+  gate.set_value();
+  thr.Kill();
+  ASSERT_EQ( 101u, order.size() );
+  ASSERT_EQ( 1, order.front() );
+}
+
+TEST( DispatchThreadShould, RunDelayedTasksWithoutBlockingOthers )
+{
+  DispatchThread thr;
+  auto start = chrono::steady_clock::now();
+  promise<chrono::steady_clock::time_point> delayedRan;
+  promise<chrono::steady_clock::time_point> immediateRan;
+  auto delayed = delayedRan.get_future();
+  auto immediate = immediateRan.get_future();
+  auto wpToken = thr.PostDelayed( chrono::milliseconds( 50 ), [&delayedRan]() {
+    delayedRan.set_value( chrono::steady_clock::now() );
+  } );
+  ASSERT_FALSE( wpToken.expired() );
+  thr.PostToDispatch( [&immediateRan]() { immediateRan.set_value( chrono::steady_clock::now() ); } );
+  ASSERT_EQ( future_status::ready, immediate.wait_for( chrono::seconds( 1 ) ) );
+  ASSERT_LT( immediate.get() - start, chrono::milliseconds( 50 ) );
+  ASSERT_EQ( future_status::ready, delayed.wait_for( chrono::seconds( 1 ) ) );
+  ASSERT_GE( delayed.get() - start, chrono::milliseconds( 50 ) );
+  // One shot tokens expire once the timer has fired
+  promise<void> flushed;
+  thr.PostToDispatch( [&flushed]() { flushed.set_value(); } );
+  flushed.get_future().wait();
+  ASSERT_TRUE( wpToken.expired() );
+}
+
+TEST( DispatchThreadShould, FireTimersInDeadlineOrder )
+{
+  DispatchThread thr;
+  vector<int> order;
+  promise<void> done;
+  auto now = chrono::steady_clock::now();
+  thr.PostAt( now + chrono::milliseconds( 30 ), [&order, &done]() { order.push_back( 3 ); done.set_value(); } );
+  thr.PostAt( now + chrono::milliseconds( 10 ), [&order]() { order.push_back( 1 ); } );
+  thr.PostAt( now + chrono::milliseconds( 20 ), [&order]() { order.push_back( 2 ); } );
+  thr.PostAt( now - chrono::milliseconds( 20 ), [&order]() { order.push_back( 0 ); } );
+  ASSERT_EQ( future_status::ready, done.get_future().wait_for( chrono::seconds( 1 ) ) );
+  ASSERT_EQ( ( vector<int>{ 0, 1, 2, 3 } ), order );
+}
+
+TEST( DispatchThreadShould, StopPeriodicAndPendingTimersWhenCanceled )
+{
+  DispatchThread thr;
+  atomic<int> ticks{ 0 };
+  atomic<bool> canceledRan{ false };
+  auto wpCanceled = thr.PostDelayed( chrono::milliseconds( 20 ), [&canceledRan]() { canceledRan = true; } );
+  LOCK_AND_CANCEL( wpCanceled );
+  auto wpPeriodic = thr.PostPeriodic( chrono::milliseconds( 5 ), [&ticks]() { ticks++; } );
+  while( ticks < 3 ) {
+    this_thread::sleep_for( chrono::milliseconds( 1 ) );
+  }
+  LOCK_AND_CANCEL( wpPeriodic );
+  this_thread::sleep_for( chrono::milliseconds( 10 ) );
+  int ticksAfterCancel = ticks;
+  this_thread::sleep_for( chrono::milliseconds( 40 ) );
+  ASSERT_EQ( ticksAfterCancel, ticks.load() );
+  ASSERT_FALSE( canceledRan.load() );
+  ASSERT_TRUE( wpPeriodic.expired() );
+}
+
+TEST( DispatchThreadShould, RejectTimersWhenKilled )
+{
+  DispatchThread thr;
+  atomic<bool> ran{ false };
+  thr.PostDelayed( chrono::seconds( 10 ), [&ran]() { ran = true; } );
+  auto start = chrono::steady_clock::now();
+  thr.Kill();
+  ASSERT_LT( chrono::steady_clock::now() - start, chrono::seconds( 1 ) );
+  ASSERT_TRUE( thr.PostDelayed( chrono::milliseconds( 1 ), [&ran]() { ran = true; } ).expired() );
+  ASSERT_FALSE( ran.load() );
+}
+
+TEST( DispatchThreadShould, RunSyncCallsOnTheThreadAndInlineWhenAlreadyOnIt )
+{
+  DispatchThread thr;
+  thread::id ranOn;
+  int value = 0;
+  ASSERT_TRUE( thr.DispatchSync( [&]() {
+    ranOn = this_thread::get_id();
+    // A nested sync call would deadlock if it were queued
+    thr.DispatchSync( [&value]() { value = 42; } );
+  } ) );
+  ASSERT_NE( this_thread::get_id(), ranOn );
+  ASSERT_EQ( 42, value );
+  ASSERT_FALSE( thr.IsDispatchThread() );
+}
+
+TEST( DispatchThreadShould, ReturnFalseFromSyncCallsOnceKilled )
+{
+  DispatchThread thr;
+  thr.Kill();
+  bool ran = false;
+  ASSERT_FALSE( thr.DispatchSync( [&ran]() { ran = true; } ) );
+  ASSERT_FALSE( ran );
+}
+
+TEST( DispatchThreadShould, DrainQueuedTasksOnShutdown )
+{
+  DispatchThread thr;
+  atomic<uint32_t> ran{ 0 };
+  for( uint32_t i = 0; i < 100; i++ ) {
+    ASSERT_TRUE( thr.PostToDispatch( [ &ran ]() { ran++; } ) );
+  }
+  AShutdownable& shutdownable = thr;
+  ShutdownFuture fut = shutdownable.Shutdown();
+  ASSERT_FALSE( thr.PostToDispatch( [ &ran ]() { ran++; } ) );
+  ASSERT_EQ( future_status::ready, fut.wait_for( chrono::seconds( 1 ) ) );
+  ASSERT_EQ( eSHUTDOWN_STATUS_SUCCESS, fut.get() );
+  ASSERT_EQ( 100u, ran.load() );
+  ASSERT_EQ( 0u, thr.DroppedCount() );
+}
+
+TEST( DispatchThreadShould, DropQueuedTasksAndCountThem )
+{
+  DispatchThread thr;
+  promise<void> release;
+  shared_future<void> released = release.get_future().share();
+  atomic<uint32_t> ran{ 0 };
+  CountingTask task;
+  task.pCount = &ran;
+  promise<void> started;
+  ASSERT_TRUE( thr.PostToDispatch( [ &started, released ]() {
+    started.set_value();
+    released.wait();
+  } ) );
+  started.get_future().wait();
+  for( uint32_t i = 0; i < 10; i++ ) {
+    ASSERT_TRUE( thr.PostToDispatch( [ &ran ]() { ran++; } ) );
+  }
+  ASSERT_TRUE( thr.PostToDispatch( &task ) );
+  ShutdownFuture fut = thr.Shutdown( eSHUTDOWN_MODE_DROP );
+  ASSERT_FALSE( thr.PostToDispatch( [ &ran ]() { ran++; } ) );
+  release.set_value();
+  ASSERT_EQ( future_status::ready, fut.wait_for( chrono::seconds( 1 ) ) );
+  ASSERT_EQ( 0u, ran.load() );
+  ASSERT_EQ( 11u, thr.DroppedCount() );
+}
+
+TEST( DispatchThreadShould, CutADrainShortWithADrop )
+{
+  DispatchThread thr;
+  atomic<uint32_t> ran{ 0 };
+  for( uint32_t i = 0; i < 1000; i++ ) {
+    ASSERT_TRUE( thr.PostToDispatch( [ &ran ]() {
+      this_thread::sleep_for( chrono::milliseconds( 1 ) );
+      ran++;
+    } ) );
+  }
+  ShutdownFuture drained = thr.Shutdown();
+  ASSERT_EQ( future_status::timeout, drained.wait_for( chrono::milliseconds( 20 ) ) );
+  ShutdownFuture dropped = thr.Shutdown( eSHUTDOWN_MODE_DROP );
+  ASSERT_EQ( future_status::ready, dropped.wait_for( chrono::seconds( 1 ) ) );
+  ASSERT_EQ( future_status::ready, drained.wait_for( chrono::seconds( 0 ) ) );
+  ASSERT_EQ( 1000u, ran.load() + thr.DroppedCount() );
+  ASSERT_GT( thr.DroppedCount(), 0u );
+  // Later callers get a future that is ready right away
+  ASSERT_EQ( future_status::ready, thr.Shutdown().wait_for( chrono::seconds( 0 ) ) );
+}
+
+TEST( DispatchThreadShould, ReleaseSyncCallersWhenDropping )
+{
+  DispatchThread thr;
+  promise<void> release;
+  shared_future<void> released = release.get_future().share();
+  promise<void> started;
+  ASSERT_TRUE( thr.PostToDispatch( [ &started, released ]() {
+    started.set_value();
+    released.wait();
+  } ) );
+  started.get_future().wait();
+  auto sync = async( launch::async, [&thr]() { return thr.DispatchSync( []() {} ); } );
+  ASSERT_EQ( future_status::timeout, sync.wait_for( chrono::milliseconds( 20 ) ) );
+  thr.Shutdown( eSHUTDOWN_MODE_DROP );
+  release.set_value();
+  ASSERT_EQ( future_status::ready, sync.wait_for( chrono::seconds( 1 ) ) );
+  ASSERT_FALSE( sync.get() );
+  ASSERT_EQ( 1u, thr.DroppedCount() );
+}
+
+#if defined( __linux__ )
+TEST( DispatchThreadShould, StartWithTheGivenNameCpusAndStackSize )
+{
+  DispatchThreadOptions options;
+  options.m_name = "dispatch-under-test";
+  options.m_cpus = { 0 };
+  options.m_stackSize = 4 * 1024 * 1024;
+  DispatchThread thr( options );
+  ASSERT_EQ( "dispatch-under-test", thr.Name() );
+
+  char name[ 16 ] = {};
+  cpu_set_t cpus;
+  size_t stackSize = 0;
+  ASSERT_TRUE( thr.DispatchSync( [&]() {
+    pthread_getname_np( pthread_self(), name, sizeof( name ) );
+    pthread_getaffinity_np( pthread_self(), sizeof( cpus ), &cpus );
+    pthread_attr_t attr;
+    pthread_getattr_np( pthread_self(), &attr );
+    pthread_attr_getstacksize( &attr, &stackSize );
+    pthread_attr_destroy( &attr );
+  } ) );
+  ASSERT_STREQ( "dispatch-under-", name );
+  ASSERT_EQ( 1, CPU_COUNT( &cpus ) );
+  ASSERT_TRUE( CPU_ISSET( 0, &cpus ) );
+  ASSERT_GE( stackSize, options.m_stackSize );
+}
+
+TEST( DispatchThreadShould, RunWithARealTimePolicyWhenPermitted )
+{
+  DispatchThreadOptions options;
+  options.m_schedPolicy = eSCHED_POLICY_FIFO;
+  options.m_schedPriority = 10;
+  try {
+    DispatchThread thr( options );
+    int policy = 0;
+    sched_param param;
+    ASSERT_TRUE( thr.DispatchSync( [&]() { pthread_getschedparam( pthread_self(), &policy, &param ); } ) );
+    ASSERT_EQ( SCHED_FIFO, policy );
+    ASSERT_EQ( 10, param.sched_priority );
+  } catch( const system_error& e ) {
+    // No CAP_SYS_NICE here
+    ASSERT_EQ( EPERM, e.code().value() );
+  }
+}
+#endif
+
+TEST( DispatchThreadShould, ThrowIfItsOptionsCannotBeApplied )
+{
+  DispatchThreadOptions options;
+  options.m_stackSize = 1;
+  ASSERT_THROW( DispatchThread thr( options ), system_error );
+}
@@ -0,0 +1,106 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <DispatchWatchdog.h>
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <vector>
+
+using namespace std;
+using namespace CppUtils;
+
+namespace {
+struct Reports
+{
+  mutex m_mtx;
+  vector<DispatchWatchdogReport> m_reports;
+
+  DispatchWatchdog::Callback Callback()
+  {
+    return [this]( const DispatchWatchdogReport& report ) {
+      lock_guard<mutex> lk( m_mtx );
+      m_reports.push_back( report );
+    };
+  }
+
+  size_t Size()
+  {
+    lock_guard<mutex> lk( m_mtx );
+    return m_reports.size();
+  }
+};
+}
+
+TEST( DispatchWatchdogShould, ReportATaskThatRunsTooLongOnce )
+{
+  Reports reports;
+  InstrumentedDispatchThread thr;
+  DispatchWatchdog watchdog( chrono::milliseconds( 20 ), reports.Callback(), chrono::milliseconds( 2 ) );
+  watchdog.Watch( thr, "worker" );
+  int line = __LINE__ + 1;
+  ASSERT_TRUE( thr.PostToDispatch( CPPUTILS_TASK_SITE, []() { this_thread::sleep_for( chrono::milliseconds( 100 ) ); } ) );
+  ASSERT_TRUE( thr.DispatchSync( []() {} ) );
+  watchdog.Unwatch( thr );
+
+  ASSERT_EQ( 1u, reports.Size() );
+  const DispatchWatchdogReport& report = reports.m_reports[0];
+  ASSERT_EQ( "worker", report.m_threadName );
+  ASSERT_NE( nullptr, strstr( report.m_site.m_pFile, "DispatchWatchdogTest.cc" ) );
+  ASSERT_EQ( line, report.m_site.m_line );
+  ASSERT_GE( report.m_runningFor, chrono::milliseconds( 20 ) );
+}
+
+TEST( DispatchWatchdogShould, ReportEveryOverrunningTaskEvenWithoutASite )
+{
+  Reports reports;
+  InstrumentedDispatchThread thr;
+  DispatchWatchdog watchdog( chrono::milliseconds( 10 ), reports.Callback(), chrono::milliseconds( 2 ) );
+  watchdog.Watch( thr, "worker" );
+  for( int i = 0; i < 2; i++ ) {
+    thr.PostToDispatch( []() { this_thread::sleep_for( chrono::milliseconds( 50 ) ); } );
+  }
+  ASSERT_TRUE( thr.DispatchSync( []() {} ) );
+  watchdog.Unwatch( thr );
+  ASSERT_EQ( 2u, reports.Size() );
+  ASSERT_EQ( nullptr, reports.m_reports[1].m_site.m_pFile );
+}
+
+TEST( DispatchWatchdogShould, IgnoreQuickTasksAndUnwatchedThreads )
+{
+  Reports reports;
+  InstrumentedDispatchThread thr;
+  InstrumentedDispatchThread unwatched;
+  DispatchWatchdog watchdog( chrono::milliseconds( 50 ), reports.Callback(), chrono::milliseconds( 2 ) );
+  watchdog.Watch( thr, "worker" );
+  for( int i = 0; i < 1000; i++ ) {
+    thr.PostToDispatch( CPPUTILS_TASK_SITE, []() {} );
+  }
+  unwatched.PostToDispatch( []() { this_thread::sleep_for( chrono::milliseconds( 80 ) ); } );
+  ASSERT_TRUE( thr.DispatchSync( []() {} ) );
+  ASSERT_TRUE( unwatched.DispatchSync( []() {} ) );
+  watchdog.Unwatch( thr );
+  ASSERT_EQ( 0u, reports.Size() );
+}
@@ -0,0 +1,148 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <DispatchPool.h>
+#include <DispatchThread.h>
+#include <Future.h>
+#include <Strand.h>
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace CppUtils;
+using namespace std;
+
+namespace {
+atomic<bool> g_countAllocations{ false };
+atomic<size_t> g_allocations{ 0 };
+}
+
+// Counts allocations on every thread while g_countAllocations is set
+void* operator new( size_t size )
+{
+  if( g_countAllocations.load( memory_order_relaxed ) ) {
+    g_allocations.fetch_add( 1, memory_order_relaxed );
+  }
+  void* p = malloc( size ? size : 1 );
+  if( !p ) {
+    throw bad_alloc();
+  }
+  return p;
+}
+
+void operator delete( void* p ) noexcept
+{
+  free( p );
+}
+
+void operator delete( void* p, size_t ) noexcept
+{
+  free( p );
+}
+
+TEST( FutureShould, HandBackTheResultOfASubmittedTask )
+{
+  DispatchThread thr;
+  auto fut = thr.Submit( []() { return this_thread::get_id(); } );
+  ASSERT_TRUE( fut.Valid() );
+  thread::id ranOn = fut.Get();
+  ASSERT_NE( this_thread::get_id(), ranOn );
+  ASSERT_FALSE( fut.Valid() );
+  auto done = thr.Submit( []() { } );
+  done.Get();
+}
+
+TEST( FutureShould, ChainContinuationsAcrossExecutors )
+{
+  DispatchThread first;
+  DispatchThread second;
+  DispatchPool pool( 2 );
+  Strand strand( pool );
+  thread::id firstId = first.Submit( []() { return this_thread::get_id(); } ).Get();
+  thread::id secondId = second.Submit( []() { return this_thread::get_id(); } ).Get();
+
+  auto fut = first.Submit( []() { return 20; } )
+      .Then( second, [secondId]( int value ) { return value + ( this_thread::get_id() == secondId ? 1 : 100 ); } )
+      .Then( strand, [&strand]( int value ) { return to_string( value * 2 ) + ( strand.IsCurrent() ? "" : "!" ); } )
+      .Then( first, [firstId]( string value ) { return value + ( this_thread::get_id() == firstId ? "" : "!" ); } );
+  ASSERT_EQ( "42", fut.Get() );
+}
+
+TEST( FutureShould, RunTheContinuationWhenItIsAttachedLate )
+{
+  DispatchThread thr;
+  auto fut = thr.Submit( []() { return unique_ptr<int>( new int( 7 ) ); } );
+  fut.Wait();
+  ASSERT_TRUE( fut.IsReady() );
+  auto next = fut.Then( thr, []( unique_ptr<int> spValue ) { ( *spValue )++; } );
+  next.Get();
+}
+
+TEST( FutureShould, SkipContinuationsAndRethrowExceptions )
+{
+  DispatchThread thr;
+  bool continued = false;
+  auto fut = thr.Submit( []() -> int { throw runtime_error( "boom" ); } )
+      .Then( thr, [&continued]( int value ) { continued = true; return value; } );
+  ASSERT_THROW( fut.Get(), runtime_error );
+  ASSERT_FALSE( continued );
+}
+
+TEST( FutureShould, ReportABrokenPromiseWhenTheExecutorRejects )
+{
+  DispatchThread thr;
+  thr.Kill();
+  auto fut = thr.Submit( []() { return 1; } );
+  ASSERT_THROW( fut.Get(), future_error );
+
+  Future<int> orphan;
+  {
+    Promise<int> promise;
+    orphan = promise.GetFuture();
+  }
+  ASSERT_TRUE( orphan.IsReady() );
+  ASSERT_THROW( orphan.Get(), future_error );
+}
+
+TEST( FutureShould, NotAllocateInSteadyState )
+{
+  // The segmented queue reuses its blocks, so only the futures could allocate
+  SegmentedDispatchThread thr;
+  auto roundTrips = [&thr]() {
+    for( int i = 0; i < 1000; i++ ) {
+      ASSERT_EQ( i, thr.Submit( [i]() { return i; } ).Get() );
+      ASSERT_EQ( i + 1, thr.Submit( [i]() { return i; } ).Then( thr, []( int v ) { return v + 1; } ).Get() );
+    }
+  };
+  roundTrips();
+  g_allocations = 0;
+  g_countAllocations = true;
+  roundTrips();
+  g_countAllocations = false;
+  ASSERT_EQ( 0u, g_allocations.load() );
+}
@@ -0,0 +1,87 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <IntrusiveMpscQueue.h>
+#include <thread>
+#include <vector>
+
+using namespace CppUtils;
+using namespace std;
+
+namespace {
+struct Item : public MpscNode
+{
+  uint32_t producer = 0;
+  uint32_t seq = 0;
+};
+}
+
+TEST( IntrusiveMpscQueueShould, PopItemsInPushOrder )
+{
+  IntrusiveMpscQueue<Item> q;
+  Item items[ 3 ];
+  ASSERT_EQ( nullptr, q.Pop() );
+  for( auto& item : items ) {
+    q.Push( &item );
+  }
+  ASSERT_EQ( &items[ 0 ], q.Pop() );
+  ASSERT_EQ( &items[ 1 ], q.Pop() );
+  q.Push( &items[ 0 ] );
+  ASSERT_EQ( &items[ 2 ], q.Pop() );
+  ASSERT_EQ( &items[ 0 ], q.Pop() );
+  ASSERT_EQ( nullptr, q.Pop() );
+}
+
+TEST( IntrusiveMpscQueueShould, KeepPerProducerOrderUnderContention )
+{
+  const uint32_t producers = 4;
+  const uint32_t count = 50000;
+  IntrusiveMpscQueue<Item> q;
+  vector<vector<Item>> items( producers, vector<Item>( count ) );
+  vector<thread> threads;
+  for( uint32_t p = 0; p < producers; p++ ) {
+    threads.emplace_back( [&q, &items, p, count]() {
+      for( uint32_t i = 0; i < count; i++ ) {
+        items[ p ][ i ].producer = p;
+        items[ p ][ i ].seq = i;
+        q.Push( &items[ p ][ i ] );
+      }
+    } );
+  }
+  vector<uint32_t> next( producers, 0 );
+  bool inOrder = true;
+  uint32_t received = 0;
+  while( received < producers * count ) {
+    Item* pItem = q.Pop();
+    if( pItem ) {
+      inOrder = inOrder && ( pItem->seq == next[ pItem->producer ]++ );
+      received++;
+    }
+  }
+  for( auto& t : threads ) {
+    t.join();
+  }
+  ASSERT_TRUE( inOrder );
+  ASSERT_EQ( nullptr, q.Pop() );
+}
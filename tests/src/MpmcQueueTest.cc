@@ -0,0 +1,153 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <MpmcQueue.h>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace CppUtils;
+using namespace std;
+
+TEST( MpmcQueueShould, RoundCapacityUpToAPowerOfTwo )
+{
+  MpmcQueue<int> q( 100 );
+  ASSERT_EQ( 128u, q.Capacity() );
+}
+
+TEST( MpmcQueueShould, RejectEnQueueWhenFull )
+{
+  MpmcQueue<int> q( 4 );
+  for( int i = 0; i < 4; i++ ) {
+    ASSERT_TRUE( q.TryEnQueue( i ) );
+  }
+  ASSERT_FALSE( q.TryEnQueue( 4 ) );
+  int val = -1;
+  ASSERT_TRUE( q.TryDeQueue( val ) );
+  ASSERT_EQ( 0, val );
+  ASSERT_TRUE( q.TryEnQueue( 4 ) );
+}
+
+TEST( MpmcQueueShould, PreserveFifoOrderForASingleProducer )
+{
+  MpmcQueue<int> q( 16 );
+  int val = 0;
+  ASSERT_FALSE( q.TryDeQueue( val ) );
+  for( int i = 0; i < 10; i++ ) {
+    q.EnQueue( i );
+  }
+  ASSERT_EQ( 10u, q.Size() );
+  for( int i = 0; i < 10; i++ ) {
+    ASSERT_EQ( i, q.DeQueue() );
+  }
+}
+
+TEST( MpmcQueueShould, DeliverEveryItemWithManyProducersAndConsumers )
+{
+  MpmcQueue<uint32_t> q( 64 );
+  const uint32_t producers = 4, consumers = 4, perProducer = 20000;
+  atomic<uint64_t> sum{ 0 };
+  vector<thread> threads;
+  for( uint32_t p = 0; p < producers; p++ ) {
+    threads.push_back( thread( [ &q, perProducer ]() {
+      for( uint32_t i = 1; i <= perProducer; i++ ) {
+        q.EnQueue( i );
+      }
+    } ) );
+  }
+  for( uint32_t c = 0; c < consumers; c++ ) {
+    threads.push_back( thread( [ &q, &sum, producers, consumers, perProducer ]() {
+      for( uint32_t i = 0; i < producers * perProducer / consumers; i++ ) {
+        sum += q.DeQueue();
+      }
+    } ) );
+  }
+  for( auto& thr : threads ) {
+    thr.join();
+  }
+  uint64_t expected = (uint64_t)producers * perProducer * ( perProducer + 1 ) / 2;
+  ASSERT_EQ( expected, sum.load() );
+}
+
+TEST( MpmcQueueShould, QueueMoveOnlyItems )
+{
+  MpmcQueue<unique_ptr<int>> q( 2 );
+  ASSERT_TRUE( q.TryEmplace( new int( 1 ) ) );
+  q.EnQueue( unique_ptr<int>( new int( 2 ) ) );
+  unique_ptr<int> spare( new int( 3 ) );
+  ASSERT_FALSE( q.TryEnQueue( std::move( spare ) ) );
+  ASSERT_TRUE( spare != nullptr );
+  ASSERT_EQ( 1, *q.DeQueue() );
+  ASSERT_EQ( 2, *q.DeQueue() );
+}
+
+TEST( MpmcQueueShould, TimeOutWhenNothingArrives )
+{
+  MpmcQueue<int> q( 4 );
+  int val = 0;
+  ASSERT_FALSE( q.DeQueueFor( val, chrono::milliseconds( 10 ) ) );
+  q.EnQueue( 1 );
+  ASSERT_TRUE( q.DeQueueFor( val, chrono::milliseconds( 10 ) ) );
+  ASSERT_EQ( 1, val );
+}
+
+TEST( MpmcQueueShould, WakeBlockedThreadsWhenClosed )
+{
+  MpmcQueue<int> q( 2 );
+  q.EnQueue( 1 );
+  q.EnQueue( 2 );
+  bool enqueued = true;
+  thread producer( [ &q, &enqueued ]() { enqueued = q.EnQueue( 3 ); } );
+  this_thread::sleep_for( chrono::milliseconds( 10 ) );
+  q.Close();
+  producer.join();
+  ASSERT_FALSE( enqueued );
+
+  int val = 0;
+  ASSERT_TRUE( q.DeQueue( val ) );
+  ASSERT_TRUE( q.DeQueue( val ) );
+  thread consumer( [ &q, &val ]() { val = q.DeQueue( val ) ? val : -1; } );
+  consumer.join();
+  ASSERT_EQ( -1, val );
+}
+
+TEST( MpmcQueueShould, WorkWithASpinningWaitStrategy )
+{
+  MpmcQueue<int, YieldWait> q( 8 );
+  const int count = 10000;
+  thread producer( [ &q, count ]() {
+    for( int i = 0; i < count; i++ ) {
+      q.EnQueue( i );
+    }
+  } );
+  int sum = 0;
+  for( int i = 0; i < count; i++ ) {
+    sum += q.DeQueue();
+  }
+  producer.join();
+  ASSERT_EQ( count * ( count - 1 ) / 2, sum );
+  int val = 0;
+  ASSERT_FALSE( q.DeQueueFor( val, chrono::milliseconds( 1 ) ) );
+}
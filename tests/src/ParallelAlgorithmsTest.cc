@@ -0,0 +1,225 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <ParallelAlgorithms.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <numeric>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace CppUtils;
+using namespace std;
+
+namespace {
+// Fails every post, like a pool that cannot allocate
+struct ThrowingPool
+{
+  using Fn = DispatchFn;
+
+  bool PostToDispatch( Fn ) { throw bad_alloc(); }
+  bool TryRunOne() { return false; }
+  size_t ThreadCount() const { return 1; }
+};
+}
+
+TEST( ParallelForShould, VisitEveryIndexOnce )
+{
+  DispatchPool pool( 3 );
+  vector<atomic<int>> visits( 10007 );
+  for( auto& v : visits ) {
+    v = 0;
+  }
+  atomic<size_t> maxPiece{ 0 };
+  ParallelFor( pool, 0, visits.size(), 64, [&]( size_t b, size_t e ) {
+    size_t piece = e - b;
+    size_t seen = maxPiece.load();
+    while( piece > seen && !maxPiece.compare_exchange_weak( seen, piece ) ) { }
+    for( size_t i = b; i < e; i++ ) {
+      visits[ i ]++;
+    }
+  } );
+  for( auto& v : visits ) {
+    ASSERT_EQ( 1, v.load() );
+  }
+  ASSERT_LE( maxPiece.load(), 64u );
+}
+
+TEST( ParallelForShould, HandleEmptyAndSmallRanges )
+{
+  DispatchPool pool( 2 );
+  int calls = 0;
+  ParallelFor( pool, 5, 5, 16, [&]( size_t, size_t ) { calls++; } );
+  ASSERT_EQ( 0, calls );
+  ParallelFor( pool, 0, 10, 16, [&]( size_t b, size_t e ) {
+    calls++;
+    ASSERT_EQ( 0u, b );
+    ASSERT_EQ( 10u, e );
+  } );
+  ASSERT_EQ( 1, calls );
+}
+
+TEST( ParallelForShould, RethrowAfterAllPiecesRan )
+{
+  DispatchPool pool( 2 );
+  atomic<size_t> done{ 0 };
+  ASSERT_THROW( ParallelFor( pool, 0, 1000, 10, [&]( size_t b, size_t e ) {
+    done += e - b;
+    if( b == 500 ) {
+      throw runtime_error( "piece" );
+    }
+  } ), runtime_error );
+  ASSERT_EQ( 1000u, done.load() );
+}
+
+TEST( ParallelForShould, NestInsidePoolTasks )
+{
+  // The outer pieces wait for the inner ones by running pool tasks, so this
+  // must finish even with a single worker
+  DispatchPool pool( 1 );
+  vector<atomic<int>> visits( 64 * 64 );
+  for( auto& v : visits ) {
+    v = 0;
+  }
+  ParallelFor( pool, 0, 64, 1, [&]( size_t ob, size_t oe ) {
+    for( size_t o = ob; o < oe; o++ ) {
+      ParallelFor( pool, 0, 64, 4, [&]( size_t b, size_t e ) {
+        for( size_t i = b; i < e; i++ ) {
+          visits[ o * 64 + i ]++;
+        }
+      } );
+    }
+  } );
+  for( auto& v : visits ) {
+    ASSERT_EQ( 1, v.load() );
+  }
+}
+
+TEST( ParallelForShould, RunOnTheCallerAfterKill )
+{
+  DispatchPool pool( 2 );
+  pool.Kill();
+  atomic<size_t> done{ 0 };
+  ParallelFor( pool, 0, 100, 10, [&]( size_t b, size_t e ) { done += e - b; } );
+  ASSERT_EQ( 100u, done.load() );
+}
+
+TEST( ParallelForShould, RethrowWhenPostingFails )
+{
+  ThrowingPool pool;
+  ASSERT_THROW( ParallelFor( pool, 0, 1000, 10, []( size_t, size_t ) { } ), bad_alloc );
+  vector<int> values( 1000, 1 );
+  ASSERT_THROW( ParallelSort( pool, values.begin(), values.end(), less<int>(), 16 ), bad_alloc );
+}
+
+TEST( ParallelReduceShould, MatchSequentialSumAndKeepOrder )
+{
+  DispatchPool pool( 3 );
+  vector<uint64_t> values( 100000 );
+  iota( values.begin(), values.end(), 1 );
+  uint64_t sum = ParallelReduce( pool, 0, values.size(), 100, uint64_t( 0 ),
+    [&]( size_t b, size_t e ) { return accumulate( values.begin() + b, values.begin() + e, uint64_t( 0 ) ); },
+    []( uint64_t a, uint64_t b ) { return a + b; } );
+  ASSERT_EQ( accumulate( values.begin(), values.end(), uint64_t( 0 ) ), sum );
+
+  // Concatenation is associative but not commutative
+  string letters = "abcdefghijklmnopqrstuvwxyz";
+  string joined = ParallelReduce( pool, 0, letters.size(), 3, string(),
+    [&]( size_t b, size_t e ) { return letters.substr( b, e - b ); },
+    []( string a, string b ) { return a + b; } );
+  ASSERT_EQ( letters, joined );
+
+  ASSERT_EQ( 7, ParallelReduce( pool, 3, 3, 1, 7, []( size_t, size_t ) { return 0; }, plus<int>() ) );
+}
+
+TEST( ParallelReduceShould, ReduceToBool )
+{
+  DispatchPool pool( 3 );
+  vector<int> values( 100000 );
+  iota( values.begin(), values.end(), 0 );
+  auto allBelow = [&]( int limit ) {
+    return ParallelReduce( pool, 0, values.size(), 16, true,
+      [&]( size_t b, size_t e ) { return all_of( values.begin() + b, values.begin() + e, [limit]( int v ) { return v < limit; } ); },
+      []( bool a, bool b ) { return a && b; } );
+  };
+  for( int i = 0; i < 20; i++ ) {
+    ASSERT_TRUE( allBelow( 100000 ) );
+    ASSERT_FALSE( allBelow( 99999 ) );
+  }
+}
+
+TEST( ParallelSortShould, SortLikeStdSort )
+{
+  DispatchPool pool( 3 );
+  mt19937 rng( 42 );
+  vector<int> values( 200000 );
+  for( auto& v : values ) {
+    v = static_cast<int>( rng() % 100000 );
+  }
+  vector<int> expected = values;
+  sort( expected.begin(), expected.end() );
+  ParallelSort( pool, values.begin(), values.end(), less<int>(), 256 );
+  ASSERT_EQ( expected, values );
+
+  ParallelSort( pool, values.begin(), values.end(), greater<int>(), 256 );
+  reverse( expected.begin(), expected.end() );
+  ASSERT_EQ( expected, values );
+}
+
+TEST( ParallelSortShould, HandleDuplicatesAndSortedInput )
+{
+  DispatchPool pool( 2 );
+  vector<int> same( 50000, 7 );
+  ParallelSort( pool, same.begin(), same.end(), less<int>(), 64 );
+  ASSERT_TRUE( all_of( same.begin(), same.end(), []( int v ) { return v == 7; } ) );
+
+  vector<int> sorted( 50000 );
+  iota( sorted.begin(), sorted.end(), 0 );
+  vector<int> reversed( sorted.rbegin(), sorted.rend() );
+  ParallelSort( pool, reversed.begin(), reversed.end(), less<int>(), 64 );
+  ASSERT_EQ( sorted, reversed );
+
+  vector<int> few{ 3, 1, 2 };
+  ParallelSort( pool, few.begin(), few.end() );
+  ASSERT_EQ( ( vector<int>{ 1, 2, 3 } ), few );
+}
+
+TEST( ParallelSortShould, RethrowWhenCompareThrows )
+{
+  DispatchPool pool( 2 );
+  vector<int> values( 10000 );
+  iota( values.begin(), values.end(), 0 );
+  shuffle( values.begin(), values.end(), mt19937( 1 ) );
+  atomic<int> compares{ 0 };
+  ASSERT_THROW( ParallelSort( pool, values.begin(), values.end(), [&]( int a, int b ) {
+    if( ++compares == 20000 ) {
+      throw runtime_error( "compare" );
+    }
+    return a < b;
+  }, 64 ), runtime_error );
+}
@@ -0,0 +1,201 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <Pipeline.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace CppUtils;
+using namespace std;
+
+namespace {
+
+PipelineStageOptions Options( const string& name, size_t concurrency, size_t capacity,
+                              EBackpressure backpressure = eBACKPRESSURE_BLOCK )
+{
+  PipelineStageOptions options;
+  options.m_name = name;
+  options.m_concurrency = concurrency;
+  options.m_capacity = capacity;
+  options.m_backpressure = backpressure;
+  return options;
+}
+
+template<typename Pred>
+bool WaitFor( Pred pred )
+{
+  auto deadline = chrono::steady_clock::now() + chrono::seconds( 5 );
+  bool retval;
+  while( !( retval = pred() ) && chrono::steady_clock::now() < deadline ) {
+    this_thread::sleep_for( chrono::milliseconds( 1 ) );
+  }
+  return retval;
+}
+
+}
+
+TEST( PipelineShould, PassItemsThroughSerialStagesInOrder )
+{
+  vector<string> out;
+  auto spPipeline = PipelineBuilder<int>()
+    .Stage( Options( "double", 1, 16 ), []( int v ) { return v * 2; } )
+    .Stage( Options( "format", 1, 16 ), []( int v ) { return to_string( v ); } )
+    .Sink( Options( "collect", 1, 16 ), [&out]( string s ) { out.push_back( s ); } );
+  for( int i = 0; i < 1000; i++ ) {
+    ASSERT_TRUE( spPipeline->Push( i ) );
+  }
+  spPipeline->Close();
+  spPipeline->Join();
+  ASSERT_EQ( 1000u, out.size() );
+  for( int i = 0; i < 1000; i++ ) {
+    ASSERT_EQ( to_string( i * 2 ), out[ i ] );
+  }
+  ASSERT_FALSE( spPipeline->Push( 1 ) );
+}
+
+TEST( PipelineShould, ProcessEveryItemInParallelStages )
+{
+  atomic<uint64_t> sum{ 0 };
+  atomic<size_t> count{ 0 };
+  {
+    auto spPipeline = PipelineBuilder<uint64_t>()
+      .Stage( Options( "square", 3, 8 ), []( uint64_t v ) { return v * v; } )
+      .Sink( Options( "sum", 2, 8 ), [&]( uint64_t v ) {
+        sum += v;
+        count++;
+      } );
+    for( uint64_t i = 1; i <= 2000; i++ ) {
+      spPipeline->Push( i );
+    }
+    // The destructor drains like Close() and Join()
+  }
+  ASSERT_EQ( 2000u, count.load() );
+  ASSERT_EQ( 2000ull * 2001 * 4001 / 6, sum.load() );
+}
+
+TEST( PipelineShould, MoveItemsThatCannotBeCopied )
+{
+  vector<int> out;
+  auto spPipeline = PipelineBuilder<unique_ptr<int>>()
+    .Stage( Options( "inc", 1, 4 ), []( unique_ptr<int> p ) {
+      ( *p )++;
+      return p;
+    } )
+    .Sink( Options( "collect", 1, 4 ), [&out]( unique_ptr<int> p ) { out.push_back( *p ); } );
+  for( int i = 0; i < 10; i++ ) {
+    spPipeline->Push( unique_ptr<int>( new int( i ) ) );
+  }
+  spPipeline->Close();
+  spPipeline->Join();
+  ASSERT_EQ( ( vector<int>{ 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 } ), out );
+}
+
+TEST( PipelineShould, BlockTheProducerWhenADownstreamStageIsFull )
+{
+  promise<void> gate;
+  shared_future<void> opened = gate.get_future().share();
+  atomic<size_t> consumed{ 0 };
+  auto spPipeline = PipelineBuilder<int>()
+    .Stage( Options( "pass", 1, 2 ), []( int v ) { return v; } )
+    .Sink( Options( "slow", 1, 2 ), [&]( int ) {
+      opened.wait();
+      consumed++;
+    } );
+  atomic<size_t> pushed{ 0 };
+  thread producer( [&]() {
+    for( int i = 0; i < 100; i++ ) {
+      spPipeline->Push( i );
+      pushed++;
+    }
+  } );
+  ASSERT_TRUE( WaitFor( [&]() { return spPipeline->Stats()[ 0 ].m_full > 0; } ) );
+  // Two queues of two plus one item held by each worker
+  ASSERT_LE( pushed.load(), 6u );
+  auto stats = spPipeline->Stats();
+  ASSERT_EQ( 1u, stats[ 1 ].m_busy );
+  ASSERT_EQ( 0u, stats[ 0 ].m_shed );
+  gate.set_value();
+  producer.join();
+  spPipeline->Close();
+  spPipeline->Join();
+  ASSERT_EQ( 100u, consumed.load() );
+}
+
+TEST( PipelineShould, ShedItemsWhenFullAndCountThem )
+{
+  promise<void> gate;
+  shared_future<void> opened = gate.get_future().share();
+  atomic<size_t> consumed{ 0 };
+  auto spPipeline = PipelineBuilder<int>()
+    .Sink( Options( "slow", 1, 2, eBACKPRESSURE_SHED ), [&]( int ) {
+      opened.wait();
+      consumed++;
+    } );
+  size_t accepted = 0;
+  for( int i = 0; i < 10; i++ ) {
+    accepted += spPipeline->Push( i ) ? 1 : 0;
+  }
+  ASSERT_GE( accepted, 2u );
+  ASSERT_LE( accepted, 3u );
+  auto stats = spPipeline->Stats();
+  ASSERT_EQ( 10u - accepted, stats[ 0 ].m_shed );
+  ASSERT_EQ( stats[ 0 ].m_shed, stats[ 0 ].m_full );
+  gate.set_value();
+  spPipeline->Close();
+  spPipeline->Join();
+  ASSERT_EQ( accepted, consumed.load() );
+}
+
+TEST( PipelineShould, ReportStageStats )
+{
+  auto spPipeline = PipelineBuilder<int>()
+    .Stage( Options( "first", 2, 3 ), []( int v ) { return v + 1; } )
+    .Sink( Options( "last", 1, 64 ), []( int ) { } );
+  spPipeline->Stats();
+  for( int i = 0; i < 500; i++ ) {
+    spPipeline->Push( i );
+  }
+  ASSERT_TRUE( WaitFor( [&]() { return spPipeline->Stats()[ 1 ].m_processed == 500; } ) );
+  auto stats = spPipeline->Stats();
+  ASSERT_EQ( 2u, stats.size() );
+  ASSERT_EQ( "first", stats[ 0 ].m_name );
+  ASSERT_EQ( 2u, stats[ 0 ].m_concurrency );
+  ASSERT_EQ( 4u, stats[ 0 ].m_capacity );
+  ASSERT_EQ( 500u, stats[ 0 ].m_processed );
+  ASSERT_EQ( 0u, stats[ 0 ].m_queued );
+  ASSERT_EQ( 0u, stats[ 0 ].m_busy );
+  ASSERT_EQ( "last", stats[ 1 ].m_name );
+  ASSERT_EQ( 64u, stats[ 1 ].m_capacity );
+
+  // The rate only covers what happened since the previous call
+  this_thread::sleep_for( chrono::milliseconds( 5 ) );
+  ASSERT_EQ( 0.0, spPipeline->Stats()[ 1 ].m_itemsPerSecond );
+  spPipeline->Push( 1 );
+  ASSERT_TRUE( WaitFor( [&]() { return spPipeline->Stats()[ 1 ].m_itemsPerSecond > 0; } ) );
+}
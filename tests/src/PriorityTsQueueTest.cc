@@ -0,0 +1,80 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <PriorityTsQueue.h>
+#include <memory>
+#include <thread>
+
+using namespace CppUtils;
+using namespace std;
+
+TEST( PriorityTsQueueShould, HandOutHigherBandsFirstAndKeepFifoWithinABand )
+{
+  PriorityTsQueue<int, 3> q;
+  q.EnQueue( 1 );
+  q.EnQueue( 2 );
+  q.EnQueue( 10, 1 );
+  q.EnQueue( 20, 2 );
+  q.EnQueue( 11, 1 );
+  q.EnQueue( 21, 7 );
+  ASSERT_EQ( 6u, q.Size() );
+  ASSERT_EQ( 20, q.DeQueue() );
+  ASSERT_EQ( 21, q.DeQueue() );
+  ASSERT_EQ( 10, q.DeQueue() );
+  ASSERT_EQ( 11, q.DeQueue() );
+  ASSERT_EQ( 1, q.DeQueue() );
+  ASSERT_EQ( 2, q.DeQueue() );
+  int val = 0;
+  ASSERT_FALSE( q.TryDeQueue( val ) );
+}
+
+TEST( PriorityTsQueueShould, AcceptMoveOnlyItems )
+{
+  PriorityTsQueue<unique_ptr<int>> q;
+  ASSERT_TRUE( q.EnQueue( unique_ptr<int>( new int( 1 ) ) ) );
+  ASSERT_TRUE( q.EmplaceWithPriority( 3, new int( 2 ) ) );
+  ASSERT_TRUE( q.TryEnQueue( unique_ptr<int>( new int( 3 ) ), 2 ) );
+  ASSERT_EQ( 2, *q.DeQueue() );
+  ASSERT_EQ( 3, *q.DeQueue() );
+  ASSERT_EQ( 1, *q.DeQueue() );
+}
+
+TEST( PriorityTsQueueShould, WakeABlockedConsumerAndDrainAfterClose )
+{
+  PriorityTsQueue<int> q;
+  thread producer( [&q]() {
+    this_thread::sleep_for( chrono::milliseconds( 10 ) );
+    q.EnQueue( 5, 1 );
+    q.EnQueue( 6 );
+    q.Close();
+  } );
+  int val = 0;
+  ASSERT_TRUE( q.DeQueue( val ) );
+  ASSERT_EQ( 5, val );
+  producer.join();
+  ASSERT_FALSE( q.EnQueue( 7, 3 ) );
+  ASSERT_TRUE( q.DeQueue( val ) );
+  ASSERT_EQ( 6, val );
+  ASSERT_FALSE( q.DeQueue( val ) );
+}
@@ -0,0 +1,176 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <DispatchThread.h>
+#include <atomic>
+#include <future>
+#include <vector>
+
+#if defined( __linux__ )
+#include <sys/epoll.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace CppUtils;
+
+namespace {
+struct Pipe
+{
+  Pipe() { EXPECT_EQ( 0, pipe( m_fds ) ); }
+  ~Pipe()
+  {
+    close( m_fds[ 0 ] );
+    close( m_fds[ 1 ] );
+  }
+
+  int ReadEnd() const { return m_fds[ 0 ]; }
+  void Write( char c ) { EXPECT_EQ( 1, write( m_fds[ 1 ], &c, 1 ) ); }
+
+  int m_fds[ 2 ];
+};
+}
+
+TEST( ReactorDispatchThreadShould, RunPostedTasksAndTimers )
+{
+  ReactorDispatchThread thr;
+  atomic<int> ran{ 0 };
+  for( int i = 0; i < 1000; i++ ) {
+    ASSERT_TRUE( thr.PostToDispatch( [&ran]() { ran++; } ) );
+  }
+  promise<void> fired;
+  thr.PostDelayed( chrono::milliseconds( 10 ), [&fired]() { fired.set_value(); } );
+  ASSERT_EQ( future_status::ready, fired.get_future().wait_for( chrono::seconds( 1 ) ) );
+  thr.Kill();
+  ASSERT_EQ( 1000, ran.load() );
+  ASSERT_FALSE( thr.PostToDispatch( []() {} ) );
+}
+
+TEST( ReactorDispatchThreadShould, RunFdCallbacksOnTheDispatchThread )
+{
+  ReactorDispatchThread thr;
+  Pipe p;
+  promise<bool> readable;
+  atomic<int> reads{ 0 };
+  auto token = thr.WatchFd( p.ReadEnd(), EPOLLIN, [&]( uint32_t events ) {
+    char c;
+    ASSERT_EQ( 1, read( p.ReadEnd(), &c, 1 ) );
+    if( ++reads == 3 ) {
+      readable.set_value( ( events & EPOLLIN ) && thr.IsDispatchThread() );
+    }
+  } );
+  ASSERT_FALSE( token.expired() );
+  for( char c = 'a'; c < 'd'; c++ ) {
+    p.Write( c );
+  }
+  auto fut = readable.get_future();
+  ASSERT_EQ( future_status::ready, fut.wait_for( chrono::seconds( 1 ) ) );
+  ASSERT_TRUE( fut.get() );
+  LOCK_AND_CANCEL( token );
+}
+
+TEST( ReactorDispatchThreadShould, StopCallingBackOnceCanceled )
+{
+  ReactorDispatchThread thr;
+  Pipe p;
+  atomic<int> calls{ 0 };
+  auto token = thr.WatchFd( p.ReadEnd(), EPOLLIN, [&]( uint32_t ) {
+    calls++;
+    char c;
+    read( p.ReadEnd(), &c, 1 );
+  } );
+  p.Write( 'x' );
+  while( calls.load() == 0 ) {
+    this_thread::yield();
+  }
+  LOCK_AND_CANCEL( token );
+  p.Write( 'y' );
+  // Two round trips through the loop, the watch is released meanwhile
+  ASSERT_TRUE( thr.DispatchSync( []() {} ) );
+  ASSERT_TRUE( thr.DispatchSync( []() {} ) );
+  ASSERT_EQ( 1, calls.load() );
+  ASSERT_TRUE( token.expired() );
+}
+
+TEST( ReactorDispatchThreadShould, LetACallbackCancelItsOwnWatch )
+{
+  ReactorDispatchThread thr;
+  Pipe p;
+  atomic<int> calls{ 0 };
+  weak_ptr<ACancelableToken> token;
+  promise<void> tokenSet;
+  auto set = tokenSet.get_future().share();
+  token = thr.WatchFd( p.ReadEnd(), EPOLLIN, [&calls, &token, set]( uint32_t ) {
+    // Level triggered, without cancelling this would fire on every poll
+    set.wait();
+    calls++;
+    LOCK_AND_CANCEL( token );
+  } );
+  tokenSet.set_value();
+  p.Write( 'x' );
+  while( calls.load() == 0 ) {
+    this_thread::yield();
+  }
+  ASSERT_TRUE( thr.DispatchSync( []() {} ) );
+  ASSERT_TRUE( thr.DispatchSync( []() {} ) );
+  ASSERT_EQ( 1, calls.load() );
+}
+
+TEST( ReactorDispatchThreadShould, ServeIoWhileTasksKeepComing )
+{
+  ReactorDispatchThread thr;
+  Pipe p;
+  atomic<bool> served{ false };
+  auto token = thr.WatchFd( p.ReadEnd(), EPOLLIN, [&]( uint32_t ) {
+    char c;
+    read( p.ReadEnd(), &c, 1 );
+    served = true;
+  } );
+  // A task that keeps reposting itself must not starve the pipe
+  struct Repost
+  {
+    ReactorDispatchThread* m_pThr;
+    atomic<bool>* m_pServed;
+    void operator()()
+    {
+      if( !*m_pServed ) {
+        m_pThr->PostToDispatch( Repost{ m_pThr, m_pServed } );
+      }
+    }
+  };
+  thr.PostToDispatch( Repost{ &thr, &served } );
+  p.Write( 'x' );
+  auto start = chrono::steady_clock::now();
+  while( !served && chrono::steady_clock::now() - start < chrono::seconds( 1 ) ) {
+    this_thread::yield();
+  }
+  ASSERT_TRUE( served.load() );
+  LOCK_AND_CANCEL( token );
+}
+
+TEST( ReactorDispatchThreadShould, RejectABadFd )
+{
+  ReactorDispatchThread thr;
+  ASSERT_TRUE( thr.WatchFd( -1, EPOLLIN, []( uint32_t ) {} ).expired() );
+}
+#endif
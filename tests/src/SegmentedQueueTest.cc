@@ -0,0 +1,97 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <TsQueue.h>
+#include <SegmentedDeque.h>
+#include <memory>
+#include <thread>
+
+using namespace CppUtils;
+using namespace std;
+
+TEST( SegmentedDequeShould, KeepFifoOrderAcrossSegments )
+{
+  SegmentedDeque<int, 4> dq;
+  for( int i = 0; i < 10; i++ ) {
+    dq.push_back( i );
+  }
+  ASSERT_EQ( 10u, dq.size() );
+  ASSERT_EQ( 9, dq.back() );
+  for( int i = 0; i < 10; i++ ) {
+    ASSERT_EQ( i, dq.front() );
+    dq.pop_front();
+  }
+  ASSERT_TRUE( dq.empty() );
+}
+
+TEST( SegmentedDequeShould, RecycleDrainedSegments )
+{
+  SegmentedDeque<int, 4, 2> dq;
+  for( int i = 0; i < 16; i++ ) {
+    dq.push_back( i );
+  }
+  for( int i = 0; i < 16; i++ ) {
+    dq.pop_front();
+  }
+  // 3 of the 4 segments were drained, the free-list keeps 2 of them
+  ASSERT_EQ( 2u, dq.FreeSegments() );
+  for( int i = 0; i < 12; i++ ) {
+    dq.push_back( i );
+  }
+  ASSERT_EQ( 0u, dq.FreeSegments() );
+}
+
+TEST( SegmentedDequeShould, DestroyWhatIsLeftInIt )
+{
+  auto sp = make_shared<int>( 1 );
+  {
+    SegmentedDeque<shared_ptr<int>, 2> dq;
+    for( int i = 0; i < 5; i++ ) {
+      dq.push_back( sp );
+    }
+    dq.pop_front();
+    ASSERT_EQ( 5, sp.use_count() );
+  }
+  ASSERT_EQ( 1, sp.use_count() );
+}
+
+TEST( SegmentedQueueShould, HandOverItemsBetweenThreads )
+{
+  SegmentedQueue<unique_ptr<int>> q;
+  const int count = 10000;
+  thread producer( [ &q, count ]() {
+    for( int i = 0; i < count; i++ ) {
+      q.Emplace( new int( i ) );
+    }
+    q.Close();
+  } );
+  unique_ptr<int> item;
+  int expected = 0;
+  while( q.DeQueue( item ) ) {
+    ASSERT_EQ( expected++, *item );
+  }
+  producer.join();
+  ASSERT_EQ( count, expected );
+}
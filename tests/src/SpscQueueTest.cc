@@ -0,0 +1,63 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <SpscQueue.h>
+#include <thread>
+
+using namespace CppUtils;
+using namespace std;
+
+TEST( SpscQueueShould, RejectEnQueueWhenFull )
+{
+  SpscQueue<int> q( 2 );
+  ASSERT_EQ( 2u, q.Capacity() );
+  ASSERT_TRUE( q.TryEnQueue( 1 ) );
+  ASSERT_TRUE( q.TryEnQueue( 2 ) );
+  ASSERT_FALSE( q.TryEnQueue( 3 ) );
+  int val = 0;
+  ASSERT_TRUE( q.TryDeQueue( val ) );
+  ASSERT_EQ( 1, val );
+  ASSERT_TRUE( q.TryEnQueue( 3 ) );
+  ASSERT_EQ( 2u, q.Size() );
+}
+
+TEST( SpscQueueShould, HandOverItemsInOrderBetweenTwoThreads )
+{
+  SpscQueue<uint32_t> q( 8 );
+  const uint32_t count = 100000;
+  thread producer( [ &q, count ]() {
+    for( uint32_t i = 0; i < count; i++ ) {
+      q.EnQueue( i );
+    }
+  } );
+  bool inOrder = true;
+  for( uint32_t i = 0; i < count; i++ ) {
+    inOrder = inOrder && ( q.DeQueue() == i );
+  }
+  producer.join();
+  ASSERT_TRUE( inOrder );
+  uint32_t val;
+  ASSERT_FALSE( q.TryDeQueue( val ) );
+}
@@ -0,0 +1,128 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <Strand.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace CppUtils;
+using namespace std;
+
+TEST( StrandShould, RunTasksOneAtATimeInPostingOrder )
+{
+  const int strands = 8;
+  const int producers = 2;
+  const int count = 5000;
+  DispatchPool pool( 4 );
+  vector<unique_ptr<Strand>> strandList;
+  vector<vector<int>> seen( strands * producers );
+  vector<atomic<int>> inFlight( strands );
+  atomic<bool> overlapped{ false };
+  for( int s = 0; s < strands; s++ ) {
+    strandList.emplace_back( new Strand( pool ) );
+    inFlight[ s ] = 0;
+  }
+  vector<thread> threads;
+  for( int p = 0; p < producers; p++ ) {
+    threads.emplace_back( [&, p]() {
+      for( int i = 0; i < count; i++ ) {
+        for( int s = 0; s < strands; s++ ) {
+          strandList[ s ]->PostToDispatch( [&, s, p, i]() {
+            if( inFlight[ s ]++ != 0 ) {
+              overlapped = true;
+            }
+            seen[ s * producers + p ].push_back( i );
+            inFlight[ s ]--;
+          } );
+        }
+      }
+    } );
+  }
+  for( auto& t : threads ) {
+    t.join();
+  }
+  for( auto& spStrand : strandList ) {
+    spStrand->Kill();
+  }
+  ASSERT_FALSE( overlapped.load() );
+  for( auto& perProducer : seen ) {
+    ASSERT_EQ( count, (int)perProducer.size() );
+    for( int i = 0; i < count; i++ ) {
+      ASSERT_EQ( i, perProducer[ i ] );
+    }
+  }
+}
+
+TEST( StrandShould, RunQueuedTasksAndRejectNewOnesWhenKilled )
+{
+  DispatchPool pool( 2 );
+  Strand strand( pool );
+  atomic<int> runs{ 0 };
+  atomic<bool> current{ false };
+  atomic<bool> repostAccepted{ true };
+  strand.PostToDispatch( [&]() {
+    this_thread::sleep_for( chrono::milliseconds( 20 ) );
+    current = strand.IsCurrent();
+    runs++;
+    repostAccepted = strand.PostToDispatch( [&runs]() { runs++; } );
+  } );
+  strand.PostToDispatch( [&runs]() { runs++; } );
+  strand.Kill();
+  ASSERT_EQ( 2, runs.load() );
+  ASSERT_TRUE( current.load() );
+  ASSERT_FALSE( repostAccepted.load() );
+  ASSERT_FALSE( strand.IsCurrent() );
+  ASSERT_FALSE( strand.PostToDispatch( [&runs]() { runs++; } ) );
+}
+
+TEST( StrandShould, RunTasksOnThePostingThreadOnceThePoolIsKilled )
+{
+  DispatchPool pool( 1 );
+  Strand strand( pool );
+  pool.Kill();
+  thread::id ranOn;
+  ASSERT_TRUE( strand.PostToDispatch( [&ranOn]() { ranOn = this_thread::get_id(); } ) );
+  ASSERT_EQ( this_thread::get_id(), ranOn );
+}
+
+TEST( StrandShould, DrainOnTheWorkerWhenDestroyedFromAPoolTask )
+{
+  // The strand's drain is queued behind the task that destroys it, on the
+  // only worker there is
+  DispatchPool pool( 1 );
+  unique_ptr<Strand> spStrand( new Strand( pool ) );
+  atomic<bool> ran{ false };
+  promise<void> destroyed;
+  pool.PostToDispatch( [&]() {
+    spStrand->PostToDispatch( [&ran]() { ran = true; } );
+    spStrand.reset();
+    destroyed.set_value();
+  } );
+  ASSERT_EQ( future_status::ready, destroyed.get_future().wait_for( chrono::seconds( 5 ) ) );
+  ASSERT_TRUE( ran.load() );
+}
@@ -0,0 +1,110 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <Task.h>
+#include <array>
+#include <memory>
+
+using namespace CppUtils;
+using namespace std;
+
+namespace {
+struct LifeCounter
+{
+  explicit LifeCounter( int* pAlive ) : m_pAlive{ pAlive } { ( *m_pAlive )++; }
+  LifeCounter( LifeCounter&& other ) noexcept : m_pAlive{ other.m_pAlive } { ( *m_pAlive )++; }
+  LifeCounter( const LifeCounter& ) = delete;
+  ~LifeCounter() { ( *m_pAlive )--; }
+  int* m_pAlive;
+};
+
+void FreeFunction() { }
+}
+
+TEST( TaskShould, StoreSmallCallablesInlineAndBigOnesOnTheHeap )
+{
+  array<char, 48> small{};
+  array<char, 128> big{};
+  auto smallFn = [small]() { (void)small; };
+  auto bigFn = [big]() { (void)big; };
+  ASSERT_TRUE( Task::IsInline<decltype( smallFn )>() );
+  ASSERT_FALSE( Task::IsInline<decltype( bigFn )>() );
+  ASSERT_TRUE( BasicTask<256>::IsInline<decltype( bigFn )>() );
+}
+
+TEST( TaskShould, RunAndMoveMoveOnlyCaptures )
+{
+  unique_ptr<int> spValue( new int( 0 ) );
+  int* pValue = spValue.get();
+  struct Bump
+  {
+    unique_ptr<int> m_spValue;
+    void operator()() { ( *m_spValue )++; }
+  };
+  Task task( Bump{ std::move( spValue ) } );
+  ASSERT_TRUE( static_cast<bool>( task ) );
+  task();
+  Task moved( std::move( task ) );
+  ASSERT_FALSE( static_cast<bool>( task ) );
+  moved();
+  task = std::move( moved );
+  task();
+  ASSERT_EQ( 3, *pValue );
+}
+
+TEST( TaskShould, DestroyItsCallableExactlyOnce )
+{
+  int alive = 0;
+  {
+    struct Small
+    {
+      LifeCounter m_counter;
+      void operator()() { }
+    };
+    struct Big
+    {
+      LifeCounter m_counter;
+      char m_pad[ 128 ];
+      void operator()() { }
+    };
+    Task small( Small{ LifeCounter( &alive ) } );
+    Task big( Big{ LifeCounter( &alive ), {} } );
+    ASSERT_EQ( 2, alive );
+    Task other( std::move( small ) );
+    other = std::move( big );
+    ASSERT_EQ( 1, alive );
+    small = nullptr;
+  }
+  ASSERT_EQ( 0, alive );
+}
+
+TEST( TaskShould, BeEmptyForNullCallables )
+{
+  void ( *pNull )() = nullptr;
+  ASSERT_FALSE( static_cast<bool>( Task() ) );
+  ASSERT_FALSE( static_cast<bool>( Task( nullptr ) ) );
+  ASSERT_FALSE( static_cast<bool>( Task( pNull ) ) );
+  ASSERT_FALSE( static_cast<bool>( Task( function<void()>() ) ) );
+  ASSERT_TRUE( static_cast<bool>( Task( &FreeFunction ) ) );
+}
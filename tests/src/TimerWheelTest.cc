@@ -0,0 +1,98 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <TimerWheel.h>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+
+using namespace CppUtils;
+using namespace std;
+
+TEST( TimerWheelShould, FireTimersAcrossLevelsInDeadlineOrder )
+{
+  DispatchThread thr;
+  // 1us ticks put these timeouts on levels 0, 1 and 2
+  TimerWheel wheel( thr, chrono::microseconds( 1 ) );
+  auto start = chrono::steady_clock::now();
+  vector<pair<int, chrono::steady_clock::duration>> fired;
+  promise<void> done;
+  wheel.Arm( chrono::milliseconds( 100 ), [&]() { fired.push_back( make_pair( 2, chrono::steady_clock::now() - start ) ); done.set_value(); } );
+  wheel.Arm( chrono::milliseconds( 10 ), [&]() { fired.push_back( make_pair( 1, chrono::steady_clock::now() - start ) ); } );
+  wheel.Arm( chrono::microseconds( 100 ), [&]() { fired.push_back( make_pair( 0, chrono::steady_clock::now() - start ) ); } );
+  ASSERT_EQ( 3u, wheel.Size() );
+  ASSERT_EQ( future_status::ready, done.get_future().wait_for( chrono::seconds( 2 ) ) );
+  ASSERT_EQ( 3u, fired.size() );
+  ASSERT_EQ( 0, fired[ 0 ].first );
+  ASSERT_GE( fired[ 0 ].second, chrono::microseconds( 100 ) );
+  ASSERT_EQ( 1, fired[ 1 ].first );
+  ASSERT_GE( fired[ 1 ].second, chrono::milliseconds( 10 ) );
+  ASSERT_EQ( 2, fired[ 2 ].first );
+  ASSERT_GE( fired[ 2 ].second, chrono::milliseconds( 100 ) );
+  ASSERT_EQ( 0u, wheel.Size() );
+}
+
+TEST( TimerWheelShould, OnlyFireTimersThatWereNotCanceled )
+{
+  DispatchThread thr;
+  TimerWheel wheel( thr );
+  const int count = 10000;
+  atomic<int> fired{ 0 };
+  atomic<int> firedCanceled{ 0 };
+  vector<weak_ptr<ACancelableToken>> tokens;
+  for( int i = 0; i < count; i++ ) {
+    bool cancel = i % 2 == 1;
+    tokens.push_back( wheel.Arm( chrono::milliseconds( 500 + i % 300 ), [&fired, &firedCanceled, cancel]() {
+      ( cancel ? firedCanceled : fired )++;
+    } ) );
+  }
+  for( int i = 1; i < count; i += 2 ) {
+    LOCK_AND_CANCEL( tokens[ i ] );
+    ASSERT_TRUE( tokens[ i ].expired() );
+  }
+  ASSERT_EQ( size_t( count / 2 ), wheel.Size() );
+  auto deadline = chrono::steady_clock::now() + chrono::seconds( 5 );
+  while( fired < count / 2 && chrono::steady_clock::now() < deadline ) {
+    this_thread::sleep_for( chrono::milliseconds( 5 ) );
+  }
+  ASSERT_EQ( count / 2, fired.load() );
+  ASSERT_EQ( 0, firedCanceled.load() );
+  ASSERT_EQ( 0u, wheel.Size() );
+}
+
+TEST( TimerWheelShould, DropPendingTimersWhenDestroyed )
+{
+  DispatchThread thr;
+  atomic<bool> ran{ false };
+  weak_ptr<ACancelableToken> wpToken;
+  {
+    TimerWheel wheel( thr );
+    wpToken = wheel.Arm( chrono::milliseconds( 10 ), [&ran]() { ran = true; } );
+    ASSERT_FALSE( wpToken.expired() );
+  }
+  ASSERT_TRUE( wpToken.expired() );
+  this_thread::sleep_for( chrono::milliseconds( 30 ) );
+  ASSERT_FALSE( ran.load() );
+}
@@ -0,0 +1,177 @@
+/**
+ * The MIT License (MIT)
+ *
+ * Copyright (c) <2014> <Kartik Aiyer>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <TsQueue.h>
+#include <iterator>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace CppUtils;
+using namespace std;
+
+TEST( TsQueueShould, EnQueueARangeAndDeQueueItAllAtOnce )
+{
+  TsQueue<int> q;
+  vector<int> in{ 1, 2, 3, 4, 5 };
+  q.EnQueueRange( in.begin(), in.end() );
+  vector<int> out;
+  ASSERT_EQ( 5u, q.DeQueueAll( back_inserter( out ) ) );
+  ASSERT_EQ( in, out );
+}
+
+TEST( TsQueueShould, DeQueueNoMoreThanRequested )
+{
+  TsQueue<int> q;
+  vector<int> in{ 1, 2, 3, 4, 5 };
+  q.EnQueueRange( in.begin(), in.end() );
+  vector<int> out;
+  ASSERT_EQ( 3u, q.DeQueueUpTo( 3, back_inserter( out ) ) );
+  ASSERT_EQ( vector<int>( { 1, 2, 3 } ), out );
+  ASSERT_EQ( 2u, q.DeQueueUpTo( 3, back_inserter( out ) ) );
+  ASSERT_EQ( in, out );
+}
+
+TEST( TsQueueShould, BlockABatchDeQueueUntilAnItemArrives )
+{
+  TsQueue<int> q;
+  thread producer( [ &q ]() {
+    this_thread::sleep_for( chrono::milliseconds( 10 ) );
+    q.EnQueue( 42 );
+  } );
+  vector<int> out;
+  ASSERT_EQ( 1u, q.DeQueueAll( back_inserter( out ) ) );
+  ASSERT_EQ( 42, out[ 0 ] );
+  producer.join();
+}
+
+TEST( TsQueueShould, QueueMoveOnlyItems )
+{
+  TsQueue<unique_ptr<int>> q;
+  q.EnQueue( unique_ptr<int>( new int( 7 ) ) );
+  q.Emplace( new int( 8 ) );
+  ASSERT_EQ( 7, *q.DeQueue() );
+  ASSERT_EQ( 8, *q.DeQueue() );
+}
+
+TEST( TsQueueShould, NotCopyItemsThatAreMovedIn )
+{
+  struct CopyCounter
+  {
+    CopyCounter() : m_pCopies{ nullptr } { }
+    CopyCounter( int& copies ) : m_pCopies{ &copies } { }
+    CopyCounter( const CopyCounter& other ) : m_pCopies{ other.m_pCopies } { ( *m_pCopies )++; }
+    CopyCounter( CopyCounter&& other ) : m_pCopies{ other.m_pCopies } { }
+    CopyCounter& operator=( const CopyCounter& other ) { m_pCopies = other.m_pCopies; ( *m_pCopies )++; return *this; }
+    CopyCounter& operator=( CopyCounter&& other ) { m_pCopies = other.m_pCopies; return *this; }
+    int* m_pCopies;
+  };
+  int copies = 0;
+  TsQueue<CopyCounter> q;
+  q.EnQueue( CopyCounter( copies ) );
+  q.Emplace( copies );
+  q.DeQueue();
+  q.DeQueue();
+  ASSERT_EQ( 0, copies );
+}
+
+TEST( TsQueueShould, NotBlockOnTryDeQueue )
+{
+  TsQueue<int> q;
+  int val = 0;
+  ASSERT_FALSE( q.TryDeQueue( val ) );
+  q.EnQueue( 3 );
+  ASSERT_TRUE( q.TryDeQueue( val ) );
+  ASSERT_EQ( 3, val );
+}
+
+TEST( TsQueueShould, TimeOutWhenNothingArrives )
+{
+  TsQueue<int> q;
+  int val = 0;
+  auto start = chrono::steady_clock::now();
+  ASSERT_FALSE( q.DeQueueFor( val, chrono::milliseconds( 20 ) ) );
+  ASSERT_TRUE( chrono::steady_clock::now() - start >= chrono::milliseconds( 20 ) );
+  q.EnQueue( 5 );
+  ASSERT_TRUE( q.DeQueueUntil( val, chrono::steady_clock::now() + chrono::milliseconds( 20 ) ) );
+  ASSERT_EQ( 5, val );
+}
+
+TEST( TsQueueShould, WakeWaitersAndRejectEnQueuesWhenClosed )
+{
+  TsQueue<int> q;
+  q.EnQueue( 1 );
+  thread consumer( [ &q ]() {
+    int val = 0;
+    while( q.DeQueue( val ) );
+  } );
+  this_thread::sleep_for( chrono::milliseconds( 10 ) );
+  q.Close();
+  consumer.join();
+  ASSERT_TRUE( q.IsClosed() );
+  ASSERT_FALSE( q.EnQueue( 2 ) );
+}
+
+TEST( TsQueueShould, HandOutQueuedItemsAfterClose )
+{
+  TsQueue<int> q;
+  q.EnQueue( 1 );
+  q.Close();
+  int val = 0;
+  ASSERT_TRUE( q.DeQueue( val ) );
+  ASSERT_EQ( 1, val );
+  ASSERT_FALSE( q.DeQueue( val ) );
+}
+
+template<typename WaitStrategy>
+static bool HandOverWith()
+{
+  TsQueue<int, WaitStrategy> q;
+  const int count = 10000;
+  thread producer( [ &q, count ]() {
+    for( int i = 0; i < count; i++ ) {
+      q.EnQueue( i );
+    }
+  } );
+  bool inOrder = true;
+  for( int i = 0; i < count; i++ ) {
+    inOrder = inOrder && ( q.DeQueue() == i );
+  }
+  producer.join();
+  int val = 0;
+  inOrder = inOrder && !q.DeQueueFor( val, chrono::milliseconds( 1 ) );
+  q.Close();
+  return inOrder && !q.DeQueue( val );
+}
+
+TEST( TsQueueShould, WorkWithEveryWaitStrategy )
+{
+  ASSERT_TRUE( HandOverWith<BlockingWait>() );
+  ASSERT_TRUE( HandOverWith<SpinThenParkWait<>>() );
+  ASSERT_TRUE( ( HandOverWith<SpinThenParkWait<16, 16>>() ) );
+  ASSERT_TRUE( HandOverWith<YieldWait>() );
+  ASSERT_TRUE( HandOverWith<SpinPauseWait>() );
+  ASSERT_TRUE( HandOverWith<BusySpinWait>() );
+}